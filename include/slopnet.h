@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 #define SNET_BLOB_FMT "%.*s"
 #define SNET_BLOB_FMT_ARGS(BLOB) (int)(BLOB).size, (char*)(BLOB).ptr
@@ -19,6 +20,37 @@ typedef struct {
 	void* logctx;
 
 	bool insecure_tls;
+	// Talk to the lobby over plain HTTP, such as the local server in server/.
+	// insecure_tls is then ignored.
+	bool plain_http;
+
+	// Ask the lobby for its compact binary encoding instead of JSON.
+	// Responses are still decoded according to their Content-Type.
+	bool binary_lobby;
+
+	// Run requests and the game connection on a background thread.
+	// Events are still returned by snet_next_event on the calling thread but
+	// log may be called from the background thread.
+	// Ignored on the web.
+	bool threaded;
+
+	// How long to try getting the game connection back after it drops before
+	// giving up with SNET_EVENT_DISCONNECTED.
+	// 0 means 10 seconds and a negative value disables reconnection.
+	double reconnect_timeout;
+
+	// Most bytes of messages handed to the game connection per snet_update,
+	// 0 for no limit.
+	// When set, messages are queued by snet_send and sent by snet_update
+	// highest priority first.
+	// Reliable messages which do not fit wait for the next update while
+	// unreliable ones are dropped.
+	size_t send_budget;
+
+	// How many earlier snet_send_redundant messages go along with each new
+	// one.
+	// 0 means 3 and a negative value sends each message only once.
+	int redundancy;
 } snet_config_t;
 
 typedef struct {
@@ -33,6 +65,20 @@ typedef enum {
 	SNET_EVENT_JOIN_GAME_FINISHED,
 	SNET_EVENT_MESSAGE,
 	SNET_EVENT_DISCONNECTED,
+	SNET_EVENT_GAME_ADDED,
+	SNET_EVENT_GAME_UPDATED,
+	SNET_EVENT_GAME_REMOVED,
+	// The game connection dropped and is being restored.
+	// Reliable messages sent meanwhile are queued.
+	SNET_EVENT_RECONNECTING,
+	// Messages sent by others while reconnecting may have been missed
+	SNET_EVENT_RECONNECTED,
+	// Something was written to or sent from a stream opened by this instance
+	SNET_EVENT_STREAM_PROGRESS,
+	// Another player opened a stream
+	SNET_EVENT_STREAM_OPENED,
+	SNET_EVENT_STREAM_DATA,
+	SNET_EVENT_STREAM_CLOSED,
 } snet_event_type_t;
 
 typedef enum {
@@ -58,6 +104,7 @@ typedef enum {
 	SNET_CREATING_GAME,
 	SNET_JOINING_GAME,
 	SNET_JOINED_GAME,
+	SNET_RECONNECTING,
 } snet_lobby_state_t;
 
 typedef struct {
@@ -69,7 +116,12 @@ typedef struct {
 typedef struct {
 	snet_op_status_t status;
 	int num_games;
+	// Equal creator or data strings within one list share the same pointer.
+	// Valid until the next list call.
 	const snet_game_info_t* games;
+	// Pass this as snet_list_games_options_t.cursor to get the next page.
+	// Empty on the last page.
+	snet_blob_t next_cursor;
 } snet_list_games_result_t;
 
 typedef struct {
@@ -99,17 +151,68 @@ typedef struct {
 	snet_blob_t data;
 } snet_message_t;
 
+typedef struct {
+	uint64_t id;
+	size_t num_bytes_written;
+	size_t num_bytes_sent;
+	// Everything was sent, this is the last event for the stream
+	bool finished;
+	// The game connection was lost or there was none, this is the last event
+	// for the stream
+	bool aborted;
+} snet_stream_progress_t;
+
+// For SNET_EVENT_STREAM_OPENED, SNET_EVENT_STREAM_DATA and
+// SNET_EVENT_STREAM_CLOSED
+typedef struct {
+	uint64_t id;
+	// Where data starts in the stream or its total size once closed
+	size_t offset;
+	snet_blob_t data;
+} snet_stream_chunk_t;
+
 typedef enum {
 	SNET_GAME_PUBLIC,
 	SNET_GAME_PRIVATE,
 } snet_game_visibility_t;
 
+// Only matters when snet_config_t.send_budget is set.
+// Messages of the same priority keep their order.
+typedef enum {
+	SNET_PRIORITY_NORMAL,
+	// Such as player input
+	SNET_PRIORITY_HIGH,
+	// Such as bulk transfers
+	SNET_PRIORITY_LOW,
+} snet_priority_t;
+
 typedef struct {
 	snet_game_visibility_t visibility;
 	int max_num_players;
 	snet_blob_t data;
+	// Join the game as soon as it is created.
+	// SNET_EVENT_JOIN_GAME_FINISHED follows SNET_EVENT_CREATE_GAME_FINISHED.
+	bool join;
 } snet_game_options_t;
 
+typedef enum {
+	SNET_LIST_ANY_VISIBILITY,
+	SNET_LIST_PUBLIC_ONLY,
+	SNET_LIST_PRIVATE_ONLY,
+} snet_list_visibility_t;
+
+typedef struct {
+	// 0 lets the server decide
+	int page_size;
+	// Empty for the first page
+	snet_blob_t cursor;
+
+	snet_list_visibility_t visibility;
+	bool has_free_slots;
+	snet_blob_t creator;
+	snet_blob_t data_prefix;
+} snet_list_games_options_t;
+
 typedef struct {
 	snet_event_type_t type;
 
@@ -119,6 +222,11 @@ typedef struct {
 		snet_list_games_result_t list_games;
 		snet_join_game_result_t join_game;
 		snet_message_t message;
+		snet_stream_progress_t stream_progress;
+		snet_stream_chunk_t stream;
+		// For SNET_EVENT_GAME_* events.
+		// Valid until the next call to snet_update.
+		snet_game_info_t game;
 	};
 } snet_event_t;
 
@@ -131,9 +239,25 @@ snet_cleanup(snet_t* snet);
 void
 snet_update(snet_t* snet);
 
+// Like snet_update but stops after roughly max_microseconds.
+// The game connection is always updated, then the lobby tasks and the
+// connection pools until the budget runs out.
+// What is left over is picked up first by the next call.
+void
+snet_update_budgeted(snet_t* snet, int max_microseconds);
+
 size_t
 snet_max_message_size(void);
 
+// Estimate of the relay's clock in seconds, which every player in the game
+// shares, such as for interpolation and lag compensation.
+// error, which may be NULL, is how far off it can be.
+// The estimate can jump by up to that much when a better measurement comes
+// in.
+// Returns false until the game connection has measured it.
+bool
+snet_server_time(snet_t* snet, double* time, double* error);
+
 const snet_event_t*
 snet_next_event(snet_t* snet);
 
@@ -158,13 +282,130 @@ snet_create_game(snet_t* snet, const snet_game_options_t* options);
 void
 snet_list_games(snet_t* snet);
 
+void
+snet_list_games_ex(snet_t* snet, const snet_list_games_options_t* options);
+
+// Keeps a local table of games up to date by polling /game/list and reports
+// changes as SNET_EVENT_GAME_* events.
+// Only the first page is watched when options->page_size is set.
+void
+snet_watch_games(snet_t* snet, const snet_list_games_options_t* options, double poll_interval);
+
+// Like snet_watch_games but changes are pushed by the server through
+// /game/events instead of being polled.
+// Falls back to polling every poll_interval seconds when the server has no
+// /game/events or the connection cannot stream.
+void
+snet_subscribe_games(snet_t* snet, const snet_list_games_options_t* options, double poll_interval);
+
+// Stops both snet_watch_games and snet_subscribe_games
+void
+snet_unwatch_games(snet_t* snet);
+
+// The array is only valid until the next call to snet_update
+const snet_game_info_t*
+snet_watched_games(snet_t* snet, int* num_games);
+
+const snet_game_info_t*
+snet_find_watched_game(snet_t* snet, snet_blob_t join_token);
+
 void
 snet_join_game(snet_t* snet, snet_blob_t join_token);
 
 void
 snet_exit_game(snet_t* snet);
 
+// Same as snet_send_prioritized with SNET_PRIORITY_NORMAL
 void
 snet_send(snet_t* snet, snet_blob_t message, bool reliable);
 
+void
+snet_send_prioritized(snet_t* snet, snet_blob_t message, bool reliable, snet_priority_t priority);
+
+// Unreliable but every datagram also carries the last
+// snet_config_t.redundancy messages, so one lost datagram loses nothing,
+// such as for player input.
+// Receivers report each message once and in order.
+// When snet_config_t.send_budget is set, the messages of one update go out
+// together in as few datagrams as they fit in, ahead of everything else.
+// message.size must fit in 16 bits.
+void
+snet_send_redundant(snet_t* snet, snet_blob_t message);
+
+// Streams carry data too big for a single message, such as a replay or a
+// save file, to the other players.
+// They are sent in the background alongside messages, only using what is
+// left of snet_config_t.send_budget, and reported with
+// SNET_EVENT_STREAM_PROGRESS.
+// Streams do not survive a lost game connection.
+// Players who join after a stream was opened do not receive it.
+uint64_t
+snet_stream_open(snet_t* snet);
+
+// The data is copied
+void
+snet_stream_write(snet_t* snet, uint64_t stream, snet_blob_t data);
+
+// The stream finishes once everything written so far has been sent
+void
+snet_stream_close(snet_t* snet, uint64_t stream);
+
+// Drives many instances from a pool of worker threads, mainly for load
+// testing.
+// Instances are spread over shards which share arena and connection pools.
+// Every update, idle workers keep taking shards until none are left so one
+// slow shard does not hold up the rest.
+typedef struct snet_group_s snet_group_t;
+
+typedef struct {
+	// Used for every instance
+	snet_config_t config;
+	// 0 updates every instance on the calling thread.
+	// Ignored on the web.
+	int num_workers;
+	void* userdata;
+
+	// Called from a worker after an instance has been updated.
+	// Only that instance may be used from it.
+	void (*update)(snet_t* snet, void* instance_userdata, void* userdata);
+	// Called from a worker for every event of an instance
+	void (*event)(snet_t* snet, const snet_event_t* event, void* instance_userdata, void* userdata);
+} snet_group_config_t;
+
+typedef struct {
+	int num_instances;
+	int num_authorized;
+	int num_in_game;
+
+	uint64_t num_messages_sent;
+	uint64_t num_bytes_sent;
+	uint64_t num_messages_received;
+	uint64_t num_bytes_received;
+
+	// Of the last snet_group_update, in seconds
+	double update_time;
+	// Longest time a single shard took in the last snet_group_update
+	double max_shard_time;
+} snet_group_stats_t;
+
+snet_group_t*
+snet_group_init(const snet_group_config_t* config);
+
+void
+snet_group_cleanup(snet_group_t* group);
+
+// Must not be called during snet_group_update
+snet_t*
+snet_group_add(snet_group_t* group, void* instance_userdata);
+
+// Must not be called during snet_group_update
+void
+snet_group_remove(snet_group_t* group, snet_t* snet);
+
+void
+snet_group_update(snet_group_t* group);
+
+void
+snet_group_stats(snet_group_t* group, snet_group_stats_t* stats);
+
 #endif
@@ -0,0 +1,232 @@
+// Headless load test which runs many players in one snet_group_t.
+// Meant to be pointed at the local server in server/ which needs one relay
+// per 32 players.
+//
+// Every players_per_game instances share a game created by the first of them
+// and each player sends a small unreliable message every tick.
+#include <slopnet.h>
+#include <cute_alloc.h>
+#include <cute_time.h>
+#include <SDL3/SDL_timer.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#define LOADTEST_MAX_JOIN_TOKEN_SIZE 128
+#define LOADTEST_MESSAGE_SIZE 32
+
+typedef struct {
+	// Set by the creator once join_token is written
+	atomic_bool created;
+	char join_token[LOADTEST_MAX_JOIN_TOKEN_SIZE];
+	size_t join_token_size;
+} loadtest_game_t;
+
+typedef struct {
+	int index;
+	bool creator;
+	loadtest_game_t* game;
+
+	bool logging_in;
+	bool joining;
+	uint32_t num_ticks;
+} loadtest_player_t;
+
+static volatile sig_atomic_t loadtest_quit = 0;
+
+static void
+loadtest_on_signal(int sig) {
+	loadtest_quit = 1;
+}
+
+static double
+loadtest_seconds(void) {
+	return (double)cf_get_ticks() / (double)cf_get_tick_frequency();
+}
+
+static void
+loadtest_update(snet_t* snet, void* instance_userdata, void* userdata) {
+	loadtest_player_t* player = instance_userdata;
+
+	snet_auth_state_t auth_state = snet_auth_state(snet);
+	if (auth_state == SNET_UNAUTHORIZED && !player->logging_in) {
+		// The local server hands out a guest name for an empty cookie
+		player->logging_in = true;
+		snet_login_with_cookie(snet, (snet_blob_t){ 0 });
+		return;
+	}
+	if (auth_state != SNET_AUTHORIZED) { return; }
+
+	snet_lobby_state_t lobby_state = snet_lobby_state(snet);
+	if (lobby_state == SNET_IN_LOBBY && !player->joining) {
+		if (player->creator) {
+			player->joining = true;
+			snet_create_game(snet, &(snet_game_options_t){
+				.visibility = SNET_GAME_PRIVATE,
+				.data = { .ptr = "loadtest", .size = sizeof("loadtest") - 1 },
+				.join = true,
+			});
+		} else if (atomic_load_explicit(&player->game->created, memory_order_acquire)) {
+			player->joining = true;
+			snet_join_game(snet, (snet_blob_t){
+				.ptr = player->game->join_token,
+				.size = player->game->join_token_size,
+			});
+		}
+	} else if (lobby_state == SNET_JOINED_GAME) {
+		char message[LOADTEST_MESSAGE_SIZE] = { 0 };
+		memcpy(message, &player->index, sizeof(player->index));
+		memcpy(message + sizeof(player->index), &player->num_ticks, sizeof(player->num_ticks));
+		snet_send(snet, (snet_blob_t){ .ptr = message, .size = sizeof(message) }, false);
+		player->num_ticks += 1;
+	}
+}
+
+static void
+loadtest_event(snet_t* snet, const snet_event_t* event, void* instance_userdata, void* userdata) {
+	loadtest_player_t* player = instance_userdata;
+
+	switch (event->type) {
+		case SNET_EVENT_LOGIN_FINISHED:
+			if (event->login.status != SNET_OK) { player->logging_in = false; }
+			break;
+		case SNET_EVENT_CREATE_GAME_FINISHED:
+			if (event->create_game.status == SNET_OK) {
+				snet_blob_t token = event->create_game.info.join_token;
+				if (token.size <= LOADTEST_MAX_JOIN_TOKEN_SIZE) {
+					memcpy(player->game->join_token, token.ptr, token.size);
+					player->game->join_token_size = token.size;
+					atomic_store_explicit(&player->game->created, true, memory_order_release);
+				}
+			} else {
+				player->joining = false;
+			}
+			break;
+		case SNET_EVENT_JOIN_GAME_FINISHED:
+			if (event->join_game.status != SNET_OK) { player->joining = false; }
+			break;
+		case SNET_EVENT_DISCONNECTED:
+			player->joining = false;
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+loadtest_usage(const char* program) {
+	fprintf(
+		stderr,
+		"Usage: %s [options]\n"
+		"  --host <host>              Lobby host (default: 127.0.0.1)\n"
+		"  --port <port>              Lobby port (default: 8080)\n"
+		"  --instances <n>            Number of players (default: 1000)\n"
+		"  --players-per-game <n>     Players sharing a game (default: 8)\n"
+		"  --workers <n>              Worker threads besides the main one (default: 3)\n"
+		"  --tick-rate <hz>           Updates per second (default: 30)\n"
+		"  --duration <seconds>       Stop after this long, 0 runs until interrupted (default: 0)\n",
+		program
+	);
+}
+
+int
+main(int argc, const char* argv[]) {
+	const char* host = "127.0.0.1";
+	int port = 8080;
+	int num_instances = 1000;
+	int players_per_game = 8;
+	int num_workers = 3;
+	double tick_rate = 30.0;
+	double duration = 0.0;
+
+	for (int i = 1; i < argc; ++i) {
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--host") == 0 && has_value) {
+			host = argv[++i];
+		} else if (strcmp(argv[i], "--port") == 0 && has_value) {
+			port = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--instances") == 0 && has_value) {
+			num_instances = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--players-per-game") == 0 && has_value) {
+			players_per_game = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--workers") == 0 && has_value) {
+			num_workers = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--tick-rate") == 0 && has_value) {
+			tick_rate = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--duration") == 0 && has_value) {
+			duration = atof(argv[++i]);
+		} else {
+			loadtest_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (num_instances < 1) { num_instances = 1; }
+	if (players_per_game < 1) { players_per_game = 1; }
+	if (tick_rate <= 0.0) { tick_rate = 30.0; }
+
+	snet_group_t* group = snet_group_init(&(snet_group_config_t){
+		.config = {
+			.host = host,
+			.port = port,
+			.path = "",
+			.plain_http = true,
+		},
+		.num_workers = num_workers,
+		.update = loadtest_update,
+		.event = loadtest_event,
+	});
+
+	int num_games = (num_instances + players_per_game - 1) / players_per_game;
+	loadtest_game_t* games = cf_alloc(sizeof(loadtest_game_t) * num_games);
+	for (int i = 0; i < num_games; ++i) {
+		games[i] = (loadtest_game_t){ 0 };
+		atomic_init(&games[i].created, false);
+	}
+	loadtest_player_t* players = cf_alloc(sizeof(loadtest_player_t) * num_instances);
+	for (int i = 0; i < num_instances; ++i) {
+		players[i] = (loadtest_player_t){
+			.index = i,
+			.creator = i % players_per_game == 0,
+			.game = &games[i / players_per_game],
+		};
+		snet_group_add(group, &players[i]);
+	}
+
+	signal(SIGINT, loadtest_on_signal);
+	signal(SIGTERM, loadtest_on_signal);
+
+	double start_time = loadtest_seconds();
+	double next_report = start_time + 1.0;
+	snet_group_stats_t last_stats = { 0 };
+	while (!loadtest_quit && (duration <= 0.0 || loadtest_seconds() - start_time < duration)) {
+		double tick_start = loadtest_seconds();
+		snet_group_update(group);
+
+		double now = loadtest_seconds();
+		if (now >= next_report) {
+			snet_group_stats_t stats;
+			snet_group_stats(group, &stats);
+			fprintf(
+				stderr,
+				"%6.0fs  authorized %d/%d  in game %d  sent %llu msg/s  received %llu msg/s  update %.1fms (slowest shard %.1fms)\n",
+				now - start_time,
+				stats.num_authorized, stats.num_instances, stats.num_in_game,
+				(unsigned long long)(stats.num_messages_sent - last_stats.num_messages_sent),
+				(unsigned long long)(stats.num_messages_received - last_stats.num_messages_received),
+				stats.update_time * 1000.0, stats.max_shard_time * 1000.0
+			);
+			last_stats = stats;
+			next_report += 1.0;
+		}
+
+		double remaining = 1.0 / tick_rate - (now - tick_start);
+		if (remaining > 0.0) { SDL_Delay((uint32_t)(remaining * 1000.0)); }
+	}
+
+	snet_group_cleanup(group);
+	cf_free(players);
+	cf_free(games);
+	return 0;
+}
@@ -116,6 +116,12 @@ main(int argc, const char* argv[]) {
 				case SNET_EVENT_DISCONNECTED:
 					fprintf(stderr, "Disconnected\n");
 					break;
+				case SNET_EVENT_RECONNECTING:
+					fprintf(stderr, "Connection lost, reconnecting\n");
+					break;
+				case SNET_EVENT_RECONNECTED:
+					fprintf(stderr, "Reconnected\n");
+					break;
 				case SNET_EVENT_LIST_GAMES_FINISHED:
 					if (snet_event->list_games.status == SNET_OK) {
 						num_games = snet_event->list_games.num_games;
@@ -196,6 +202,9 @@ main(int argc, const char* argv[]) {
 								snet_send(snet, msg, true);
 							}
 						} break;
+						case SNET_RECONNECTING: {
+							ImGui_LabelText("Status", "Reconnecting");
+						} break;
 					}
 				} break;
 			}
@@ -0,0 +1,812 @@
+// Local stand-in for the lobby and game servers.
+// Serves /auth/cookie, /game/create, /game/list, /game/join and /game/events
+// over plain HTTP and relays game messages through cute_net.
+// Point snet_config_t.host/port at it with plain_http set.
+#include <cute_networking.h>
+#include <cute_json.h>
+#include <cute_alloc.h>
+#include <SDL3/SDL_timer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include "slopnet_time.h"
+#include "slopnet_packet.h"
+#include "slopnet_clock.h"
+
+#define WBY_STATIC
+#define WBY_IMPLEMENTATION
+#include "wby.h"
+
+#define SNET_SERVER_MAX_BODY_SIZE 65536
+#define SNET_SERVER_MAX_QUERY_VAR_SIZE 1024
+// Fixed by cute_net
+#define SNET_SERVER_MAX_RELAY_CLIENTS 32
+#define SNET_SERVER_JOIN_TOKEN_SIZE 16
+#define SNET_SERVER_CONNECT_TOKEN_EXPIRY 60
+#define SNET_SERVER_HANDSHAKE_TIMEOUT 5
+#define SNET_SERVER_DEFAULT_PAGE_SIZE 50
+#define SNET_SERVER_MAX_PAGE_SIZE 1000
+// Recent game changes kept for /game/events
+#define SNET_SERVER_MAX_EVENTS 1024
+// Milliseconds, sent to event stream clients
+#define SNET_SERVER_EVENT_RETRY 1000
+
+typedef struct {
+	char* ptr;
+	size_t size;
+	size_t capacity;
+} snet_server_buf_t;
+
+typedef struct {
+	uint32_t id;
+	char join_token[SNET_SERVER_JOIN_TOKEN_SIZE * 2 + 1];
+	char* creator;
+	char* data;
+	bool is_public;
+	int max_num_players;
+	int num_players;
+	// Empty games are closed once somebody has played in them
+	bool started;
+	int relay;
+} snet_server_game_t;
+
+typedef enum {
+	SNET_SERVER_GAME_CREATED,
+	SNET_SERVER_GAME_UPDATED,
+	SNET_SERVER_GAME_CLOSED,
+} snet_server_event_type_t;
+
+// The game as it was when the event happened
+typedef struct {
+	uint64_t id;
+	snet_server_event_type_t type;
+	snet_server_game_t game;
+} snet_server_event_t;
+
+typedef struct {
+	int visibility;  // 0 for any, 1 for public, 2 for private
+	bool has_free_slots;
+	bool filter_creator;
+	char creator[SNET_SERVER_MAX_QUERY_VAR_SIZE];
+	bool filter_data;
+	char data_prefix[SNET_SERVER_MAX_QUERY_VAR_SIZE];
+} snet_server_filter_t;
+
+typedef struct {
+	CF_Server* server;
+	char address[64];
+	int num_clients;
+	// Game id of each client, 0 for free slots
+	uint32_t client_games[SNET_SERVER_MAX_RELAY_CLIENTS];
+} snet_server_relay_t;
+
+typedef struct {
+	struct wby_server httpd;
+	void* httpd_memory;
+
+	CF_CryptoSignPublic public_key;
+	CF_CryptoSignSecret secret_key;
+	snet_server_relay_t* relays;
+	int num_relays;
+	int next_relay;
+	uint32_t next_client_seq;
+
+	// Sorted by id which doubles as the list cursor
+	snet_server_game_t* games;
+	int num_games;
+	int games_capacity;
+	uint32_t next_game_id;
+	// Changes whenever the list does, used as its ETag
+	uint64_t revision;
+	// Ring of the last SNET_SERVER_MAX_EVENTS events, indexed by id
+	snet_server_event_t events[SNET_SERVER_MAX_EVENTS];
+	uint64_t last_event_id;
+
+	int num_guests;
+	char body[SNET_SERVER_MAX_BODY_SIZE + 1];
+	snet_server_buf_t response;
+	bool verbose;
+} snet_server_t;
+
+static volatile sig_atomic_t snet_server_quit = 0;
+
+static void
+snet_server_on_signal(int sig) {
+	snet_server_quit = 1;
+}
+
+static void
+snet_server_log(snet_server_t* server, const char* fmt, ...) {
+	if (!server->verbose) { return; }
+
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+}
+
+static char*
+snet_server_strdup(const char* str) {
+	size_t len = strlen(str);
+	char* copy = cf_alloc(len + 1);
+	memcpy(copy, str, len + 1);
+	return copy;
+}
+
+static bool
+snet_server_ends_with(const char* str, const char* suffix) {
+	size_t len = strlen(str);
+	size_t suffix_len = strlen(suffix);
+	return len >= suffix_len && strcmp(str + len - suffix_len, suffix) == 0;
+}
+
+// Response buffer {{{
+
+static void
+snet_server_buf_append(snet_server_buf_t* buf, const void* data, size_t size) {
+	if (buf->size + size > buf->capacity) {
+		size_t capacity = buf->capacity > 0 ? buf->capacity : 1024;
+		while (capacity < buf->size + size) { capacity *= 2; }
+		buf->ptr = cf_realloc(buf->ptr, capacity);
+		buf->capacity = capacity;
+	}
+
+	memcpy(buf->ptr + buf->size, data, size);
+	buf->size += size;
+}
+
+static void
+snet_server_buf_printf(snet_server_buf_t* buf, const char* fmt, ...) {
+	char tmp[256];
+	va_list args;
+	va_start(args, fmt);
+	int size = vsnprintf(tmp, sizeof(tmp), fmt, args);
+	va_end(args);
+	if (size > 0) { snet_server_buf_append(buf, tmp, (size_t)size < sizeof(tmp) ? (size_t)size : sizeof(tmp) - 1); }
+}
+
+static void
+snet_server_buf_json_string(snet_server_buf_t* buf, const char* str) {
+	snet_server_buf_append(buf, "\"", 1);
+	for (const char* itr = str; *itr != '\0'; ++itr) {
+		unsigned char ch = (unsigned char)*itr;
+		if (ch == '"' || ch == '\\') {
+			char escaped[2] = { '\\', (char)ch };
+			snet_server_buf_append(buf, escaped, 2);
+		} else if (ch < 0x20) {
+			snet_server_buf_printf(buf, "\\u%04x", ch);
+		} else {
+			snet_server_buf_append(buf, itr, 1);
+		}
+	}
+	snet_server_buf_append(buf, "\"", 1);
+}
+
+// }}}
+
+// Games {{{
+
+static snet_server_game_t*
+snet_server_find_game_by_id(snet_server_t* server, uint32_t id) {
+	int low = 0, high = server->num_games;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (server->games[mid].id < id) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low < server->num_games && server->games[low].id == id ? &server->games[low] : NULL;
+}
+
+static snet_server_game_t*
+snet_server_find_game_by_token(snet_server_t* server, const char* join_token, size_t len) {
+	for (int i = 0; i < server->num_games; ++i) {
+		snet_server_game_t* game = &server->games[i];
+		if (strlen(game->join_token) == len && memcmp(game->join_token, join_token, len) == 0) {
+			return game;
+		}
+	}
+
+	return NULL;
+}
+
+static snet_server_game_t*
+snet_server_add_game(snet_server_t* server) {
+	if (server->num_games >= server->games_capacity) {
+		server->games_capacity = server->games_capacity > 0 ? server->games_capacity * 2 : 64;
+		server->games = cf_realloc(server->games, sizeof(snet_server_game_t) * server->games_capacity);
+	}
+
+	snet_server_game_t* game = &server->games[server->num_games++];
+	*game = (snet_server_game_t){ .id = ++server->next_game_id };
+
+	uint8_t token[SNET_SERVER_JOIN_TOKEN_SIZE];
+	cf_crypto_random_bytes(token, sizeof(token));
+	for (int i = 0; i < SNET_SERVER_JOIN_TOKEN_SIZE; ++i) {
+		snprintf(game->join_token + i * 2, 3, "%02x", token[i]);
+	}
+
+	server->revision += 1;
+	return game;
+}
+
+// Records a change for /game/events, overwriting the oldest one
+static void
+snet_server_push_event(snet_server_t* server, snet_server_event_type_t type, const snet_server_game_t* game) {
+	uint64_t id = ++server->last_event_id;
+	snet_server_event_t* event = &server->events[id % SNET_SERVER_MAX_EVENTS];
+	if (event->id != 0) {
+		cf_free(event->game.creator);
+		cf_free(event->game.data);
+	}
+
+	*event = (snet_server_event_t){
+		.id = id,
+		.type = type,
+		.game = *game,
+	};
+	event->game.creator = snet_server_strdup(game->creator);
+	event->game.data = snet_server_strdup(game->data);
+}
+
+static void
+snet_server_remove_game(snet_server_t* server, snet_server_game_t* game) {
+	snet_server_log(server, "Game %s closed", game->join_token);
+	snet_server_push_event(server, SNET_SERVER_GAME_CLOSED, game);
+
+	cf_free(game->creator);
+	cf_free(game->data);
+
+	int index = (int)(game - server->games);
+	memmove(game, game + 1, sizeof(snet_server_game_t) * (server->num_games - index - 1));
+	server->num_games -= 1;
+	server->revision += 1;
+}
+
+static void
+snet_server_write_game(snet_server_buf_t* buf, const snet_server_game_t* game) {
+	snet_server_buf_printf(buf, "{\"join_token\":");
+	snet_server_buf_json_string(buf, game->join_token);
+	snet_server_buf_printf(buf, ",\"creator\":");
+	snet_server_buf_json_string(buf, game->creator);
+	snet_server_buf_printf(buf, ",\"data\":");
+	snet_server_buf_json_string(buf, game->data);
+	snet_server_buf_printf(buf, "}");
+}
+
+// }}}
+
+// HTTP {{{
+
+static int
+snet_server_respond(
+	struct wby_con* conn,
+	int status_code,
+	const char* content_type,
+	const void* body,
+	size_t size,
+	const char* etag
+) {
+	struct wby_header headers[2];
+	int num_headers = 0;
+	if (content_type != NULL) {
+		headers[num_headers++] = (struct wby_header){ .name = "Content-Type", .value = content_type };
+	}
+	if (etag != NULL) {
+		headers[num_headers++] = (struct wby_header){ .name = "ETag", .value = etag };
+	}
+
+	wby_response_begin(conn, status_code, (int)size, headers, num_headers);
+	if (size > 0) { wby_write(conn, body, size); }
+	wby_response_end(conn);
+	return 0;
+}
+
+static int
+snet_server_respond_text(struct wby_con* conn, int status_code, const char* text) {
+	return snet_server_respond(conn, status_code, "text/plain", text, strlen(text), NULL);
+}
+
+// The session is just the cookie handed out by /auth/cookie
+static const char*
+snet_server_session(struct wby_con* conn) {
+	const char* auth = wby_find_header(conn, "Authorization");
+	if (auth == NULL || strncmp(auth, "Bearer ", 7) != 0 || auth[7] == '\0') { return NULL; }
+	return auth + 7;
+}
+
+static bool
+snet_server_query_var(struct wby_con* conn, const char* name, char* buf) {
+	const char* query = conn->request.query_params;
+	return query != NULL && wby_find_query_var(query, name, buf, SNET_SERVER_MAX_QUERY_VAR_SIZE) >= 0;
+}
+
+// The list filters, shared by /game/list and /game/events
+static void
+snet_server_parse_filter(struct wby_con* conn, snet_server_filter_t* filter) {
+	char var[SNET_SERVER_MAX_QUERY_VAR_SIZE];
+	*filter = (snet_server_filter_t){ 0 };
+	if (snet_server_query_var(conn, "visibility", var)) {
+		filter->visibility = strcmp(var, "public") == 0 ? 1 : strcmp(var, "private") == 0 ? 2 : 0;
+	}
+
+	filter->has_free_slots = snet_server_query_var(conn, "has_free_slots", var) && strcmp(var, "1") == 0;
+	filter->filter_creator = snet_server_query_var(conn, "creator", filter->creator);
+	filter->filter_data = snet_server_query_var(conn, "data_prefix", filter->data_prefix);
+}
+
+static bool
+snet_server_game_matches(const snet_server_filter_t* filter, const snet_server_game_t* game) {
+	if (filter->visibility == 1 && !game->is_public) { return false; }
+	if (filter->visibility == 2 && game->is_public) { return false; }
+	if (filter->has_free_slots && game->num_players >= game->max_num_players) { return false; }
+	if (filter->filter_creator && strcmp(game->creator, filter->creator) != 0) { return false; }
+	if (filter->filter_data && strncmp(game->data, filter->data_prefix, strlen(filter->data_prefix)) != 0) { return false; }
+	return true;
+}
+
+static int
+snet_server_auth_cookie(snet_server_t* server, struct wby_con* conn, size_t body_size) {
+	// Any cookie is accepted, an empty one gets a new guest name
+	if (body_size == 0) {
+		body_size = snprintf(server->body, sizeof(server->body), "guest-%d", ++server->num_guests);
+	}
+
+	return snet_server_respond(conn, 200, "text/plain", server->body, body_size, NULL);
+}
+
+static int
+snet_server_create_game(snet_server_t* server, struct wby_con* conn, const char* session, size_t body_size) {
+	// The binary lobby format is not spoken here
+	const char* content_type = wby_find_header(conn, "Content-Type");
+	if (content_type != NULL && strcmp(content_type, "application/json") != 0) {
+		return snet_server_respond_text(conn, 415, "Only JSON is supported");
+	}
+
+	CF_JDoc doc = cf_make_json(server->body, body_size);
+	CF_JVal root = cf_json_get_root(doc);
+	const char* visibility = cf_json_get_string(cf_json_get(root, "visibility"));
+	const char* data = cf_json_get_string(cf_json_get(root, "data"));
+	int max_num_players = cf_json_get_int(cf_json_get(root, "max_num_players"));
+
+	snet_server_game_t* game = snet_server_add_game(server);
+	game->creator = snet_server_strdup(session);
+	game->data = snet_server_strdup(data != NULL ? data : "");
+	game->is_public = visibility == NULL || strcmp(visibility, "private") != 0;
+	game->max_num_players = max_num_players > 0 ? max_num_players : SNET_SERVER_MAX_RELAY_CLIENTS;
+	game->relay = server->next_relay;
+	server->next_relay = (server->next_relay + 1) % server->num_relays;
+	cf_destroy_json(doc);
+
+	snet_server_log(server, "Game %s created by %s", game->join_token, session);
+	snet_server_push_event(server, SNET_SERVER_GAME_CREATED, game);
+
+	snet_server_buf_t* response = &server->response;
+	response->size = 0;
+	snet_server_write_game(response, game);
+	return snet_server_respond(conn, 200, "application/json", response->ptr, response->size, NULL);
+}
+
+static int
+snet_server_list_games(snet_server_t* server, struct wby_con* conn) {
+	char etag[32];
+	snprintf(etag, sizeof(etag), "\"%llu\"", (unsigned long long)server->revision);
+	const char* if_none_match = wby_find_header(conn, "If-None-Match");
+	if (if_none_match != NULL && strcmp(if_none_match, etag) == 0) {
+		return snet_server_respond(conn, 304, NULL, NULL, 0, etag);
+	}
+
+	char var[SNET_SERVER_MAX_QUERY_VAR_SIZE];
+	int page_size = SNET_SERVER_DEFAULT_PAGE_SIZE;
+	if (snet_server_query_var(conn, "page_size", var)) {
+		page_size = atoi(var);
+		if (page_size <= 0 || page_size > SNET_SERVER_MAX_PAGE_SIZE) { page_size = SNET_SERVER_MAX_PAGE_SIZE; }
+	}
+
+	uint32_t cursor = 0;
+	if (snet_server_query_var(conn, "cursor", var)) { cursor = (uint32_t)strtoul(var, NULL, 10); }
+
+	snet_server_filter_t filter;
+	snet_server_parse_filter(conn, &filter);
+
+	snet_server_buf_t* response = &server->response;
+	response->size = 0;
+	snet_server_buf_printf(response, "{\"games\":[");
+
+	int num_listed = 0;
+	uint32_t next_cursor = 0;
+	for (int i = 0; i < server->num_games; ++i) {
+		const snet_server_game_t* game = &server->games[i];
+		if (game->id <= cursor) { continue; }
+		if (!snet_server_game_matches(&filter, game)) { continue; }
+
+		if (num_listed == page_size) {
+			next_cursor = server->games[i - 1].id;
+			break;
+		}
+
+		if (num_listed > 0) { snet_server_buf_printf(response, ","); }
+		snet_server_write_game(response, game);
+		num_listed += 1;
+	}
+
+	if (next_cursor != 0) {
+		snet_server_buf_printf(response, "],\"next_cursor\":\"%u\"}", next_cursor);
+	} else {
+		snet_server_buf_printf(response, "],\"next_cursor\":\"\"}");
+	}
+
+	return snet_server_respond(conn, 200, "application/json", response->ptr, response->size, etag);
+}
+
+static int
+snet_server_join_game(snet_server_t* server, struct wby_con* conn, const char* session, size_t body_size) {
+	char transport[SNET_SERVER_MAX_QUERY_VAR_SIZE];
+	if (!snet_server_query_var(conn, "transport", transport) || strcmp(transport, "cute_net") != 0) {
+		return snet_server_respond_text(conn, 400, "Only cute_net is supported");
+	}
+
+	snet_server_game_t* game = snet_server_find_game_by_token(server, server->body, body_size);
+	if (game == NULL) {
+		return snet_server_respond_text(conn, 404, "Game not found");
+	}
+
+	snet_server_relay_t* relay = &server->relays[game->relay];
+	if (game->num_players >= game->max_num_players) {
+		return snet_server_respond_text(conn, 403, "Game is full");
+	}
+	if (relay->num_clients >= SNET_SERVER_MAX_RELAY_CLIENTS) {
+		return snet_server_respond_text(conn, 503, "Relay is full");
+	}
+
+	// The game is recovered from the client id once it connects to the relay
+	uint64_t client_id = ((uint64_t)game->id << 32) | ++server->next_client_seq;
+	const char* addresses[] = { relay->address };
+	uint8_t user_data[CF_CONNECT_TOKEN_USER_DATA_SIZE] = { 0 };
+	uint8_t connect_token[CF_CONNECT_TOKEN_SIZE];
+	CF_CryptoKey client_to_server_key = cf_crypto_generate_key();
+	CF_CryptoKey server_to_client_key = cf_crypto_generate_key();
+	uint64_t now = (uint64_t)time(NULL);
+	CF_Result result = cf_generate_connect_token(
+		0,  // The client is made with application id 0
+		now,
+		&client_to_server_key,
+		&server_to_client_key,
+		now + SNET_SERVER_CONNECT_TOKEN_EXPIRY,
+		SNET_SERVER_HANDSHAKE_TIMEOUT,
+		1, addresses,
+		client_id,
+		user_data,
+		&server->secret_key,
+		connect_token
+	);
+	if (cf_is_error(result)) {
+		return snet_server_respond_text(conn, 500, "Could not generate connect token");
+	}
+
+	snet_server_log(server, "%s joining game %s", session, game->join_token);
+	return snet_server_respond(conn, 200, "application/octet-stream", connect_token, sizeof(connect_token), NULL);
+}
+
+// wby can not keep a response open once the dispatcher returns so instead of
+// one long stream, every request gets the events after Last-Event-ID and the
+// response ends.
+// The client reconnects after the retry delay and carries on from the last id.
+// Events which fell out of the ring are covered by the list the client
+// fetches on every connection.
+static int
+snet_server_game_events(snet_server_t* server, struct wby_con* conn) {
+	snet_server_filter_t filter;
+	snet_server_parse_filter(conn, &filter);
+
+	uint64_t first_id = server->last_event_id + 1;
+	const char* last_event_id = wby_find_header(conn, "Last-Event-ID");
+	if (last_event_id != NULL) {
+		uint64_t after = strtoull(last_event_id, NULL, 10);
+		if (after < server->last_event_id) { first_id = after + 1; }
+	}
+	if (server->last_event_id - first_id + 1 > SNET_SERVER_MAX_EVENTS) {
+		first_id = server->last_event_id - SNET_SERVER_MAX_EVENTS + 1;
+	}
+
+	snet_server_buf_t* response = &server->response;
+	response->size = 0;
+	snet_server_buf_printf(response, "retry: %d\n\n", SNET_SERVER_EVENT_RETRY);
+	for (uint64_t id = first_id; id <= server->last_event_id; ++id) {
+		const snet_server_event_t* event = &server->events[id % SNET_SERVER_MAX_EVENTS];
+		const char* type;
+		if (event->type == SNET_SERVER_GAME_CLOSED) {
+			type = "game_closed";
+		} else if (!snet_server_game_matches(&filter, &event->game)) {
+			// The game no longer belongs in this client's table
+			type = "game_closed";
+		} else {
+			type = event->type == SNET_SERVER_GAME_CREATED ? "game_created" : "game_updated";
+		}
+
+		snet_server_buf_printf(response, "id: %llu\nevent: %s\ndata: ", (unsigned long long)id, type);
+		snet_server_write_game(response, &event->game);
+		snet_server_buf_printf(response, "\n\n");
+	}
+	// Without new events this still moves the client's Last-Event-ID up to now
+	snet_server_buf_printf(response, "id: %llu\n\n", (unsigned long long)server->last_event_id);
+
+	static const struct wby_header headers[] = {
+		{ .name = "Content-Type", .value = "text/event-stream" },
+		{ .name = "Cache-Control", .value = "no-cache" },
+	};
+	wby_response_begin(conn, 200, (int)response->size, headers, WBY_LEN(headers));
+	wby_write(conn, response->ptr, response->size);
+	wby_response_end(conn);
+	return 0;
+}
+
+static int
+snet_server_dispatch(struct wby_con* conn, void* userdata) {
+	snet_server_t* server = userdata;
+	const char* method = conn->request.method;
+	const char* uri = conn->request.uri;
+	snet_server_log(server, "%s %s", method, uri);
+
+	if (conn->request.content_length > SNET_SERVER_MAX_BODY_SIZE) {
+		// wby drains the unread body before answering and the connection is
+		// closed afterwards
+		static const char text[] = "Body is too large";
+		static const struct wby_header headers[] = {
+			{ .name = "Content-Type", .value = "text/plain" },
+			{ .name = "Connection", .value = "close" },
+		};
+		wby_response_begin(conn, 413, (int)sizeof(text) - 1, headers, WBY_LEN(headers));
+		wby_write(conn, text, sizeof(text) - 1);
+		wby_response_end(conn);
+		return 0;
+	}
+
+	size_t body_size = conn->request.content_length > 0 ? (size_t)conn->request.content_length : 0;
+	if (body_size > 0 && wby_read(conn, server->body, body_size) != 0) {
+		return snet_server_respond_text(conn, 400, "Could not read body");
+	}
+	server->body[body_size] = '\0';
+
+	// Any path prefix is accepted so snet_config_t.path does not matter
+	bool is_post = strcmp(method, "POST") == 0;
+	if (is_post && snet_server_ends_with(uri, "/auth/cookie")) {
+		return snet_server_auth_cookie(server, conn, body_size);
+	}
+
+	bool is_create = is_post && snet_server_ends_with(uri, "/game/create");
+	bool is_join = is_post && snet_server_ends_with(uri, "/game/join");
+	bool is_get = strcmp(method, "GET") == 0;
+	bool is_list = is_get && snet_server_ends_with(uri, "/game/list");
+	bool is_events = is_get && snet_server_ends_with(uri, "/game/events");
+	if (!is_create && !is_join && !is_list && !is_events) { return 1; }
+
+	const char* session = snet_server_session(conn);
+	if (session == NULL) {
+		return snet_server_respond_text(conn, 401, "Unauthorized");
+	}
+
+	if (is_create) {
+		return snet_server_create_game(server, conn, session, body_size);
+	} else if (is_join) {
+		return snet_server_join_game(server, conn, session, body_size);
+	} else if (is_events) {
+		return snet_server_game_events(server, conn);
+	} else {
+		return snet_server_list_games(server, conn);
+	}
+}
+
+// }}}
+
+// Relay {{{
+
+static void
+snet_server_update_relay(snet_server_t* server, snet_server_relay_t* relay, double dt) {
+	cf_server_update(relay->server, dt, (uint64_t)time(NULL));
+
+	CF_ServerEvent event;
+	while (cf_server_pop_event(relay->server, &event)) {
+		switch (event.type) {
+			case CF_SERVER_EVENT_TYPE_NEW_CONNECTION: {
+				int client_index = event.u.new_connection.client_index;
+				uint32_t game_id = (uint32_t)(event.u.new_connection.client_id >> 32);
+				snet_server_game_t* game = snet_server_find_game_by_id(server, game_id);
+				if (game == NULL || game->num_players >= game->max_num_players) {
+					cf_server_disconnect_client(relay->server, client_index, true);
+					break;
+				}
+
+				relay->client_games[client_index] = game_id;
+				relay->num_clients += 1;
+				game->num_players += 1;
+				game->started = true;
+				server->revision += 1;
+				snet_server_push_event(server, SNET_SERVER_GAME_UPDATED, game);
+			} break;
+			case CF_SERVER_EVENT_TYPE_DISCONNECTED: {
+				int client_index = event.u.disconnected.client_index;
+				uint32_t game_id = relay->client_games[client_index];
+				if (game_id == 0) { break; }
+
+				relay->client_games[client_index] = 0;
+				relay->num_clients -= 1;
+
+				snet_server_game_t* game = snet_server_find_game_by_id(server, game_id);
+				if (game != NULL) {
+					game->num_players -= 1;
+					server->revision += 1;
+					if (game->num_players == 0 && game->started) {
+						snet_server_remove_game(server, game);
+					} else {
+						snet_server_push_event(server, SNET_SERVER_GAME_UPDATED, game);
+					}
+				}
+			} break;
+			case CF_SERVER_EVENT_TYPE_PAYLOAD_PACKET: {
+				int sender = event.u.payload_packet.client_index;
+				uint32_t game_id = relay->client_games[sender];
+				const char* data = event.u.payload_packet.data;
+				int size = event.u.payload_packet.size;
+
+				if (size >= SNET_CLOCK_REQUEST_SIZE && data[0] == (char)SNET_PACKET_CLOCK_REQUEST) {
+					// Answered right away with the request time echoed back
+					char response[SNET_CLOCK_RESPONSE_SIZE];
+					memcpy(response, data, SNET_CLOCK_REQUEST_SIZE);
+					response[0] = (char)SNET_PACKET_CLOCK_RESPONSE;
+					snet_clock_write_time(response + SNET_CLOCK_REQUEST_SIZE, snet_seconds());
+					cf_server_send(relay->server, response, sizeof(response), sender, false);
+				} else {
+					// Everyone else in the same game gets a copy, sent the way
+					// the original was so losses show up as they would
+					bool reliable = size > 0 && snet_packet_is_reliable((uint8_t)data[0]);
+					for (int i = 0; game_id != 0 && i < SNET_SERVER_MAX_RELAY_CLIENTS; ++i) {
+						if (i != sender && relay->client_games[i] == game_id) {
+							cf_server_send(relay->server, data, size, i, reliable);
+						}
+					}
+				}
+
+				cf_server_free_packet(relay->server, sender, event.u.payload_packet.data);
+			} break;
+		}
+	}
+}
+
+// }}}
+
+static void
+snet_server_usage(const char* program) {
+	fprintf(
+		stderr,
+		"Usage: %s [options]\n"
+		"  --address <ip>      Address to listen on (default: 127.0.0.1)\n"
+		"  --port <port>       Lobby HTTP port (default: 8080)\n"
+		"  --relay-port <port> First game relay port (default: 5000)\n"
+		"  --num-relays <n>    Number of game relays, %d players each (default: 1)\n"
+		"  --verbose           Log every request\n",
+		program, SNET_SERVER_MAX_RELAY_CLIENTS
+	);
+}
+
+int
+main(int argc, const char* argv[]) {
+	const char* address = "127.0.0.1";
+	int port = 8080;
+	int relay_port = 5000;
+	int num_relays = 1;
+	bool verbose = false;
+
+	for (int i = 1; i < argc; ++i) {
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--address") == 0 && has_value) {
+			address = argv[++i];
+		} else if (strcmp(argv[i], "--port") == 0 && has_value) {
+			port = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--relay-port") == 0 && has_value) {
+			relay_port = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--num-relays") == 0 && has_value) {
+			num_relays = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--verbose") == 0) {
+			verbose = true;
+		} else {
+			snet_server_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (num_relays < 1) { num_relays = 1; }
+
+	snet_server_t* server = cf_alloc(sizeof(snet_server_t));
+	*server = (snet_server_t){
+		.num_relays = num_relays,
+		.verbose = verbose,
+	};
+
+	cf_crypto_sign_keygen(&server->public_key, &server->secret_key);
+	server->relays = cf_alloc(sizeof(snet_server_relay_t) * num_relays);
+	for (int i = 0; i < num_relays; ++i) {
+		snet_server_relay_t* relay = &server->relays[i];
+		*relay = (snet_server_relay_t){ 0 };
+		snprintf(relay->address, sizeof(relay->address), "%s:%d", address, relay_port + i);
+
+		CF_ServerConfig config = cf_server_config_defaults();
+		config.application_id = 0;
+		config.public_key = server->public_key;
+		config.secret_key = server->secret_key;
+		relay->server = cf_make_server(config);
+		if (cf_is_error(cf_server_start(relay->server, relay->address))) {
+			fprintf(stderr, "Could not start relay on %s\n", relay->address);
+			return 1;
+		}
+	}
+
+	struct wby_config httpd_config = {
+		.address = address,
+		.port = (unsigned short)port,
+		.connection_max = 512,
+		.request_buffer_size = 4096,
+		.io_buffer_size = 8192,
+		.dispatch = snet_server_dispatch,
+		.userdata = server,
+	};
+	wby_size httpd_memory_size;
+	wby_init(&server->httpd, &httpd_config, &httpd_memory_size);
+	(void)wby_find_conn;
+	(void)wby_frame_begin;
+	(void)wby_frame_end;
+	server->httpd_memory = cf_alloc(httpd_memory_size);
+	if (wby_start(&server->httpd, server->httpd_memory) != WBY_OK) {
+		fprintf(stderr, "Could not listen on %s:%d\n", address, port);
+		return 1;
+	}
+
+	fprintf(stderr, "Lobby listening on http://%s:%d\n", address, port);
+	fprintf(stderr, "Game relays on %s:%d-%d\n", address, relay_port, relay_port + num_relays - 1);
+
+	signal(SIGINT, snet_server_on_signal);
+	signal(SIGTERM, snet_server_on_signal);
+
+	double last_update = snet_seconds();
+	while (!snet_server_quit) {
+		wby_update(&server->httpd, 0);
+
+		double now = snet_seconds();
+		for (int i = 0; i < num_relays; ++i) {
+			snet_server_update_relay(server, &server->relays[i], now - last_update);
+		}
+		last_update = now;
+
+		SDL_Delay(1);
+	}
+
+	wby_stop(&server->httpd);
+	cf_free(server->httpd_memory);
+	for (int i = 0; i < num_relays; ++i) {
+		cf_server_stop(server->relays[i].server);
+		cf_destroy_server(server->relays[i].server);
+	}
+	cf_free(server->relays);
+	for (int i = 0; i < server->num_games; ++i) {
+		cf_free(server->games[i].creator);
+		cf_free(server->games[i].data);
+	}
+	cf_free(server->games);
+	for (int i = 0; i < SNET_SERVER_MAX_EVENTS; ++i) {
+		if (server->events[i].id != 0) {
+			cf_free(server->events[i].game.creator);
+			cf_free(server->events[i].game.data);
+		}
+	}
+	cf_free(server->response.ptr);
+	cf_free(server);
+
+	return 0;
+}
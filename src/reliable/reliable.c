@@ -484,6 +484,9 @@ struct reliable_fragment_reassembly_data_t
     int packet_bytes;
     int packet_header_bytes;
     uint8_t fragment_received[256];
+    int parity_group_size;
+    uint8_t * parity_data;
+    uint8_t parity_received[256];
 };
 
 void reliable_fragment_reassembly_data_cleanup( void * data, void * allocator_context, void (*free_function)(void*,void*) )
@@ -496,6 +499,11 @@ void reliable_fragment_reassembly_data_cleanup( void * data, void * allocator_co
         free_function( allocator_context, reassembly_data->packet_data );
         reassembly_data->packet_data = NULL;
     }
+    if ( reassembly_data->parity_data )
+    {
+        free_function( allocator_context, reassembly_data->parity_data );
+        reassembly_data->parity_data = NULL;
+    }
 }
 
 // ---------------------------------------------------------------
@@ -577,6 +585,8 @@ struct reliable_endpoint_t * reliable_endpoint_create( struct reliable_config_t
     reliable_assert( config->max_fragments > 0 );
     reliable_assert( config->max_fragments <= 256 );
     reliable_assert( config->fragment_size > 0 );
+    reliable_assert( config->fragment_parity_group >= 0 );
+    reliable_assert( config->fragment_parity_group <= 255 );
     reliable_assert( config->ack_buffer_size > 0 );
     reliable_assert( config->sent_packets_buffer_size > 0 );
     reliable_assert( config->received_packets_buffer_size > 0 );
@@ -755,7 +765,8 @@ void reliable_endpoint_send_packet( struct reliable_endpoint_t * endpoint, const
 {
     reliable_assert( endpoint );
     reliable_assert( packet_data );
-    reliable_assert( packet_bytes > 0 );
+    // note: a packet without payload only carries acks
+    reliable_assert( packet_bytes >= 0 );
 
     if ( packet_bytes > endpoint->config.max_packet_size )
     {
@@ -818,6 +829,20 @@ void reliable_endpoint_send_packet( struct reliable_endpoint_t * endpoint, const
 
         uint8_t * fragment_packet_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, fragment_buffer_size );
 
+        // parity fragments have their own prefix byte, so a receiver without parity support
+        // rejects them as invalid fragments and otherwise works as before
+
+        int parity_group_size = endpoint->config.fragment_parity_group;
+        int num_parity_groups = 0;
+        uint8_t * parity_data = NULL;
+        if ( parity_group_size > 0 )
+        {
+            num_parity_groups = ( num_fragments + parity_group_size - 1 ) / parity_group_size;
+            int parity_data_size = num_parity_groups * ( 2 + endpoint->config.fragment_size );
+            parity_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, parity_data_size );
+            memset( parity_data, 0, parity_data_size );
+        }
+
         const uint8_t * q = packet_data;
 
         const uint8_t * end = q + packet_bytes;
@@ -846,6 +871,18 @@ void reliable_endpoint_send_packet( struct reliable_endpoint_t * endpoint, const
 
             memcpy( p, q, bytes_to_copy );
 
+            if ( parity_data )
+            {
+                uint8_t * parity = parity_data + ( fragment_id / parity_group_size ) * ( 2 + endpoint->config.fragment_size );
+                parity[0] ^= (uint8_t) ( bytes_to_copy & 0xFF );
+                parity[1] ^= (uint8_t) ( bytes_to_copy >> 8 );
+                int i;
+                for ( i = 0; i < bytes_to_copy; ++i )
+                {
+                    parity[2+i] ^= q[i];
+                }
+            }
+
             p += bytes_to_copy;
             q += bytes_to_copy;
 
@@ -856,6 +893,30 @@ void reliable_endpoint_send_packet( struct reliable_endpoint_t * endpoint, const
             endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_SENT]++;
         }
 
+        int group;
+        for ( group = 0; group < num_parity_groups; ++group )
+        {
+            uint8_t * p = fragment_packet_data;
+
+            reliable_write_uint8( &p, 3 );
+            reliable_write_uint16( &p, sequence );
+            reliable_write_uint8( &p, (uint8_t) group );
+            reliable_write_uint8( &p, (uint8_t) ( num_fragments - 1 ) );
+            reliable_write_uint8( &p, (uint8_t) parity_group_size );
+
+            memcpy( p, parity_data + group * ( 2 + endpoint->config.fragment_size ), 2 + endpoint->config.fragment_size );
+            p += 2 + endpoint->config.fragment_size;
+
+            int fragment_packet_bytes = (int) ( p - fragment_packet_data );
+
+            endpoint->config.transmit_packet_function( endpoint->config.context, endpoint->config.id, sequence, fragment_packet_data, fragment_packet_bytes );
+        }
+
+        if ( parity_data )
+        {
+            endpoint->free_function( endpoint->allocator_context, parity_data );
+        }
+
         endpoint->free_function( endpoint->allocator_context, fragment_packet_data );
     }
 
@@ -1071,6 +1132,222 @@ void reliable_store_fragment_data( struct reliable_fragment_reassembly_data_t *
     memcpy( reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES + fragment_id * fragment_size, fragment_data, fragment_bytes );
 }
 
+struct reliable_fragment_reassembly_data_t * reliable_endpoint_find_reassembly( struct reliable_endpoint_t * endpoint, uint16_t sequence, int num_fragments )
+{
+    struct reliable_fragment_reassembly_data_t * reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
+        reliable_sequence_buffer_find( endpoint->fragment_reassembly, sequence );
+
+    if ( !reassembly_data )
+    {
+        reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
+            reliable_sequence_buffer_insert_with_cleanup( endpoint->fragment_reassembly, sequence, reliable_fragment_reassembly_data_cleanup );
+
+        if ( !reassembly_data )
+        {
+            reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment. could not insert in reassembly buffer (stale)\n", endpoint->config.name );
+            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
+            return NULL;
+        }
+
+        reliable_sequence_buffer_advance( endpoint->received_packets, sequence );
+
+        int packet_buffer_size = RELIABLE_MAX_PACKET_HEADER_BYTES + num_fragments * endpoint->config.fragment_size;
+
+        reassembly_data->sequence = sequence;
+        reassembly_data->ack = 0;
+        reassembly_data->ack_bits = 0;
+        reassembly_data->num_fragments_received = 0;
+        reassembly_data->num_fragments_total = num_fragments;
+        reassembly_data->packet_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, packet_buffer_size );
+        reassembly_data->packet_bytes = 0;
+        reassembly_data->parity_group_size = 0;
+        reassembly_data->parity_data = NULL;
+        memset( reassembly_data->fragment_received, 0, sizeof( reassembly_data->fragment_received ) );
+        memset( reassembly_data->parity_received, 0, sizeof( reassembly_data->parity_received ) );
+
+        // note: the padding past the last fragment must be zero for parity to work out
+        memset( reassembly_data->packet_data, 0, packet_buffer_size );
+    }
+
+    if ( num_fragments != (int) reassembly_data->num_fragments_total )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment. fragment count mismatch. expected %d, got %d\n", 
+            endpoint->config.name, (int) reassembly_data->num_fragments_total, num_fragments );
+        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
+        return NULL;
+    }
+
+    return reassembly_data;
+}
+
+void reliable_recover_fragment( struct reliable_fragment_reassembly_data_t * reassembly_data, int fragment_size, int group )
+{
+    if ( !reassembly_data->parity_data || !reassembly_data->parity_received[group] )
+    {
+        return;
+    }
+
+    int first_fragment = group * reassembly_data->parity_group_size;
+    int end_fragment = first_fragment + reassembly_data->parity_group_size;
+    if ( end_fragment > reassembly_data->num_fragments_total )
+    {
+        end_fragment = reassembly_data->num_fragments_total;
+    }
+
+    // only a single missing fragment per group can be rebuilt
+
+    int missing_fragment = -1;
+    int fragment_id;
+    for ( fragment_id = first_fragment; fragment_id < end_fragment; ++fragment_id )
+    {
+        if ( !reassembly_data->fragment_received[fragment_id] )
+        {
+            if ( missing_fragment >= 0 )
+            {
+                return;
+            }
+            missing_fragment = fragment_id;
+        }
+    }
+
+    if ( missing_fragment < 0 )
+    {
+        return;
+    }
+
+    int last_fragment = reassembly_data->num_fragments_total - 1;
+    const uint8_t * parity = reassembly_data->parity_data + group * ( 2 + fragment_size );
+    uint8_t * missing_data = reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES + missing_fragment * fragment_size;
+    int fragment_bytes = (int) parity[0] | ( (int) parity[1] << 8 );
+
+    memcpy( missing_data, parity + 2, fragment_size );
+
+    for ( fragment_id = first_fragment; fragment_id < end_fragment; ++fragment_id )
+    {
+        if ( fragment_id == missing_fragment )
+        {
+            continue;
+        }
+
+        const uint8_t * fragment_data = reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES + fragment_id * fragment_size;
+        int i;
+        for ( i = 0; i < fragment_size; ++i )
+        {
+            missing_data[i] ^= fragment_data[i];
+        }
+
+        fragment_bytes ^= fragment_id == last_fragment ? reassembly_data->packet_bytes - last_fragment * fragment_size : fragment_size;
+    }
+
+    if ( fragment_bytes > fragment_size || ( missing_fragment != last_fragment && fragment_bytes != fragment_size ) )
+    {
+        memset( missing_data, 0, fragment_size );
+        return;
+    }
+
+    if ( missing_fragment == last_fragment )
+    {
+        reassembly_data->packet_bytes = last_fragment * fragment_size + fragment_bytes;
+    }
+
+    if ( missing_fragment == 0 )
+    {
+        // note: the acks carried by the first fragment are lost with it, which is fine since acks are redundant
+
+        uint8_t packet_header[RELIABLE_MAX_PACKET_HEADER_BYTES];
+
+        reassembly_data->packet_header_bytes = reliable_write_packet_header( packet_header, reassembly_data->sequence, 0, 0 );
+
+        memcpy( reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES - reassembly_data->packet_header_bytes, 
+                packet_header, 
+                reassembly_data->packet_header_bytes );
+    }
+
+    reassembly_data->fragment_received[missing_fragment] = 1;
+    reassembly_data->num_fragments_received++;
+}
+
+void reliable_endpoint_complete_reassembly( struct reliable_endpoint_t * endpoint, struct reliable_fragment_reassembly_data_t * reassembly_data )
+{
+    if ( reassembly_data->num_fragments_received != reassembly_data->num_fragments_total )
+    {
+        return;
+    }
+
+    uint16_t sequence = reassembly_data->sequence;
+
+    reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] completed reassembly of packet %d\n", endpoint->config.name, sequence );
+
+    reliable_endpoint_receive_packet( endpoint, 
+                                      reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES - reassembly_data->packet_header_bytes, 
+                                      reassembly_data->packet_header_bytes + reassembly_data->packet_bytes );
+
+    reliable_sequence_buffer_remove_with_cleanup( endpoint->fragment_reassembly, sequence, reliable_fragment_reassembly_data_cleanup );
+}
+
+void reliable_endpoint_receive_parity( struct reliable_endpoint_t * endpoint, const uint8_t * packet_data, int packet_bytes )
+{
+    int fragment_size = endpoint->config.fragment_size;
+
+    if ( packet_bytes != RELIABLE_PARITY_HEADER_BYTES + fragment_size )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] ignoring invalid parity fragment. expected %d bytes, got %d\n", 
+            endpoint->config.name, RELIABLE_PARITY_HEADER_BYTES + fragment_size, packet_bytes );
+        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
+        return;
+    }
+
+    const uint8_t * p = packet_data + 1;
+
+    uint16_t sequence = reliable_read_uint16( &p );
+    int group = (int) reliable_read_uint8( &p );
+    int num_fragments = ( (int) reliable_read_uint8( &p ) ) + 1;
+    int group_size = (int) reliable_read_uint8( &p );
+
+    if ( num_fragments > endpoint->config.max_fragments || group_size == 0 || group * group_size >= num_fragments )
+    {
+        reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] ignoring invalid parity fragment. group %d of size %d is outside of %d fragments\n", 
+            endpoint->config.name, group, group_size, num_fragments );
+        endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
+        return;
+    }
+
+    // parity is sent after the data fragments, so it usually arrives once the packet is complete
+
+    if ( reliable_sequence_buffer_exists( endpoint->received_packets, sequence ) )
+    {
+        return;
+    }
+
+    struct reliable_fragment_reassembly_data_t * reassembly_data = reliable_endpoint_find_reassembly( endpoint, sequence, num_fragments );
+
+    if ( !reassembly_data )
+    {
+        return;
+    }
+
+    if ( reassembly_data->parity_data == NULL )
+    {
+        int num_groups = ( num_fragments + group_size - 1 ) / group_size;
+        reassembly_data->parity_group_size = group_size;
+        reassembly_data->parity_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, num_groups * ( 2 + fragment_size ) );
+    }
+
+    if ( group_size != reassembly_data->parity_group_size || reassembly_data->parity_received[group] )
+    {
+        return;
+    }
+
+    reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] received parity fragment %d of packet %d\n", endpoint->config.name, group, sequence );
+
+    reassembly_data->parity_received[group] = 1;
+    memcpy( reassembly_data->parity_data + group * ( 2 + fragment_size ), p, 2 + fragment_size );
+
+    reliable_recover_fragment( reassembly_data, fragment_size, group );
+
+    reliable_endpoint_complete_reassembly( endpoint, reassembly_data );
+}
+
 void reliable_endpoint_receive_packet( struct reliable_endpoint_t * endpoint, const uint8_t * packet_data, int packet_bytes )
 {
     reliable_assert( endpoint );
@@ -1191,6 +1468,12 @@ void reliable_endpoint_receive_packet( struct reliable_endpoint_t * endpoint, co
     {
         // fragment packet
 
+        if ( prefix_byte == 3 )
+        {
+            reliable_endpoint_receive_parity( endpoint, packet_data, packet_bytes );
+            return;
+        }
+
         int fragment_id;
         int num_fragments;
         int fragment_bytes;
@@ -1218,40 +1501,10 @@ void reliable_endpoint_receive_packet( struct reliable_endpoint_t * endpoint, co
             return;
         }
 
-        struct reliable_fragment_reassembly_data_t * reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
-            reliable_sequence_buffer_find( endpoint->fragment_reassembly, sequence );
+        struct reliable_fragment_reassembly_data_t * reassembly_data = reliable_endpoint_find_reassembly( endpoint, sequence, num_fragments );
 
         if ( !reassembly_data )
         {
-            reassembly_data = (struct reliable_fragment_reassembly_data_t*) 
-                reliable_sequence_buffer_insert_with_cleanup( endpoint->fragment_reassembly, sequence, reliable_fragment_reassembly_data_cleanup );
-
-            if ( !reassembly_data )
-            {
-                reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment. could not insert in reassembly buffer (stale)\n", endpoint->config.name );
-                endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
-                return;
-            }
-
-            reliable_sequence_buffer_advance( endpoint->received_packets, sequence );
-
-            int packet_buffer_size = RELIABLE_MAX_PACKET_HEADER_BYTES + num_fragments * endpoint->config.fragment_size;
-
-            reassembly_data->sequence = sequence;
-            reassembly_data->ack = 0;
-            reassembly_data->ack_bits = 0;
-            reassembly_data->num_fragments_received = 0;
-            reassembly_data->num_fragments_total = num_fragments;
-            reassembly_data->packet_data = (uint8_t*) endpoint->allocate_function( endpoint->allocator_context, packet_buffer_size );
-            reassembly_data->packet_bytes = 0;
-            memset( reassembly_data->fragment_received, 0, sizeof( reassembly_data->fragment_received ) );
-        }
-
-        if ( num_fragments != (int) reassembly_data->num_fragments_total )
-        {
-            reliable_printf( RELIABLE_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment. fragment count mismatch. expected %d, got %d\n", 
-                endpoint->config.name, (int) reassembly_data->num_fragments_total, num_fragments );
-            endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
             return;
         }
 
@@ -1277,18 +1530,14 @@ void reliable_endpoint_receive_packet( struct reliable_endpoint_t * endpoint, co
                                       packet_data + fragment_header_bytes, 
                                       packet_bytes - fragment_header_bytes );
 
-        if ( reassembly_data->num_fragments_received == reassembly_data->num_fragments_total )
+        if ( reassembly_data->parity_group_size > 0 )
         {
-            reliable_printf( RELIABLE_LOG_LEVEL_DEBUG, "[%s] completed reassembly of packet %d\n", endpoint->config.name, sequence );
-
-            reliable_endpoint_receive_packet( endpoint, 
-                                              reassembly_data->packet_data + RELIABLE_MAX_PACKET_HEADER_BYTES - reassembly_data->packet_header_bytes, 
-                                              reassembly_data->packet_header_bytes + reassembly_data->packet_bytes );
-
-            reliable_sequence_buffer_remove_with_cleanup( endpoint->fragment_reassembly, sequence, reliable_fragment_reassembly_data_cleanup );
+            reliable_recover_fragment( reassembly_data, endpoint->config.fragment_size, fragment_id / reassembly_data->parity_group_size );
         }
 
         endpoint->counters[RELIABLE_ENDPOINT_COUNTER_NUM_FRAGMENTS_RECEIVED]++;
+
+        reliable_endpoint_complete_reassembly( endpoint, reassembly_data );
     }
 }
 
@@ -1313,6 +1562,14 @@ void reliable_endpoint_clear_acks( struct reliable_endpoint_t * endpoint )
     endpoint->num_acks = 0;
 }
 
+void reliable_endpoint_set_fragment_above( struct reliable_endpoint_t * endpoint, int fragment_above )
+{
+    reliable_assert( endpoint );
+    reliable_assert( fragment_above > 0 );
+
+    endpoint->config.fragment_above = fragment_above;
+}
+
 void reliable_endpoint_reset( struct reliable_endpoint_t * endpoint )
 {
     reliable_assert( endpoint );
@@ -1941,6 +2198,7 @@ struct test_context_t
 {
     int drop;
     int allow_packets;
+    int drop_fragment;
     struct reliable_endpoint_t * sender;
     struct reliable_endpoint_t * receiver;
 };
@@ -1949,6 +2207,7 @@ void test_default_context( struct test_context_t * context )
 {
     memset( context, 0, sizeof( *context ) );
     context->allow_packets = -1;
+    context->drop_fragment = -1;
 }
 
 static void test_transmit_packet_function( void * _context, uint64_t id, uint16_t sequence, uint8_t * packet_data, int packet_bytes )
@@ -1972,6 +2231,11 @@ static void test_transmit_packet_function( void * _context, uint64_t id, uint16_
         context->allow_packets--;
     }
 
+    if ( context->drop_fragment >= 0 && packet_bytes > 3 && packet_data[0] == 1 && packet_data[3] == context->drop_fragment )
+    {
+        return;
+    }
+
     if ( id == 0 )
     {
         reliable_endpoint_receive_packet( context->receiver, packet_data, packet_bytes );
@@ -2547,6 +2811,74 @@ void test_fragment_cleanup()
     }
 }
 
+void test_fragment_parity()
+{
+    double time = 100.0;
+
+    struct test_context_t context;
+    test_default_context( &context );
+
+    struct reliable_config_t sender_config;
+    struct reliable_config_t receiver_config;
+
+    reliable_default_config( &sender_config );
+    reliable_default_config( &receiver_config );
+
+    sender_config.fragment_above = 500;
+    sender_config.fragment_size = 500;
+    sender_config.fragment_parity_group = 2;
+    receiver_config.fragment_above = 500;
+    receiver_config.fragment_size = 500;
+
+    reliable_copy_string( sender_config.name, "sender", sizeof( sender_config.name ) );
+    sender_config.context = &context;
+    sender_config.id = 0;
+    sender_config.transmit_packet_function = &test_transmit_packet_function;
+    sender_config.process_packet_function = &test_process_packet_function_validate;
+
+    reliable_copy_string( receiver_config.name, "receiver", sizeof( receiver_config.name ) );
+    receiver_config.context = &context;
+    receiver_config.id = 1;
+    receiver_config.transmit_packet_function = &test_transmit_packet_function;
+    receiver_config.process_packet_function = &test_process_packet_function_validate;
+
+    context.sender = reliable_endpoint_create( &sender_config, time );
+    context.receiver = reliable_endpoint_create( &receiver_config, time );
+
+    double delta_time = 0.1;
+
+    // every fragmented packet loses one fragment, including the first and the last, and must still arrive
+
+    int num_fragmented = 0;
+    int i;
+    for ( i = 0; i < 64; ++i )
+    {
+        uint8_t packet_data[TEST_MAX_PACKET_BYTES];
+        uint16_t sequence = reliable_endpoint_next_packet_sequence( context.sender );
+        int packet_bytes = generate_packet_data( sequence, packet_data );
+        int num_fragments = ( packet_bytes + sender_config.fragment_size - 1 ) / sender_config.fragment_size;
+
+        context.drop_fragment = i % num_fragments;
+        num_fragmented += packet_bytes > sender_config.fragment_above;
+
+        reliable_endpoint_send_packet( context.sender, packet_data, packet_bytes );
+
+        reliable_endpoint_update( context.sender, time );
+        reliable_endpoint_update( context.receiver, time );
+
+        reliable_endpoint_clear_acks( context.sender );
+        reliable_endpoint_clear_acks( context.receiver );
+
+        time += delta_time;
+    }
+
+    check( num_fragmented > 0 );
+    check( reliable_endpoint_counters( context.receiver )[RELIABLE_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED] == 64 );
+
+    reliable_endpoint_destroy( context.sender );
+    reliable_endpoint_destroy( context.receiver );
+}
+
 #define RUN_TEST( test_function )                                           \
     do                                                                      \
     {                                                                       \
@@ -2569,6 +2901,7 @@ void reliable_test()
         RUN_TEST( test_large_packets );
         RUN_TEST( test_sequence_buffer_rollover );
         RUN_TEST( test_fragment_cleanup );
+        RUN_TEST( test_fragment_parity );
     }
 }
 
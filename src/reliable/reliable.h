@@ -69,6 +69,7 @@
 
 #define RELIABLE_MAX_PACKET_HEADER_BYTES 9
 #define RELIABLE_FRAGMENT_HEADER_BYTES   5
+#define RELIABLE_PARITY_HEADER_BYTES     8
 
 #define RELIABLE_LOG_LEVEL_NONE     0
 #define RELIABLE_LOG_LEVEL_ERROR    1
@@ -102,6 +103,7 @@ struct reliable_config_t
     int fragment_above;
     int max_fragments;
     int fragment_size;
+    int fragment_parity_group;          // note: 0 disables parity. otherwise one xor parity fragment is sent per this many fragments
     int ack_buffer_size;
     int sent_packets_buffer_size;
     int received_packets_buffer_size;
@@ -136,6 +138,8 @@ void reliable_endpoint_clear_acks( struct reliable_endpoint_t * endpoint );
 
 void reliable_endpoint_reset( struct reliable_endpoint_t * endpoint );
 
+void reliable_endpoint_set_fragment_above( struct reliable_endpoint_t * endpoint, int fragment_above );     // note: only affects packets sent afterwards
+
 void reliable_endpoint_update( struct reliable_endpoint_t * endpoint, double time );
 
 float reliable_endpoint_rtt( struct reliable_endpoint_t * endpoint );       // exponentially smoothed moving average
@@ -3,15 +3,26 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <time.h>
+#include <math.h>
 #include <cute_json.h>
 #include <cute_coroutine.h>
 #include <cute_alloc.h>
-#include <cute_time.h>
 #include <SDL3/SDL_misc.h>
+#include <SDL3/SDL_stdinc.h>
 
 #include "slopnet_fetch.h"
 #include "slopnet_transport.h"
 #include "slopnet_oauth.h"
+#include "slopnet_json.h"
+#include "slopnet_game_table.h"
+#include "slopnet_sse.h"
+#include "slopnet_wire.h"
+#include "slopnet_time.h"
+#include "slopnet_io.h"
+#include "slopnet_shared.h"
+#include "slopnet_packet.h"
+#include "slopnet_clock.h"
+#include "slopnet_send_queue.h"
 
 #define BARENA_API static inline
 #include "barena.h"
@@ -19,6 +30,27 @@
 #define SNET_URL_FMT_PREFIX "https://%s:%d%s"
 #define SNET_URL_FMT_PREFIX_ARGS(snet) (snet)->config.host, (snet)->config.port, (snet)->config.path
 #define SNET_MAX_COOKIE_SIZE 1024
+#define SNET_HTTP_IDLE_TIMEOUT 30.0
+#define SNET_MAX_ETAG_SIZE 256
+#define SNET_MAX_WIRE_STRING_SIZE (1 << 20)
+#define SNET_MAX_EVENT_ID_SIZE 128
+#define SNET_EVENT_STREAM_TIMEOUT 60.0
+#define SNET_RESUBSCRIBE_MIN_DELAY 1.0
+#define SNET_RESUBSCRIBE_MAX_DELAY 30.0
+#define SNET_DEFAULT_RECONNECT_TIMEOUT 10.0
+#define SNET_RECONNECT_STALE_ATTEMPT_TIMEOUT 1.0
+#define SNET_RECONNECT_MIN_DELAY 0.1
+#define SNET_RECONNECT_MAX_DELAY 2.0
+#define SNET_MAX_RECONNECT_QUEUE_SIZE (256 * 1024)
+// Packet type followed by the stream id
+#define SNET_STREAM_HEADER_SIZE (SNET_PACKET_HEADER_SIZE + 8)
+#define SNET_STREAM_MAX_BYTES_PER_UPDATE (64 * 1024)
+#define SNET_DEFAULT_REDUNDANCY 3
+// Packet type, sender id, sequence of the first message and message count.
+// Each message is then prefixed by its 16 bit size.
+#define SNET_REDUNDANT_HEADER_SIZE (SNET_PACKET_HEADER_SIZE + 8 + 4 + 1)
+#define SNET_REDUNDANT_SIZE_BYTES 2
+#define SNET_REDUNDANT_MAX_MESSAGES 255
 #define SNET_TASK_ARG(TYPE, ARG) \
 	TYPE ARG; \
 	memcpy(&ARG, env->arg, sizeof(ARG))
@@ -28,6 +60,11 @@ typedef struct {
 	size_t capacity;
 } snet_buf_t;
 
+struct snet_shared_s {
+	barena_pool_t arena_pool;
+	snet_fetch_pool_t* fetch_pool;
+};
+
 typedef struct snet_task_env_s snet_task_env_t;
 typedef void (*snet_task_fn_t)(const snet_task_env_t* env);
 
@@ -46,20 +83,101 @@ struct snet_task_env_s {
 	snet_task_fn_t entry;
 };
 
+typedef struct {
+	uint64_t id;
+	// Of the last message reported
+	uint32_t sequence;
+} snet_redundant_sender_t;
+
+typedef struct {
+	uint64_t id;
+	// Bytes which were written but not sent yet are buffer[head, size)
+	char* buffer;
+	size_t head;
+	size_t size;
+	size_t capacity;
+	size_t num_bytes_written;
+	size_t num_bytes_sent;
+
+	bool opened;
+	bool closing;
+	bool closed;
+	bool aborted;
+	// Something changed since the last SNET_EVENT_STREAM_PROGRESS
+	bool progressed;
+} snet_outgoing_stream_t;
+
+typedef struct {
+	uint64_t id;
+	size_t num_bytes_received;
+} snet_incoming_stream_t;
+
 struct snet_s {
 	snet_config_t config;
 
+	// In threaded mode, everything is forwarded to the I/O thread
+	snet_io_t* io;
+
 	snet_auth_state_t auth_state;
 	snet_lobby_state_t lobby_state;
 
-	barena_pool_t arena_pool;
+	snet_shared_t* shared;
+	bool owns_shared;
 	snet_task_t auth_task;
 	snet_task_t create_game_task;
 	snet_task_t join_game_task;
 	snet_task_t list_games_task;
+	// Where snet_update_budgeted resumes after running out of time
+	int next_update_step;
+
+	// Lists are decoded into the back arena.
+	// The front one holds the last list which is also what the last
+	// SNET_EVENT_LIST_GAMES_FINISHED points into.
+	barena_t list_cache_arenas[2];
+	int list_cache_front;
+	snet_list_games_result_t list_cache;
+	const char* list_cache_query;
+	const char* list_cache_etag;
+	// The cookie the list was fetched with.
+	// A list of another account is never revalidated with its ETag.
+	const char* list_cache_session;
+
+	snet_task_t watch_games_task;
+	snet_game_table_t watched_games;
+	snet_event_t* watch_events;
+	int num_watch_events;
+	int next_watch_event;
+	int watch_events_capacity;
 
 	snet_transport_t* transport;
 	snet_event_t current_event;
+	// What is needed to get back into the current game
+	char* game_join_token;
+	size_t game_join_token_size;
+	char* game_transport_config;
+	size_t game_transport_config_size;
+	snet_send_queue_t send_queue;
+	// Game messages are framed here before going to the transport
+	char* packet_buf;
+	dyna snet_outgoing_stream_t* outgoing_streams;
+	dyna snet_incoming_stream_t* incoming_streams;
+	int next_outgoing_stream;
+	// Sent and unsent snet_send_redundant messages, oldest first.
+	// The last num_unsent ones have not been sent yet.
+	dyna snet_blob_t* redundant_history;
+	int num_unsent_redundant;
+	uint64_t redundant_id;
+	uint32_t next_redundant_sequence;
+	// Where each other player's redundant messages are up to
+	dyna snet_redundant_sender_t* redundant_senders;
+	// New messages from the last redundant packet received, as size and
+	// data pairs, which are reported before reading the next packet
+	dyna char* redundant_received;
+	int next_redundant_received;
+	// Of the relay, which every player in the game shares
+	snet_clock_t clock;
+	uint64_t num_messages_sent;
+	uint64_t num_bytes_sent;
 
 	char cookie_buf[SNET_MAX_COOKIE_SIZE];
 };
@@ -108,7 +226,7 @@ snet_task_begin(snet_t* snet, snet_task_t* task, snet_task_fn_t fn, const void*
 		arg_copy = barena_malloc(&task->arena, arg_size);
 		memcpy(arg_copy, arg, arg_size);
 	}
-	snet_task_env_t* env = barena_malloc(&task->arena, sizeof(arg_size));
+	snet_task_env_t* env = barena_malloc(&task->arena, sizeof(snet_task_env_t));
 	*env = (snet_task_env_t){
 		.arg = arg_copy,
 		.self = task,
@@ -147,7 +265,7 @@ snet_task_reap(snet_task_t* task) {
 
 static void
 snet_task_init(snet_t* snet, snet_task_t* task) {
-	barena_init(&task->arena, &snet->arena_pool);
+	barena_init(&task->arena, &snet->shared->arena_pool);
 	task->coro.id = 0;
 }
 
@@ -179,6 +297,14 @@ snet_task_post(const snet_task_env_t* env, const snet_event_t* event) {
 	env->self->result = result;
 }
 
+static void
+snet_task_sleep(const snet_task_env_t* env, double duration) {
+	double wake_time = snet_seconds() + duration;
+	while (!snet_task_cancelled(env) && snet_seconds() < wake_time) {
+		snet_task_yield(env);
+	}
+}
+
 // }}}
 
 static inline const char*
@@ -201,8 +327,31 @@ snet_printf(const snet_task_env_t* env, const char* fmt, ...) {
 	return result;
 }
 
-snet_t*
-snet_init(const snet_config_t* config_in) {
+snet_shared_t*
+snet_shared_init(void) {
+	snet_shared_t* shared = cf_alloc(sizeof(snet_shared_t));
+	*shared = (snet_shared_t){ 0 };
+	barena_pool_init(&shared->arena_pool, 1);
+	shared->fetch_pool = snet_fetch_pool_init(&(snet_fetch_pool_config_t){
+		.idle_timeout = SNET_HTTP_IDLE_TIMEOUT,
+	});
+	return shared;
+}
+
+void
+snet_shared_cleanup(snet_shared_t* shared) {
+	snet_fetch_pool_cleanup(shared->fetch_pool);
+	barena_pool_cleanup(&shared->arena_pool);
+	cf_free(shared);
+}
+
+void
+snet_shared_update(snet_shared_t* shared) {
+	snet_fetch_pool_update(shared->fetch_pool);
+}
+
+static snet_t*
+snet_init_ex(const snet_config_t* config_in, snet_shared_t* shared) {
 	snet_config_t config = { 0 };
 	if (config_in != NULL) {
 		config = *config_in;
@@ -213,7 +362,17 @@ snet_init(const snet_config_t* config_in) {
 	}
 
 	if (config.port == 0) {
-		config.port = 443;
+		config.port = config.plain_http ? 80 : 443;
+	}
+
+	if (config.reconnect_timeout == 0.0) {
+		config.reconnect_timeout = SNET_DEFAULT_RECONNECT_TIMEOUT;
+	}
+
+	if (config.redundancy == 0) {
+		config.redundancy = SNET_DEFAULT_REDUNDANCY;
+	} else if (config.redundancy < 0) {
+		config.redundancy = 0;
 	}
 
 	snet_t* snet = cf_alloc(sizeof(snet_t));
@@ -221,264 +380,1356 @@ snet_init(const snet_config_t* config_in) {
 		.config = config,
 	};
 
-	barena_pool_init(&snet->arena_pool, 1);
+#ifndef __EMSCRIPTEN__
+	if (config.threaded && shared == NULL) {
+		config.threaded = false;
+		snet->io = snet_io_init(&config);
+		return snet;
+	}
+#endif
+	snet->config.threaded = false;
+
+	if (shared != NULL) {
+		snet->shared = shared;
+	} else {
+		snet->shared = snet_shared_init();
+		snet->owns_shared = true;
+	}
 
 	snet_task_init(snet, &snet->auth_task);
 	snet_task_init(snet, &snet->create_game_task);
 	snet_task_init(snet, &snet->join_game_task);
 	snet_task_init(snet, &snet->list_games_task);
+	barena_init(&snet->list_cache_arenas[0], &snet->shared->arena_pool);
+	barena_init(&snet->list_cache_arenas[1], &snet->shared->arena_pool);
+	snet_task_init(snet, &snet->watch_games_task);
+	snet_game_table_init(&snet->watched_games);
+	snet->packet_buf = cf_alloc(snet_transport_max_message_size());
+	snet->redundant_id = ((uint64_t)SDL_rand_bits() << 32) | SDL_rand_bits();
 
 	return snet;
 }
 
-void
-snet_cleanup(snet_t* snet) {
-	snet_task_cleanup(&snet->auth_task);
-	snet_task_cleanup(&snet->create_game_task);
-	snet_task_cleanup(&snet->join_game_task);
-	snet_task_cleanup(&snet->list_games_task);
-	barena_pool_cleanup(&snet->arena_pool);
+snet_t*
+snet_init(const snet_config_t* config) {
+	return snet_init_ex(config, NULL);
+}
 
-	if (snet->transport) { snet_transport_cleanup(snet->transport); }
-	cf_free(snet);
+snet_t*
+snet_init_shared(const snet_config_t* config, snet_shared_t* shared) {
+	return snet_init_ex(config, shared);
+}
+
+const snet_clock_t*
+snet_relay_clock(snet_t* snet) {
+	return &snet->clock;
+}
+
+bool
+snet_server_time(snet_t* snet, double* time, double* error) {
+	if (snet->io != NULL) { return snet_io_server_time(snet->io, time, error); }
+
+	return snet_clock_estimate(&snet->clock, snet_seconds(), time, error);
 }
 
 void
-snet_update(snet_t* snet) {
-	snet_task_process(&snet->auth_task);
-	snet_task_process(&snet->create_game_task);
-	snet_task_process(&snet->join_game_task);
-	snet_task_process(&snet->list_games_task);
+snet_send_counters(snet_t* snet, uint64_t* num_messages, uint64_t* num_bytes) {
+	*num_messages = snet->num_messages_sent;
+	*num_bytes = snet->num_bytes_sent;
+}
 
-	if (snet->transport) {
-		snet_transport_update(snet->transport);
+static void
+snet_forget_game(snet_t* snet) {
+	cf_free(snet->game_join_token);
+	cf_free(snet->game_transport_config);
+	snet->game_join_token = NULL;
+	snet->game_transport_config = NULL;
+
+	snet_send_queue_cleanup(&snet->send_queue);
+
+	for (int i = 0; i < alen(snet->redundant_history); ++i) {
+		cf_free((void*)snet->redundant_history[i].ptr);
 	}
+	afree(snet->redundant_history);
+	snet->num_unsent_redundant = 0;
+	afree(snet->redundant_senders);
+	afree(snet->redundant_received);
+	snet->next_redundant_received = 0;
+
+	// The next game may be on another relay
+	snet->clock = (snet_clock_t){ 0 };
 }
 
-const snet_event_t*
-snet_next_event(snet_t* snet) {
-	const snet_event_t* event;
-	if ((event = snet_task_reap(&snet->auth_task)) != NULL) {
-		return event;
+static bool
+snet_send_packet(
+	snet_t* snet,
+	snet_packet_type_t type,
+	uint64_t stream,
+	snet_blob_t payload,
+	bool reliable
+) {
+	char* packet = snet->packet_buf;
+	size_t header_size = SNET_PACKET_HEADER_SIZE;
+	packet[0] = (char)type;
+	if (type != SNET_PACKET_MESSAGE && type != SNET_PACKET_UNRELIABLE_MESSAGE) {
+		for (int i = 0; i < 8; ++i) {
+			packet[SNET_PACKET_HEADER_SIZE + i] = (char)(stream >> (i * 8));
+		}
+		header_size = SNET_STREAM_HEADER_SIZE;
 	}
 
-	if ((event = snet_task_reap(&snet->create_game_task)) != NULL) {
-		return event;
+	if (header_size + payload.size > snet_transport_max_message_size()) { return false; }
+	if (payload.size > 0) { memcpy(packet + header_size, payload.ptr, payload.size); }
+	return snet_transport_send(snet->transport, packet, header_size + payload.size, reliable);
+}
+
+// Returns false when the transport has no room for the message right now.
+// A message which could never fit is dropped instead.
+static bool
+snet_send_now(snet_t* snet, snet_blob_t message, bool reliable) {
+	if (SNET_PACKET_HEADER_SIZE + message.size > snet_transport_max_message_size()) { return true; }
+	snet_packet_type_t type = reliable ? SNET_PACKET_MESSAGE : SNET_PACKET_UNRELIABLE_MESSAGE;
+	if (!snet_send_packet(snet, type, 0, message, reliable)) { return false; }
+
+	snet->num_messages_sent += 1;
+	snet->num_bytes_sent += message.size;
+	return true;
+}
+
+static bool
+snet_send_queued(void* ctx, snet_blob_t message, bool reliable) {
+	return snet_send_now(ctx, message, reliable);
+}
+
+// See snet_send_queue_flush
+static size_t
+snet_flush_sends(snet_t* snet, size_t budget, size_t num_bytes_sent) {
+	return snet_send_queue_flush(&snet->send_queue, budget, num_bytes_sent, snet_send_queued, snet);
+}
+
+// Redundant {{{
+
+// Each packet carries unsent messages and the snet_config_t.redundancy ones
+// before them.
+// Everything is numbered per sender so receivers can skip what they already
+// have.
+
+static void
+snet_write_u32(char* buf, uint32_t value) {
+	for (int i = 0; i < 4; ++i) {
+		buf[i] = (char)(value >> (i * 8));
 	}
+}
 
-	if ((event = snet_task_reap(&snet->join_game_task)) != NULL) {
-		return event;
+static uint32_t
+snet_read_u32(const uint8_t* buf) {
+	uint32_t value = 0;
+	for (int i = 0; i < 4; ++i) {
+		value |= (uint32_t)buf[i] << (i * 8);
 	}
+	return value;
+}
 
-	if ((event = snet_task_reap(&snet->list_games_task)) != NULL) {
-		return event;
+// Sends history[first, end) as one packet of packet_size bytes
+static bool
+snet_send_redundant_packet(snet_t* snet, int first, int end, size_t packet_size) {
+	int num_history = alen(snet->redundant_history);
+	char* packet = snet->packet_buf;
+	packet[0] = (char)SNET_PACKET_REDUNDANT;
+	for (int i = 0; i < 8; ++i) {
+		packet[SNET_PACKET_HEADER_SIZE + i] = (char)(snet->redundant_id >> (i * 8));
+	}
+	snet_write_u32(
+		packet + SNET_PACKET_HEADER_SIZE + 8,
+		snet->next_redundant_sequence - (uint32_t)(num_history - first)
+	);
+	packet[SNET_REDUNDANT_HEADER_SIZE - 1] = (char)(end - first);
+
+	char* itr = packet + SNET_REDUNDANT_HEADER_SIZE;
+	for (int i = first; i < end; ++i) {
+		snet_blob_t message = snet->redundant_history[i];
+		itr[0] = (char)(message.size & 0xFF);
+		itr[1] = (char)(message.size >> 8);
+		if (message.size > 0) { memcpy(itr + SNET_REDUNDANT_SIZE_BYTES, message.ptr, message.size); }
+		itr += SNET_REDUNDANT_SIZE_BYTES + message.size;
 	}
 
-	if (snet->transport != NULL) {
-		size_t packet_size;
-		const void* packet;
-		if (snet_transport_recv(snet->transport, &packet, &packet_size)) {
-			snet->current_event = (snet_event_t){
-				.type = SNET_EVENT_MESSAGE,
-				.message.data = {
-					.ptr = packet,
-					.size = packet_size,
-				},
-			};
-			return &snet->current_event;
+	return snet_transport_send(snet->transport, packet, packet_size, false);
+}
+
+// Unsent messages go out oldest first in as many packets as they need, each
+// one filled up with the messages before it.
+// A packet the transport refuses is lost like any other datagram and only
+// the redundancy of later packets can make up for it.
+// Returns the number of bytes sent
+static size_t
+snet_flush_redundant(snet_t* snet) {
+	if (snet->num_unsent_redundant == 0) { return 0; }
+
+	int num_history = alen(snet->redundant_history);
+	size_t max_size = snet_transport_max_message_size();
+	size_t num_bytes_sent = 0;
+	int next = num_history - snet->num_unsent_redundant;
+	while (next < num_history) {
+		size_t packet_size = SNET_REDUNDANT_HEADER_SIZE;
+		int end = next;
+		while (end < num_history && end - next < SNET_REDUNDANT_MAX_MESSAGES) {
+			size_t size = SNET_REDUNDANT_SIZE_BYTES + snet->redundant_history[end].size;
+			if (packet_size + size > max_size) { break; }
+
+			packet_size += size;
+			end += 1;
 		}
 
-		if (snet_transport_state(snet->transport) == SNET_TRANSPORT_DISCONNECTED) {
-			snet_transport_cleanup(snet->transport);
-			snet->transport = NULL;
-			snet->current_event.type = SNET_EVENT_DISCONNECTED;
-			snet->lobby_state = SNET_IN_LOBBY;
-			return &snet->current_event;
+		// The datagram size can shrink after the message was accepted
+		if (end == next) {
+			next += 1;
+			continue;
 		}
-	}
 
-	return NULL;
-}
+		int first = next;
+		while (
+			first > 0
+			&& next - first < snet->config.redundancy
+			&& end - first < SNET_REDUNDANT_MAX_MESSAGES
+		) {
+			size_t size = SNET_REDUNDANT_SIZE_BYTES + snet->redundant_history[first - 1].size;
+			if (packet_size + size > max_size) { break; }
+
+			packet_size += size;
+			first -= 1;
+		}
 
-snet_auth_state_t
-snet_auth_state(snet_t* snet) {
-	return snet->auth_state;
-}
+		if (!snet_send_redundant_packet(snet, first, end, packet_size)) { break; }
 
-snet_lobby_state_t
-snet_lobby_state(snet_t* snet) {
-	return snet->lobby_state;
-}
+		for (int i = next; i < end; ++i) {
+			snet->num_messages_sent += 1;
+			snet->num_bytes_sent += snet->redundant_history[i].size;
+		}
+		num_bytes_sent += packet_size;
+		next = end;
+	}
 
-static void
-snet_task_login_with_cookie(const snet_task_env_t* env) {
-	SNET_TASK_ARG(snet_blob_t, cookie);
-	snet_t* snet = env->snet;
+	// Only what the next packet repeats is kept
+	int num_dropped = num_history - snet->config.redundancy;
+	if (num_dropped > 0) {
+		for (int i = 0; i < num_dropped; ++i) {
+			cf_free((void*)snet->redundant_history[i].ptr);
+		}
+		memmove(
+			snet->redundant_history,
+			snet->redundant_history + num_dropped,
+			sizeof(snet_blob_t) * (num_history - num_dropped)
+		);
+		asetlen(snet->redundant_history, num_history - num_dropped);
+	}
+	snet->num_unsent_redundant = 0;
 
-	snet->auth_state = SNET_AUTHORIZING;
-	snet_fetch_t* fetch = snet_fetch_begin(&(snet_fetch_options_t){
-		.method = SNET_FETCH_POST,
-		.host = snet->config.host,
-		.port = snet->config.port,
-		.path = snet_printf(env, "%s%s", snet->config.path, "/auth/cookie"),
-		.verify_tls = !snet->config.insecure_tls,
+	return num_bytes_sent;
+}
 
-		.content = cookie.ptr, .content_length = cookie.size,
-	});
+static void
+snet_receive_redundant_packet(snet_t* snet, snet_blob_t packet) {
+	if (packet.size < SNET_REDUNDANT_HEADER_SIZE) { return; }
 
-	snet_fetch_status_t fetch_status;
-	while (true) {
-		if (snet_task_cancelled(env)) { break; }
+	const uint8_t* header = packet.ptr;
+	uint64_t id = 0;
+	for (int i = 0; i < 8; ++i) {
+		id |= (uint64_t)header[SNET_PACKET_HEADER_SIZE + i] << (i * 8);
+	}
+	uint32_t first_sequence = snet_read_u32(header + SNET_PACKET_HEADER_SIZE + 8);
+	int num_messages = header[SNET_REDUNDANT_HEADER_SIZE - 1];
 
-		if ((fetch_status = snet_fetch_process(fetch)) != SNET_FETCH_PENDING) {
+	snet_redundant_sender_t* sender = NULL;
+	for (int i = 0; i < alen(snet->redundant_senders); ++i) {
+		if (snet->redundant_senders[i].id == id) {
+			sender = &snet->redundant_senders[i];
 			break;
 		}
-		snet_task_yield(env);
+	}
+	if (sender == NULL) {
+		apush(snet->redundant_senders, ((snet_redundant_sender_t){
+			.id = id,
+			.sequence = first_sequence - 1,
+		}));
+		sender = &snet->redundant_senders[alen(snet->redundant_senders) - 1];
 	}
 
-	snet_op_status_t op_status = SNET_ERR_IO;
-	snet->auth_state = SNET_UNAUTHORIZED;
-	size_t cookie_size = 0;
-	snet_log(snet, "fetch status: %d", fetch_status);
-	if (fetch_status == SNET_FETCH_FINISHED) {
-		int status_code = snet_fetch_status_code(fetch);
-		snet_log(snet, "status code: %d", status_code);
-		op_status = status_code == 200 ? SNET_OK : SNET_ERR_REJECTED;
-		if (op_status == SNET_OK) {
-			snet->auth_state = SNET_AUTHORIZED;
-			const void* body = snet_fetch_response_body(fetch, &cookie_size);
-			if (cookie_size < sizeof(snet->cookie_buf)) {
-				memcpy(snet->cookie_buf, body, cookie_size);
-				snet->cookie_buf[cookie_size] = '\0';
-			} else {
-				cookie_size = 0;
-				op_status = SNET_ERR_IO;
-				snet_log(snet, "Body is too large");
-			}
+	aclear(snet->redundant_received);
+	snet->next_redundant_received = 0;
+
+	const uint8_t* itr = header + SNET_REDUNDANT_HEADER_SIZE;
+	const uint8_t* end = header + packet.size;
+	uint32_t last_sequence = sender->sequence;
+	for (int i = 0; i < num_messages; ++i) {
+		if (end - itr < SNET_REDUNDANT_SIZE_BYTES) { break; }
+		size_t size = (size_t)itr[0] | ((size_t)itr[1] << 8);
+		if ((size_t)(end - itr) < SNET_REDUNDANT_SIZE_BYTES + size) { break; }
+
+		// Compared so that the sequence can wrap around
+		uint32_t sequence = first_sequence + (uint32_t)i;
+		if ((int32_t)(sequence - sender->sequence) > 0) {
+			int offset = alen(snet->redundant_received);
+			asetlen(snet->redundant_received, offset + SNET_REDUNDANT_SIZE_BYTES + (int)size);
+			memcpy(snet->redundant_received + offset, itr, SNET_REDUNDANT_SIZE_BYTES + size);
+			last_sequence = sequence;
 		}
+
+		itr += SNET_REDUNDANT_SIZE_BYTES + size;
 	}
+	sender->sequence = last_sequence;
+}
 
-	snet_task_post(env, &(snet_event_t){
-		.type = SNET_EVENT_LOGIN_FINISHED,
-		.login = {
-			.status = op_status,
-			.data = {
-				.ptr = snet->cookie_buf,
-				.size = cookie_size,
-			}
+// Returns whether there was a message to report
+static bool
+snet_next_redundant_message(snet_t* snet, snet_event_t* event) {
+	if (snet->next_redundant_received >= alen(snet->redundant_received)) { return false; }
+
+	const uint8_t* itr = (const uint8_t*)snet->redundant_received + snet->next_redundant_received;
+	size_t size = (size_t)itr[0] | ((size_t)itr[1] << 8);
+	*event = (snet_event_t){
+		.type = SNET_EVENT_MESSAGE,
+		.message.data = {
+			.ptr = itr + SNET_REDUNDANT_SIZE_BYTES,
+			.size = size,
 		},
-	});
+	};
+	snet->next_redundant_received += SNET_REDUNDANT_SIZE_BYTES + (int)size;
+	return true;
+}
 
-	snet_fetch_end(fetch);
+// }}}
+
+// Stream {{{
+
+// Streams share the ordered reliable channel with messages.
+// They are sent in chunks from what the send budget leaves, round robin
+// between streams, and stop early when the transport has too many reliable
+// messages in flight.
+
+static snet_outgoing_stream_t*
+snet_find_outgoing_stream(snet_t* snet, uint64_t id) {
+	for (int i = 0; i < alen(snet->outgoing_streams); ++i) {
+		if (snet->outgoing_streams[i].id == id) {
+			return &snet->outgoing_streams[i];
+		}
+	}
+	return NULL;
+}
+
+static snet_incoming_stream_t*
+snet_find_incoming_stream(snet_t* snet, uint64_t id) {
+	for (int i = 0; i < alen(snet->incoming_streams); ++i) {
+		if (snet->incoming_streams[i].id == id) {
+			return &snet->incoming_streams[i];
+		}
+	}
+	return NULL;
 }
 
 void
-snet_login_with_cookie(snet_t* snet, snet_blob_t cookie) {
-	snet_task_begin(
-		snet, &snet->auth_task,
-		snet_task_login_with_cookie, &cookie, sizeof(cookie)
-	);
+snet_stream_open_with_id(snet_t* snet, uint64_t id) {
+	apush(snet->outgoing_streams, ((snet_outgoing_stream_t){
+		.id = id,
+		.aborted = snet->transport == NULL && snet->lobby_state != SNET_RECONNECTING,
+		.progressed = true,
+	}));
 }
 
-static void*
-snet_oauth_alloc(size_t size, size_t alignment, void* memctx) {
-	const snet_task_env_t* env = memctx;
-	return barena_memalign(&env->self->arena, size, alignment);
+// Everything in flight is lost with the connection
+static void
+snet_abort_streams(snet_t* snet) {
+	for (int i = 0; i < alen(snet->outgoing_streams); ++i) {
+		snet_outgoing_stream_t* stream = &snet->outgoing_streams[i];
+		stream->aborted = true;
+		stream->progressed = true;
+	}
+	aclear(snet->incoming_streams);
 }
 
 static void
-snet_task_login_with_itchio(const snet_task_env_t* env) {
-	SNET_TASK_ARG(snet_blob_t, cookie);
-	snet_t* snet = env->snet;
+snet_cleanup_streams(snet_t* snet) {
+	for (int i = 0; i < alen(snet->outgoing_streams); ++i) {
+		cf_free(snet->outgoing_streams[i].buffer);
+	}
+	afree(snet->outgoing_streams);
+	afree(snet->incoming_streams);
+}
 
-	snet->auth_state = SNET_AUTHORIZING;
-	snet_oauth_t* oauth = snet_oauth_begin(&(snet_oauth_config_t){
-		.start_url = snet_printf(env, SNET_URL_FMT_PREFIX "/auth/itchio/start", SNET_URL_FMT_PREFIX_ARGS(snet)),
-		.end_url = snet_printf(env, SNET_URL_FMT_PREFIX "/auth/itchio/end", SNET_URL_FMT_PREFIX_ARGS(snet)),
-		.alloc = snet_oauth_alloc,
-		.memctx = (void*)env,
-	});
+// Returns the number of bytes sent or -1 when the transport is full
+static int
+snet_flush_stream_chunk(snet_t* snet, snet_outgoing_stream_t* stream) {
+	snet_blob_t none = { 0 };
+	if (!stream->opened) {
+		if (!snet_send_packet(snet, SNET_PACKET_STREAM_OPEN, stream->id, none, true)) { return -1; }
+		stream->opened = true;
+		return SNET_STREAM_HEADER_SIZE;
+	}
 
+	size_t num_pending = stream->size - stream->head;
+	if (num_pending > 0) {
+		size_t max_chunk_size = snet_transport_max_message_size() - SNET_STREAM_HEADER_SIZE;
+		snet_blob_t chunk = {
+			.ptr = stream->buffer + stream->head,
+			.size = num_pending < max_chunk_size ? num_pending : max_chunk_size,
+		};
+		if (!snet_send_packet(snet, SNET_PACKET_STREAM_DATA, stream->id, chunk, true)) { return -1; }
+
+		stream->head += chunk.size;
+		stream->num_bytes_sent += chunk.size;
+		stream->progressed = true;
+		if (stream->head == stream->size) {
+			stream->head = 0;
+			stream->size = 0;
+		}
+		return (int)(SNET_STREAM_HEADER_SIZE + chunk.size);
+	}
 
-	snet_oauth_state_t oauth_state;
-	while (true) {
-		if (snet_task_cancelled(env)) { break; }
+	if (stream->closing && !stream->closed) {
+		if (!snet_send_packet(snet, SNET_PACKET_STREAM_CLOSE, stream->id, none, true)) { return -1; }
+		stream->closed = true;
+		stream->progressed = true;
+		return SNET_STREAM_HEADER_SIZE;
+	}
 
-		if ((oauth_state = snet_oauth_update(oauth)) != SNET_OAUTH_PENDING) {
-			break;
+	return 0;
+}
+
+// At least one chunk goes out per update so streams are never starved
+static void
+snet_flush_streams(snet_t* snet, size_t budget) {
+	int num_streams = alen(snet->outgoing_streams);
+	if (num_streams == 0) { return; }
+
+	size_t num_bytes_sent = 0;
+	bool progressed = true;
+	while (progressed && (num_bytes_sent == 0 || num_bytes_sent < budget)) {
+		progressed = false;
+		for (int i = 0; i < num_streams && (num_bytes_sent == 0 || num_bytes_sent < budget); ++i) {
+			snet->next_outgoing_stream = (snet->next_outgoing_stream + 1) % num_streams;
+			snet_outgoing_stream_t* stream = &snet->outgoing_streams[snet->next_outgoing_stream];
+			if (stream->aborted) { continue; }
+
+			int result = snet_flush_stream_chunk(snet, stream);
+			if (result < 0) { return; }
+
+			num_bytes_sent += result;
+			progressed = progressed || result > 0;
 		}
-		snet_task_yield(env);
 	}
+}
 
-	if (oauth_state != SNET_OAUTH_PENDING) {  // We could be cancelled
-		size_t data_size;
-		const void* oauth_data = snet_oauth_data(oauth, &data_size);
-		if (oauth_data != NULL && data_size < sizeof(snet->cookie_buf)) {
-			memcpy(snet->cookie_buf, oauth_data, data_size);
-			snet->cookie_buf[data_size] = '\0';
-		}
-		snet_task_post(env, &(snet_event_t){
-			.type = SNET_EVENT_LOGIN_FINISHED,
-			.login = {
-				.status = oauth_state == SNET_OAUTH_SUCCESS ? SNET_OK : SNET_ERR_REJECTED,
-				.data = { .ptr = snet->cookie_buf, .size = data_size },
-			},
-		});
-	} else {
-		snet_task_post(env, &(snet_event_t){
-			.type = SNET_EVENT_LOGIN_FINISHED,
-			.login = {
-				.status = SNET_ERR_IO,
+// Returns whether there was something to report
+static bool
+snet_next_stream_progress(snet_t* snet, snet_event_t* event) {
+	for (int i = 0; i < alen(snet->outgoing_streams); ++i) {
+		snet_outgoing_stream_t* stream = &snet->outgoing_streams[i];
+		if (!stream->progressed) { continue; }
+
+		stream->progressed = false;
+		*event = (snet_event_t){
+			.type = SNET_EVENT_STREAM_PROGRESS,
+			.stream_progress = {
+				.id = stream->id,
+				.num_bytes_written = stream->num_bytes_written,
+				.num_bytes_sent = stream->num_bytes_sent,
+				.finished = stream->closed,
+				.aborted = stream->aborted,
 			},
-		});
-	}
+		};
 
-	snet->auth_state = oauth_state == SNET_OAUTH_SUCCESS ? SNET_AUTHORIZED : SNET_UNAUTHORIZED;
+		if (stream->closed || stream->aborted) {
+			cf_free(stream->buffer);
+			snet->outgoing_streams[i] = snet->outgoing_streams[alen(snet->outgoing_streams) - 1];
+			apop(snet->outgoing_streams);
+		}
+		return true;
+	}
 
-	snet_oauth_end(oauth);
+	return false;
 }
 
-void
-snet_login_with_itchio(snet_t* snet) {
-	snet_task_begin(snet, &snet->auth_task, snet_task_login_with_itchio, NULL, 0);
-}
+// Returns whether the packet should be reported
+static bool
+snet_receive_stream_packet(snet_t* snet, snet_packet_type_t type, snet_blob_t packet, snet_event_t* event) {
+	if (packet.size < SNET_STREAM_HEADER_SIZE) { return false; }
 
-static snet_fetch_header_t
-snet_auth_header(const snet_task_env_t* env, snet_t* snet) {
+	const uint8_t* header = packet.ptr;
+	uint64_t id = 0;
+	for (int i = 0; i < 8; ++i) {
+		id |= (uint64_t)header[SNET_PACKET_HEADER_SIZE + i] << (i * 8);
+	}
+
+	if (type == SNET_PACKET_STREAM_OPEN) {
+		if (snet_find_incoming_stream(snet, id) == NULL) {
+			apush(snet->incoming_streams, ((snet_incoming_stream_t){ .id = id }));
+		}
+		*event = (snet_event_t){
+			.type = SNET_EVENT_STREAM_OPENED,
+			.stream = { .id = id },
+		};
+		return true;
+	}
+
+	// Opened before this instance joined
+	snet_incoming_stream_t* stream = snet_find_incoming_stream(snet, id);
+	if (stream == NULL) { return false; }
+
+	if (type == SNET_PACKET_STREAM_DATA) {
+		*event = (snet_event_t){
+			.type = SNET_EVENT_STREAM_DATA,
+			.stream = {
+				.id = id,
+				.offset = stream->num_bytes_received,
+				.data = {
+					.ptr = header + SNET_STREAM_HEADER_SIZE,
+					.size = packet.size - SNET_STREAM_HEADER_SIZE,
+				},
+			},
+		};
+		stream->num_bytes_received += packet.size - SNET_STREAM_HEADER_SIZE;
+	} else {
+		*event = (snet_event_t){
+			.type = SNET_EVENT_STREAM_CLOSED,
+			.stream = {
+				.id = id,
+				.offset = stream->num_bytes_received,
+			},
+		};
+		*stream = snet->incoming_streams[alen(snet->incoming_streams) - 1];
+		apop(snet->incoming_streams);
+	}
+	return true;
+}
+
+uint64_t
+snet_stream_open(snet_t* snet) {
+	uint64_t id = ((uint64_t)SDL_rand_bits() << 32) | SDL_rand_bits();
+
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_STREAM_OPEN,
+			.stream = id,
+		});
+	} else {
+		snet_stream_open_with_id(snet, id);
+	}
+
+	return id;
+}
+
+void
+snet_stream_write(snet_t* snet, uint64_t id, snet_blob_t data) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_STREAM_WRITE,
+			.stream = id,
+			.blob = data,
+		});
+		return;
+	}
+
+	snet_outgoing_stream_t* stream = snet_find_outgoing_stream(snet, id);
+	if (stream == NULL || stream->closing || stream->aborted) { return; }
+
+	if (stream->size + data.size > stream->capacity && stream->head > 0) {
+		// Reclaim what was already sent before growing
+		memmove(stream->buffer, stream->buffer + stream->head, stream->size - stream->head);
+		stream->size -= stream->head;
+		stream->head = 0;
+	}
+
+	if (stream->size + data.size > stream->capacity) {
+		size_t capacity = stream->capacity > 0 ? stream->capacity * 2 : 4096;
+		while (capacity < stream->size + data.size) { capacity *= 2; }
+		stream->buffer = cf_realloc(stream->buffer, capacity);
+		stream->capacity = capacity;
+	}
+
+	if (data.size > 0) { memcpy(stream->buffer + stream->size, data.ptr, data.size); }
+	stream->size += data.size;
+	stream->num_bytes_written += data.size;
+	stream->progressed = true;
+}
+
+void
+snet_stream_close(snet_t* snet, uint64_t id) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_STREAM_CLOSE,
+			.stream = id,
+		});
+		return;
+	}
+
+	snet_outgoing_stream_t* stream = snet_find_outgoing_stream(snet, id);
+	if (stream != NULL) { stream->closing = true; }
+}
+
+// }}}
+
+// Returns the number of bytes sent
+static size_t
+snet_request_clock(snet_t* snet) {
+	// Requests made while connecting would be lost and counted as unanswered
+	if (snet_transport_state(snet->transport) != SNET_TRANSPORT_CONNECTED) { return 0; }
+
+	double now = snet_seconds();
+	if (!snet_clock_should_request(&snet->clock, now)) { return 0; }
+
+	char request[SNET_CLOCK_REQUEST_SIZE];
+	request[0] = (char)SNET_PACKET_CLOCK_REQUEST;
+	snet_clock_write_time(request + SNET_PACKET_HEADER_SIZE, now);
+	return snet_transport_send(snet->transport, request, sizeof(request), false) ? sizeof(request) : 0;
+}
+
+static void
+snet_receive_clock_response(snet_t* snet, snet_blob_t packet) {
+	if (packet.size < SNET_CLOCK_RESPONSE_SIZE) { return; }
+
+	const char* response = packet.ptr;
+	snet_clock_add_sample(
+		&snet->clock,
+		snet_clock_read_time(response + SNET_PACKET_HEADER_SIZE),
+		snet_clock_read_time(response + SNET_CLOCK_REQUEST_SIZE),
+		snet_seconds()
+	);
+}
+
+static void
+snet_flush_outgoing(snet_t* snet) {
+	size_t budget = snet->config.send_budget;
+	size_t num_bytes_sent = snet_request_clock(snet);
+	num_bytes_sent += snet_flush_redundant(snet);
+	num_bytes_sent = snet_flush_sends(snet, budget, num_bytes_sent);
+
+	if (budget == 0) {
+		snet_flush_streams(snet, SNET_STREAM_MAX_BYTES_PER_UPDATE);
+	} else {
+		snet_flush_streams(snet, budget > num_bytes_sent ? budget - num_bytes_sent : 0);
+	}
+}
+
+void
+snet_cleanup(snet_t* snet) {
+	if (snet->io != NULL) {
+		snet_io_cleanup(snet->io);
+		cf_free(snet);
+		return;
+	}
+
+	snet_task_cleanup(&snet->auth_task);
+	snet_task_cleanup(&snet->create_game_task);
+	snet_task_cleanup(&snet->join_game_task);
+	snet_task_cleanup(&snet->list_games_task);
+	barena_reset(&snet->list_cache_arenas[0]);
+	barena_reset(&snet->list_cache_arenas[1]);
+	snet_task_cleanup(&snet->watch_games_task);
+	snet_game_table_cleanup(&snet->watched_games);
+	cf_free(snet->watch_events);
+	if (snet->owns_shared) { snet_shared_cleanup(snet->shared); }
+
+	if (snet->transport) { snet_transport_cleanup(snet->transport); }
+	snet_forget_game(snet);
+	snet_cleanup_streams(snet);
+	cf_free(snet->packet_buf);
+	cf_free(snet);
+}
+
+void
+snet_update(snet_t* snet) {
+	if (snet->io != NULL) {
+		snet_io_update(snet->io);
+		return;
+	}
+
+	snet_task_process(&snet->auth_task);
+	snet_task_process(&snet->create_game_task);
+	snet_task_process(&snet->join_game_task);
+	snet_task_process(&snet->list_games_task);
+	snet_task_process(&snet->watch_games_task);
+	if (snet->owns_shared) { snet_shared_update(snet->shared); }
+
+	if (snet->transport) {
+		snet_flush_outgoing(snet);
+		snet_transport_update(snet->transport);
+	}
+}
+
+// Work which can be put off to the next update, in priority order
+typedef enum {
+	SNET_UPDATE_JOIN_GAME_TASK,
+	SNET_UPDATE_CREATE_GAME_TASK,
+	SNET_UPDATE_AUTH_TASK,
+	SNET_UPDATE_LIST_GAMES_TASK,
+	SNET_UPDATE_WATCH_GAMES_TASK,
+	SNET_UPDATE_SHARED,
+
+	SNET_UPDATE_STEP_COUNT,
+} snet_update_step_t;
+
+static void
+snet_update_step(snet_t* snet, snet_update_step_t step) {
+	switch (step) {
+		case SNET_UPDATE_JOIN_GAME_TASK:
+			snet_task_process(&snet->join_game_task);
+			break;
+		case SNET_UPDATE_CREATE_GAME_TASK:
+			snet_task_process(&snet->create_game_task);
+			break;
+		case SNET_UPDATE_AUTH_TASK:
+			snet_task_process(&snet->auth_task);
+			break;
+		case SNET_UPDATE_LIST_GAMES_TASK:
+			snet_task_process(&snet->list_games_task);
+			break;
+		case SNET_UPDATE_WATCH_GAMES_TASK:
+			snet_task_process(&snet->watch_games_task);
+			break;
+		case SNET_UPDATE_SHARED:
+			if (snet->owns_shared) { snet_shared_update(snet->shared); }
+			break;
+		case SNET_UPDATE_STEP_COUNT:
+			break;
+	}
+}
+
+void
+snet_update_budgeted(snet_t* snet, int max_microseconds) {
+	if (snet->io != NULL) {
+		// The I/O thread does the actual work
+		snet_io_update(snet->io);
+		return;
+	}
+
+	double deadline = snet_seconds() + (double)max_microseconds * 1e-6;
+
+	// The game connection always goes first so it never stalls
+	if (snet->transport) {
+		snet_flush_outgoing(snet);
+		snet_transport_update(snet->transport);
+	}
+
+	// At least one step is taken so the rest is never starved
+	for (int i = 0; i < SNET_UPDATE_STEP_COUNT; ++i) {
+		if (i > 0 && snet_seconds() >= deadline) { break; }
+
+		snet_update_step(snet, snet->next_update_step);
+		snet->next_update_step = (snet->next_update_step + 1) % SNET_UPDATE_STEP_COUNT;
+	}
+}
+
+static void
+snet_task_reconnect(const snet_task_env_t* env);
+
+const snet_event_t*
+snet_next_event(snet_t* snet) {
+	if (snet->io != NULL) { return snet_io_next_event(snet->io); }
+
+	const snet_event_t* event;
+	if ((event = snet_task_reap(&snet->auth_task)) != NULL) {
+		return event;
+	}
+
+	if ((event = snet_task_reap(&snet->create_game_task)) != NULL) {
+		return event;
+	}
+
+	if ((event = snet_task_reap(&snet->join_game_task)) != NULL) {
+		return event;
+	}
+
+	if ((event = snet_task_reap(&snet->list_games_task)) != NULL) {
+		return event;
+	}
+
+	if (snet->next_watch_event < snet->num_watch_events) {
+		return &snet->watch_events[snet->next_watch_event++];
+	} else if (snet->num_watch_events > 0) {
+		// Nothing refers to replaced or removed games any more
+		snet->num_watch_events = 0;
+		snet->next_watch_event = 0;
+		snet_game_table_collect_garbage(&snet->watched_games);
+	}
+
+	if (snet_next_stream_progress(snet, &snet->current_event)) {
+		return &snet->current_event;
+	}
+
+	if (snet_next_redundant_message(snet, &snet->current_event)) {
+		return &snet->current_event;
+	}
+
+	if (snet->transport != NULL) {
+		size_t packet_size;
+		const void* packet;
+		while (snet_transport_recv(snet->transport, &packet, &packet_size)) {
+			if (packet_size < SNET_PACKET_HEADER_SIZE) { continue; }
+
+			snet_packet_type_t type = *(const uint8_t*)packet;
+			if (type == SNET_PACKET_MESSAGE || type == SNET_PACKET_UNRELIABLE_MESSAGE) {
+				snet->current_event = (snet_event_t){
+					.type = SNET_EVENT_MESSAGE,
+					.message.data = {
+						.ptr = (const char*)packet + SNET_PACKET_HEADER_SIZE,
+						.size = packet_size - SNET_PACKET_HEADER_SIZE,
+					},
+				};
+				return &snet->current_event;
+			} else if (type == SNET_PACKET_CLOCK_RESPONSE) {
+				snet_receive_clock_response(snet, (snet_blob_t){ .ptr = packet, .size = packet_size });
+			} else if (type == SNET_PACKET_REDUNDANT) {
+				snet_receive_redundant_packet(snet, (snet_blob_t){ .ptr = packet, .size = packet_size });
+				if (snet_next_redundant_message(snet, &snet->current_event)) {
+					return &snet->current_event;
+				}
+			} else if (
+				(type == SNET_PACKET_STREAM_OPEN || type == SNET_PACKET_STREAM_DATA || type == SNET_PACKET_STREAM_CLOSE)
+				&& snet_receive_stream_packet(
+					snet, type,
+					(snet_blob_t){ .ptr = packet, .size = packet_size },
+					&snet->current_event
+				)
+			) {
+				return &snet->current_event;
+			}
+		}
+
+		if (snet_transport_state(snet->transport) == SNET_TRANSPORT_DISCONNECTED) {
+			bool network_changed = snet_transport_network_changed(snet->transport);
+			snet_transport_cleanup(snet->transport);
+			snet->transport = NULL;
+			snet_abort_streams(snet);
+			if (snet->config.reconnect_timeout > 0.0 && snet->game_join_token != NULL) {
+				snet->current_event.type = SNET_EVENT_RECONNECTING;
+				snet->lobby_state = SNET_RECONNECTING;
+				snet_task_begin(
+					snet, &snet->join_game_task,
+					snet_task_reconnect, &network_changed, sizeof(network_changed)
+				);
+			} else {
+				snet->current_event.type = SNET_EVENT_DISCONNECTED;
+				snet->lobby_state = SNET_IN_LOBBY;
+				snet_forget_game(snet);
+			}
+			return &snet->current_event;
+		}
+	}
+
+	return NULL;
+}
+
+snet_auth_state_t
+snet_auth_state(snet_t* snet) {
+	if (snet->io != NULL) { return snet_io_auth_state(snet->io); }
+
+	return snet->auth_state;
+}
+
+snet_lobby_state_t
+snet_lobby_state(snet_t* snet) {
+	if (snet->io != NULL) { return snet_io_lobby_state(snet->io); }
+
+	return snet->lobby_state;
+}
+
+// Opens a lobby connection ahead of the next request so a join does not pay
+// for the handshakes.
+// Name resolution still blocks, only in the update which preconnects instead.
+static void
+snet_preconnect(snet_t* snet) {
+	// cf_https does not keep connections around
+	if (snet->config.insecure_tls && !snet->config.plain_http) { return; }
+
+	snet_fetch_pool_preconnect(
+		snet->shared->fetch_pool,
+		snet->config.host, snet->config.port, snet->config.plain_http
+	);
+}
+
+static void
+snet_task_login_with_cookie(const snet_task_env_t* env) {
+	SNET_TASK_ARG(snet_blob_t, cookie);
+	snet_t* snet = env->snet;
+
+	snet->auth_state = SNET_AUTHORIZING;
+	snet_fetch_t* fetch = snet_fetch_begin(&(snet_fetch_options_t){
+		.method = SNET_FETCH_POST,
+		.host = snet->config.host,
+		.port = snet->config.port,
+		.path = snet_printf(env, "%s%s", snet->config.path, "/auth/cookie"),
+		.verify_tls = !snet->config.insecure_tls,
+		.plain_http = snet->config.plain_http,
+		.pool = snet->shared->fetch_pool,
+
+		.content = cookie.ptr, .content_length = cookie.size,
+	});
+
+	snet_fetch_status_t fetch_status;
+	while (true) {
+		if (snet_task_cancelled(env)) { break; }
+
+		if ((fetch_status = snet_fetch_process(fetch)) != SNET_FETCH_PENDING) {
+			break;
+		}
+		snet_task_yield(env);
+	}
+
+	snet_op_status_t op_status = SNET_ERR_IO;
+	snet->auth_state = SNET_UNAUTHORIZED;
+	size_t cookie_size = 0;
+	snet_log(snet, "fetch status: %d", fetch_status);
+	if (fetch_status == SNET_FETCH_FINISHED) {
+		int status_code = snet_fetch_status_code(fetch);
+		snet_log(snet, "status code: %d", status_code);
+		op_status = status_code == 200 ? SNET_OK : SNET_ERR_REJECTED;
+		if (op_status == SNET_OK) {
+			snet->auth_state = SNET_AUTHORIZED;
+			snet_preconnect(snet);
+			const void* body = snet_fetch_response_body(fetch, &cookie_size);
+			if (cookie_size < sizeof(snet->cookie_buf)) {
+				memcpy(snet->cookie_buf, body, cookie_size);
+				snet->cookie_buf[cookie_size] = '\0';
+			} else {
+				cookie_size = 0;
+				op_status = SNET_ERR_IO;
+				snet_log(snet, "Body is too large");
+			}
+		}
+	}
+
+	snet_task_post(env, &(snet_event_t){
+		.type = SNET_EVENT_LOGIN_FINISHED,
+		.login = {
+			.status = op_status,
+			.data = {
+				.ptr = snet->cookie_buf,
+				.size = cookie_size,
+			}
+		},
+	});
+
+	snet_fetch_end(fetch);
+}
+
+void
+snet_login_with_cookie(snet_t* snet, snet_blob_t cookie) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_LOGIN_WITH_COOKIE,
+			.blob = cookie,
+		});
+		return;
+	}
+
+	snet_task_begin(
+		snet, &snet->auth_task,
+		snet_task_login_with_cookie, &cookie, sizeof(cookie)
+	);
+}
+
+static void*
+snet_oauth_alloc(size_t size, size_t alignment, void* memctx) {
+	const snet_task_env_t* env = memctx;
+	return barena_memalign(&env->self->arena, size, alignment);
+}
+
+static void
+snet_task_login_with_itchio(const snet_task_env_t* env) {
+	SNET_TASK_ARG(snet_blob_t, cookie);
+	snet_t* snet = env->snet;
+
+	snet->auth_state = SNET_AUTHORIZING;
+	snet_oauth_t* oauth = snet_oauth_begin(&(snet_oauth_config_t){
+		.start_url = snet_printf(env, SNET_URL_FMT_PREFIX "/auth/itchio/start", SNET_URL_FMT_PREFIX_ARGS(snet)),
+		.end_url = snet_printf(env, SNET_URL_FMT_PREFIX "/auth/itchio/end", SNET_URL_FMT_PREFIX_ARGS(snet)),
+		.alloc = snet_oauth_alloc,
+		.memctx = (void*)env,
+	});
+
+
+	snet_oauth_state_t oauth_state;
+	while (true) {
+		if (snet_task_cancelled(env)) { break; }
+
+		if ((oauth_state = snet_oauth_update(oauth)) != SNET_OAUTH_PENDING) {
+			break;
+		}
+		snet_task_yield(env);
+	}
+
+	if (oauth_state != SNET_OAUTH_PENDING) {  // We could be cancelled
+		size_t data_size;
+		const void* oauth_data = snet_oauth_data(oauth, &data_size);
+		if (oauth_data != NULL && data_size < sizeof(snet->cookie_buf)) {
+			memcpy(snet->cookie_buf, oauth_data, data_size);
+			snet->cookie_buf[data_size] = '\0';
+		}
+		snet_task_post(env, &(snet_event_t){
+			.type = SNET_EVENT_LOGIN_FINISHED,
+			.login = {
+				.status = oauth_state == SNET_OAUTH_SUCCESS ? SNET_OK : SNET_ERR_REJECTED,
+				.data = { .ptr = snet->cookie_buf, .size = data_size },
+			},
+		});
+	} else {
+		snet_task_post(env, &(snet_event_t){
+			.type = SNET_EVENT_LOGIN_FINISHED,
+			.login = {
+				.status = SNET_ERR_IO,
+			},
+		});
+	}
+
+	snet->auth_state = oauth_state == SNET_OAUTH_SUCCESS ? SNET_AUTHORIZED : SNET_UNAUTHORIZED;
+	if (snet->auth_state == SNET_AUTHORIZED) { snet_preconnect(snet); }
+
+	snet_oauth_end(oauth);
+}
+
+void
+snet_login_with_itchio(snet_t* snet) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_LOGIN_WITH_ITCHIO,
+		});
+		return;
+	}
+
+	snet_task_begin(snet, &snet->auth_task, snet_task_login_with_itchio, NULL, 0);
+}
+
+static snet_fetch_header_t
+snet_auth_header(const snet_task_env_t* env, snet_t* snet) {
 	return (snet_fetch_header_t){
 		.name = "Authorization",
 		.value = snet_printf(env, "Bearer %s", snet->cookie_buf),
 	};
 }
 
-static snet_blob_t
-snet_strcpy(const snet_task_env_t* env, const char* str) {
-	if (str == NULL) { return (snet_blob_t){ 0 }; }
-	size_t len = strlen(str);
-	char* copy = snet_task_alloc(env, len + 1);
-	memcpy(copy, str, len + 1);
-	return (snet_blob_t){
-		.ptr = copy,
-		.size = len,
-	};
+static bool
+snet_use_wire_format(snet_t* snet) {
+	// With TLS verification disabled, native requests go through cf_https
+	// which does not expose the Content-Type of the response
+	return snet->config.binary_lobby
+		&& (!snet->config.insecure_tls || snet->config.plain_http);
+}
+
+// Terminates the header list when the binary format is not wanted so it must
+// come last
+static snet_fetch_header_t
+snet_accept_header(snet_t* snet) {
+	if (!snet_use_wire_format(snet)) { return (snet_fetch_header_t){ 0 }; }
+
+	return (snet_fetch_header_t){
+		.name = "Accept",
+		.value = SNET_WIRE_CONTENT_TYPE ", application/json;q=0.5",
+	};
+}
+
+static bool
+snet_is_wire_response(snet_fetch_t* fetch) {
+	size_t size;
+	const char* content_type = snet_fetch_response_header(fetch, "Content-Type", &size);
+	size_t expected_size = sizeof(SNET_WIRE_CONTENT_TYPE) - 1;
+
+	return content_type != NULL
+		&& size >= expected_size
+		&& memcmp(content_type, SNET_WIRE_CONTENT_TYPE, expected_size) == 0
+		&& (size == expected_size || content_type[expected_size] == ';');
+}
+
+static snet_blob_t
+snet_arena_strncpy(barena_t* arena, const char* str, size_t len) {
+	char* copy = barena_malloc(arena, len + 1);
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return (snet_blob_t){
+		.ptr = copy,
+		.size = len,
+	};
+}
+
+static snet_blob_t
+snet_strncpy(const snet_task_env_t* env, const char* str, size_t len) {
+	return snet_arena_strncpy(&env->self->arena, str, len);
+}
+
+static snet_blob_t
+snet_strcpy(const snet_task_env_t* env, const char* str) {
+	if (str == NULL) { return (snet_blob_t){ 0 }; }
+	return snet_strncpy(env, str, strlen(str));
+}
+
+static const char*
+snet_url_encode(const snet_task_env_t* env, snet_blob_t blob) {
+	static const char hex[] = "0123456789ABCDEF";
+
+	const unsigned char* src = blob.ptr;
+	char* out = snet_task_alloc(env, blob.size * 3 + 1);
+	char* itr = out;
+	for (size_t i = 0; i < blob.size; ++i) {
+		unsigned char ch = src[i];
+		if (
+			('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ('0' <= ch && ch <= '9')
+			|| ch == '-' || ch == '_' || ch == '.' || ch == '~'
+		) {
+			*itr++ = (char)ch;
+		} else {
+			*itr++ = '%';
+			*itr++ = hex[ch >> 4];
+			*itr++ = hex[ch & 0x0F];
+		}
+	}
+	*itr = '\0';
+
+	return out;
+}
+
+// Intern table {{{
+
+// Deduplicates strings within one arena.
+// Only the slots are owned by the table, the strings live in the arena.
+typedef struct {
+	snet_blob_t* slots;
+	int num_strings;
+	int capacity;
+} snet_intern_table_t;
+
+static uint32_t
+snet_intern_hash(const char* str, size_t len) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static snet_blob_t*
+snet_intern_find_slot(snet_blob_t* slots, int capacity, const char* str, size_t len) {
+	uint32_t mask = (uint32_t)capacity - 1;
+	for (uint32_t slot = snet_intern_hash(str, len) & mask;; slot = (slot + 1) & mask) {
+		snet_blob_t* entry = &slots[slot];
+		if (entry->ptr == NULL) { return entry; }
+		if (entry->size == len && memcmp(entry->ptr, str, len) == 0) { return entry; }
+	}
+}
+
+static void
+snet_intern_table_cleanup(snet_intern_table_t* table) {
+	cf_free(table->slots);
+	*table = (snet_intern_table_t){ 0 };
+}
+
+// Returns the slot for str, which is empty if it has not been interned yet.
+// An empty slot must be filled before the next call.
+static snet_blob_t*
+snet_intern_table_lookup(snet_intern_table_t* table, const char* str, size_t len) {
+	// Keep the load factor under 1/2
+	if ((table->num_strings + 1) * 2 > table->capacity) {
+		int capacity = table->capacity > 0 ? table->capacity * 2 : 64;
+		snet_blob_t* slots = cf_alloc(sizeof(snet_blob_t) * capacity);
+		memset(slots, 0, sizeof(snet_blob_t) * capacity);
+		for (int i = 0; i < table->capacity; ++i) {
+			snet_blob_t* entry = &table->slots[i];
+			if (entry->ptr != NULL) {
+				*snet_intern_find_slot(slots, capacity, entry->ptr, entry->size) = *entry;
+			}
+		}
+
+		cf_free(table->slots);
+		table->slots = slots;
+		table->capacity = capacity;
+	}
+
+	snet_blob_t* slot = snet_intern_find_slot(table->slots, table->capacity, str, len);
+	if (slot->ptr == NULL) { table->num_strings += 1; }
+	return slot;
+}
+
+static snet_blob_t
+snet_intern(snet_intern_table_t* table, barena_t* arena, const char* str, size_t len) {
+	snet_blob_t* slot = snet_intern_table_lookup(table, str, len);
+	if (slot->ptr == NULL) {
+		*slot = snet_arena_strncpy(arena, str, len);
+	}
+	return *slot;
+}
+
+// }}}
+
+typedef struct {
+	bool has_size;
+	size_t size;
+	char* buf;
+	barena_snapshot_t snapshot;
+} snet_wire_string_t;
+
+// Reads a length-prefixed string straight into the arena as it arrives.
+// The copy is null-terminated like the ones decoded from JSON.
+// If interned is not NULL, a string which was already seen is dropped from
+// the arena again and the existing copy is returned instead.
+static snet_wire_status_t
+snet_wire_read_string(
+	snet_wire_reader_t* reader,
+	barena_t* arena,
+	snet_intern_table_t* interned,
+	snet_wire_string_t* str,
+	snet_blob_t* out
+) {
+	snet_wire_status_t status;
+	if (!str->has_size) {
+		uint64_t size;
+		if ((status = snet_wire_read_varint(reader, &size)) != SNET_WIRE_OK) {
+			return status;
+		}
+		if (size > SNET_MAX_WIRE_STRING_SIZE) { return SNET_WIRE_ERROR; }
+
+		str->has_size = true;
+		str->size = (size_t)size;
+		str->snapshot = barena_snapshot(arena);
+		str->buf = barena_malloc(arena, str->size + 1);
+		str->buf[str->size] = '\0';
+	}
+
+	if ((status = snet_wire_read_bytes(reader, str->buf, str->size)) != SNET_WIRE_OK) {
+		return status;
+	}
+
+	*out = (snet_blob_t){ .ptr = str->buf, .size = str->size };
+	if (interned != NULL) {
+		snet_blob_t* slot = snet_intern_table_lookup(interned, str->buf, str->size);
+		if (slot->ptr != NULL) {
+			// Nothing else is allocated while a string is being read
+			barena_restore(arena, str->snapshot);
+			*out = *slot;
+		} else {
+			*slot = *out;
+		}
+	}
+
+	*str = (snet_wire_string_t){ 0 };
+	return SNET_WIRE_OK;
+}
+
+static bool
+snet_decode_game_info_wire(barena_t* arena, const void* data, size_t size, snet_game_info_t* game) {
+	*game = (snet_game_info_t){ 0 };
+
+	snet_wire_reader_t reader;
+	snet_wire_reader_init(&reader);
+	snet_wire_reader_feed(&reader, data, size);
+
+	snet_wire_string_t str = { 0 };
+	return snet_wire_read_string(&reader, arena, NULL, &str, &game->join_token) == SNET_WIRE_OK
+		&& snet_wire_read_string(&reader, arena, NULL, &str, &game->creator) == SNET_WIRE_OK
+		&& snet_wire_read_string(&reader, arena, NULL, &str, &game->data) == SNET_WIRE_OK
+		&& game->join_token.size > 0;
+}
+
+static bool
+snet_json_key_is(const char* key, size_t key_len, const char* name) {
+	return key_len == strlen(name) && memcmp(key, name, key_len) == 0;
+}
+
+// Decodes {"join_token": "", "creator": "", "data": ""} in place.
+// The strings in game point into json which must outlive them.
+static bool
+snet_decode_game_info(char* json, size_t size, snet_game_info_t* game) {
+	*game = (snet_game_info_t){ 0 };
+
+	snet_json_reader_t reader;
+	snet_json_reader_init_in_place(&reader, json, size);
+
+	snet_blob_t* field = NULL;
+	bool done = false;
+	bool ok = true;
+	while (ok && !done) {
+		snet_json_token_t token = snet_json_reader_next(&reader);
+		int depth = snet_json_reader_depth(&reader);
+		size_t len;
+		const char* value;
+
+		switch (token) {
+			case SNET_JSON_NEED_MORE:
+			case SNET_JSON_ERROR:
+				ok = false;
+				break;
+			case SNET_JSON_KEY:
+				value = snet_json_reader_value(&reader, &len);
+				field = NULL;
+				if (depth != 1) { break; }
+
+				if (snet_json_key_is(value, len, "join_token")) {
+					field = &game->join_token;
+				} else if (snet_json_key_is(value, len, "creator")) {
+					field = &game->creator;
+				} else if (snet_json_key_is(value, len, "data")) {
+					field = &game->data;
+				}
+				break;
+			case SNET_JSON_STRING:
+				if (field != NULL && depth == 1) {
+					value = snet_json_reader_value(&reader, &len);
+					*field = (snet_blob_t){ .ptr = value, .size = len };
+				}
+				field = NULL;
+				break;
+			case SNET_JSON_OBJECT_END:
+				done = depth == 0;
+				break;
+			default:
+				field = NULL;
+				break;
+		}
+	}
+
+	snet_json_reader_cleanup(&reader);
+	return ok && game->join_token.size > 0;
 }
 
 static void
 snet_task_create_game(const snet_task_env_t* env) {
 	SNET_TASK_ARG(snet_game_options_t, options);
 
-	CF_JDoc doc = cf_make_json(NULL, 0);
-	CF_JVal req = cf_json_object(doc);
-	cf_json_set_root(doc, req);
-	cf_json_object_add_string(doc, req, "visibility", options.visibility == SNET_GAME_PUBLIC ? "public" : "private");
-	cf_json_object_add_int(doc, req, "max_num_players", options.max_num_players);
-	if (options.data.ptr) {
-		cf_json_object_add_string_range(doc, req, "data", options.data.ptr, (char*)options.data.ptr + options.data.size);
+	snet_t* snet = env->snet;
+	bool use_wire_format = snet_use_wire_format(snet);
+
+	dyna char* json_body = NULL;
+	const void* req_body;
+	size_t req_size;
+	if (use_wire_format) {
+		uint64_t visibility = options.visibility == SNET_GAME_PUBLIC
+			? SNET_WIRE_VISIBILITY_PUBLIC
+			: SNET_WIRE_VISIBILITY_PRIVATE;
+		uint64_t max_num_players = options.max_num_players > 0 ? (uint64_t)options.max_num_players : 0;
+		size_t capacity = SNET_WIRE_MAX_VARINT_SIZE * 3 + options.data.size;
+		char* wire_body = snet_task_alloc(env, capacity);
+
+		char* itr = wire_body;
+		itr = snet_wire_write_varint(itr, visibility);
+		itr = snet_wire_write_varint(itr, max_num_players);
+		itr = snet_wire_write_string(itr, options.data.ptr, options.data.size);
+		req_body = wire_body;
+		req_size = (size_t)(itr - wire_body);
+	} else {
+		CF_JDoc doc = cf_make_json(NULL, 0);
+		CF_JVal req = cf_json_object(doc);
+		cf_json_set_root(doc, req);
+		cf_json_object_add_string(doc, req, "visibility", options.visibility == SNET_GAME_PUBLIC ? "public" : "private");
+		cf_json_object_add_int(doc, req, "max_num_players", options.max_num_players);
+		if (options.data.ptr) {
+			cf_json_object_add_string_range(doc, req, "data", options.data.ptr, (char*)options.data.ptr + options.data.size);
+		}
+		json_body = cf_json_to_string_minimal(doc);
+		cf_destroy_json(doc);
+
+		req_body = json_body;
+		req_size = slen(json_body);
 	}
-	dyna char* req_body = cf_json_to_string_minimal(doc);
-	cf_destroy_json(doc);
 
-	snet_t* snet = env->snet;
 	snet->lobby_state = SNET_CREATING_GAME;
 	snet_log(snet, "Creating game");
 
@@ -488,13 +1739,20 @@ snet_task_create_game(const snet_task_env_t* env) {
 		.port = snet->config.port,
 		.path = snet_printf(env, "%s%s", snet->config.path, "/game/create"),
 		.verify_tls = !snet->config.insecure_tls,
+		.plain_http = snet->config.plain_http,
+		.pool = snet->shared->fetch_pool,
 
 		.headers = (snet_fetch_header_t[]){
 			snet_auth_header(env, snet),
+			{
+				.name = "Content-Type",
+				.value = use_wire_format ? SNET_WIRE_CONTENT_TYPE : "application/json",
+			},
+			snet_accept_header(snet),
 			{ 0 }
 		},
 
-		.content = req_body, .content_length = slen(req_body),
+		.content = req_body, .content_length = req_size,
 	});
 
 	snet_fetch_status_t fetch_status;
@@ -514,91 +1772,696 @@ snet_task_create_game(const snet_task_env_t* env) {
 		size_t body_size;
 		const void* resp_body = snet_fetch_response_body(fetch, &body_size);
 		if (status_code == 200) {
-			CF_JDoc resp = cf_make_json(resp_body, body_size);
-			CF_JVal root = cf_json_get_root(resp);
+			snet_game_info_t info;
+			bool decode_ok;
+			if (snet_is_wire_response(fetch)) {
+				decode_ok = snet_decode_game_info_wire(&env->self->arena, resp_body, body_size, &info);
+			} else {
+				// The info points into this copy
+				char* body_copy = (char*)snet_strncpy(env, resp_body, body_size).ptr;
+				decode_ok = snet_decode_game_info(body_copy, body_size, &info);
+			}
+
+			snet->lobby_state = SNET_IN_LOBBY;
+			snet_task_post(env, &(snet_event_t){
+				.type = SNET_EVENT_CREATE_GAME_FINISHED,
+				.create_game = decode_ok
+					? (snet_create_game_result_t){ .status = SNET_OK, .info = info }
+					: (snet_create_game_result_t){ .status = SNET_ERR_IO },
+			});
+
+			if (decode_ok && options.join) {
+				// Skip the round trip through the application.
+				// The join request goes out on the connection this one has
+				// just released.
+				snet_fetch_end(fetch);
+				fetch = NULL;
+				snet_join_game(snet, info.join_token);
+			} else {
+				snet_preconnect(snet);
+			}
+		} else {
+			void* body_copy = snet_task_alloc(env, body_size);
+			memcpy(body_copy, resp_body, body_size);
 
 			snet->lobby_state = SNET_IN_LOBBY;
 			snet_task_post(env, &(snet_event_t){
 				.type = SNET_EVENT_CREATE_GAME_FINISHED,
 				.create_game = {
-					.status = SNET_OK,
-					.info = {
-						.join_token = snet_strcpy(env, cf_json_get_string(cf_json_get(root, "join_token"))),
-						.creator = snet_strcpy(env, cf_json_get_string(cf_json_get(root, "creator"))),
-						.data = snet_strcpy(env, cf_json_get_string(cf_json_get(root, "data"))),
-					}
+					.status = SNET_ERR_REJECTED,
+					.error = { .ptr = body_copy, .size = body_size },
 				},
 			});
+		}
+	} else {
+		snet->lobby_state = SNET_IN_LOBBY;
+		snet_task_post(env, &(snet_event_t){
+			.type = SNET_EVENT_CREATE_GAME_FINISHED,
+			.create_game = { .status = SNET_ERR_IO },
+		});
+	}
+
+	snet_fetch_end(fetch);
+	if (json_body != NULL) { sfree(json_body); }
+}
+
+void
+snet_create_game(snet_t* snet, const snet_game_options_t* options) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_CREATE_GAME,
+			.game_options = *options,
+		});
+		return;
+	}
+
+	snet_task_begin(snet, &snet->create_game_task, snet_task_create_game, options, sizeof(*options));
+}
+
+typedef struct {
+	snet_op_status_t status;
+	// 0 when there was no response
+	int status_code;
+	snet_blob_t error;
+	// Null-terminated
+	snet_blob_t transport_config;
+} snet_join_response_t;
+
+// Asks the lobby how to connect to the game.
+// The response is allocated from the task arena.
+static snet_join_response_t
+snet_request_join(const snet_task_env_t* env, snet_blob_t join_token) {
+	snet_t* snet = env->snet;
+
+#ifndef __EMSCRIPTEN__
+	const char* transport = "cute_net";
+#else
+	const char* transport = "webtransport";
+#endif
+
+	snet_fetch_t* fetch = snet_fetch_begin(&(snet_fetch_options_t){
+		.method = SNET_FETCH_POST,
+		.host = snet->config.host,
+		.port = snet->config.port,
+		.path = snet_printf(env, "%s%s?transport=%s", snet->config.path, "/game/join", transport),
+		.verify_tls = !snet->config.insecure_tls,
+		.plain_http = snet->config.plain_http,
+		.pool = snet->shared->fetch_pool,
+
+		.headers = (snet_fetch_header_t[]){
+			snet_auth_header(env, snet),
+			{ 0 }
+		},
+
+		.content = join_token.ptr, .content_length = join_token.size,
+	});
+
+	snet_fetch_status_t fetch_status = SNET_FETCH_ERROR;
+	while (true) {
+		if (snet_task_cancelled(env)) { break; }
+
+		if ((fetch_status = snet_fetch_process(fetch)) != SNET_FETCH_PENDING) {
+			break;
+		}
+		snet_task_yield(env);
+	}
+
+	snet_join_response_t response = { .status = SNET_ERR_IO };
+	snet_log(snet, "fetch status: %d", fetch_status);
+	if (fetch_status == SNET_FETCH_FINISHED) {
+		int status_code = snet_fetch_status_code(fetch);
+		snet_log(snet, "status code: %d", status_code);
+		size_t body_size;
+		const void* resp_body = snet_fetch_response_body(fetch, &body_size);
+
+		response.status_code = status_code;
+		if (status_code == 200) {
+			response.status = SNET_OK;
+			response.transport_config = snet_strncpy(env, resp_body, body_size);
+		} else {
+			void* body_copy = snet_task_alloc(env, body_size);
+			memcpy(body_copy, resp_body, body_size);
+
+			response.status = SNET_ERR_REJECTED;
+			response.error = (snet_blob_t){ .ptr = body_copy, .size = body_size };
+		}
+	}
+
+	snet_fetch_end(fetch);
+	return response;
+}
+
+// Returns NULL if the transport fails, the deadline passes or the task is
+// cancelled
+static snet_transport_t*
+snet_connect_transport(const snet_task_env_t* env, const char* config, double deadline) {
+	snet_transport_t* transport = snet_transport_init(config);
+	while (true) {
+		if (snet_task_cancelled(env) || snet_seconds() >= deadline) { break; }
+
+		snet_transport_update(transport);
+
+		snet_transport_state_t state = snet_transport_state(transport);
+		if (state == SNET_TRANSPORT_CONNECTED) {
+			return transport;
+		} else if (state == SNET_TRANSPORT_DISCONNECTED) {
+			break;
+		}
+
+		snet_task_yield(env);
+	}
+
+	snet_transport_cleanup(transport);
+	return NULL;
+}
+
+// Keeps what is needed to reconnect to the current game
+static void
+snet_remember_game(snet_t* snet, snet_blob_t join_token, snet_blob_t transport_config) {
+	if (snet->game_join_token != join_token.ptr) {
+		cf_free(snet->game_join_token);
+		snet->game_join_token = cf_alloc(join_token.size);
+		memcpy(snet->game_join_token, join_token.ptr, join_token.size);
+		snet->game_join_token_size = join_token.size;
+	}
+
+	cf_free(snet->game_transport_config);
+	snet->game_transport_config = cf_alloc(transport_config.size + 1);
+	memcpy(snet->game_transport_config, transport_config.ptr, transport_config.size);
+	snet->game_transport_config[transport_config.size] = '\0';
+	snet->game_transport_config_size = transport_config.size;
+}
+
+static void
+snet_task_join_game(const snet_task_env_t* env) {
+	SNET_TASK_ARG(snet_blob_t, join_token);
+
+	snet_t* snet = env->snet;
+	snet->lobby_state = SNET_JOINING_GAME;
+	snet_log(snet, "Joining game");
+
+	// The blob is only valid until the first yield
+	join_token = snet_strncpy(env, join_token.ptr, join_token.size);
+
+	snet_join_response_t response = snet_request_join(env, join_token);
+	if (response.status != SNET_OK) {
+		snet->lobby_state = SNET_IN_LOBBY;
+		snet_task_post(env, &(snet_event_t){
+			.type = SNET_EVENT_JOIN_GAME_FINISHED,
+			.join_game = { .status = response.status, .error = response.error },
+		});
+		return;
+	}
+
+	snet_transport_t* transport = snet_connect_transport(env, response.transport_config.ptr, INFINITY);
+	if (transport != NULL) {
+		snet_forget_game(snet);
+		snet_remember_game(snet, join_token, response.transport_config);
+		snet->transport = transport;
+
+		snet->lobby_state = SNET_JOINED_GAME;
+		snet_task_post(env, &(snet_event_t){
+			.type = SNET_EVENT_JOIN_GAME_FINISHED,
+			.join_game = { .status = SNET_OK },
+		});
+	} else if (!snet_task_cancelled(env)) {
+		snet->lobby_state = SNET_IN_LOBBY;
+		snet_task_post(env, &(snet_event_t){
+			.type = SNET_EVENT_JOIN_GAME_FINISHED,
+			.join_game = { .status = SNET_ERR_IO },
+		});
+	}
+}
+
+static void
+snet_task_reconnect(const snet_task_env_t* env) {
+	SNET_TASK_ARG(bool, network_changed);
+	snet_t* snet = env->snet;
+	snet_log(snet, network_changed ? "Network changed, reconnecting" : "Reconnecting");
+
+	double deadline = snet_seconds() + snet->config.reconnect_timeout;
+	double delay = SNET_RECONNECT_MIN_DELAY;
+	snet_blob_t join_token = {
+		.ptr = snet->game_join_token,
+		.size = snet->game_join_token_size,
+	};
+
+	// When only the connection blipped, the old configuration is tried first
+	// but not for long since it may have expired.
+	// After a network change it is bound to the old address so a new one is
+	// requested right away.
+	snet_blob_t config = { 0 };
+	if (!network_changed) {
+		config = (snet_blob_t){
+			.ptr = snet->game_transport_config,
+			.size = snet->game_transport_config_size,
+		};
+	}
+	bool fresh_config = false;
+	double attempt_deadline = snet_seconds() + SNET_RECONNECT_STALE_ATTEMPT_TIMEOUT;
+
+	snet_transport_t* transport = NULL;
+	while (true) {
+		if (config.ptr != NULL) {
+			transport = snet_connect_transport(env, config.ptr, attempt_deadline < deadline ? attempt_deadline : deadline);
+			if (transport != NULL) { break; }
+
+			config = (snet_blob_t){ 0 };
+		} else {
+			snet_join_response_t response = snet_request_join(env, join_token);
+			// The game is gone or full or the session is no longer valid.
+			// Anything else, such as a busy server, is retried.
+			bool definitive = response.status_code >= 400
+				&& response.status_code < 500
+				&& response.status_code != 408
+				&& response.status_code != 429;
+			if (response.status == SNET_ERR_REJECTED && definitive) { break; }
+
+			config = response.transport_config;
+			fresh_config = true;
+			attempt_deadline = deadline;
+			if (config.ptr != NULL) { continue; }
+		}
+
+		double time_left = deadline - snet_seconds();
+		snet_task_sleep(env, delay < time_left ? delay : time_left);
+		delay = delay * 2.0 < SNET_RECONNECT_MAX_DELAY ? delay * 2.0 : SNET_RECONNECT_MAX_DELAY;
+		if (snet_task_cancelled(env) || snet_seconds() >= deadline) { break; }
+	}
+
+	if (transport != NULL) {
+		if (fresh_config) { snet_remember_game(snet, join_token, config); }
+		snet->transport = transport;
+		snet->lobby_state = SNET_JOINED_GAME;
+
+		// The queue drains over the next updates as fast as the transport
+		// takes it
+
+		snet_task_post(env, &(snet_event_t){ .type = SNET_EVENT_RECONNECTED });
+	} else {
+		snet_forget_game(snet);
+		snet->lobby_state = SNET_IN_LOBBY;
+		snet_task_post(env, &(snet_event_t){ .type = SNET_EVENT_DISCONNECTED });
+	}
+}
+
+void
+snet_join_game(snet_t* snet, snet_blob_t join_token) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_JOIN_GAME,
+			.blob = join_token,
+		});
+		return;
+	}
+
+	snet_task_begin(snet, &snet->join_game_task, snet_task_join_game, &join_token, sizeof(join_token));
+}
+
+void
+snet_send(snet_t* snet, snet_blob_t message, bool reliable) {
+	snet_send_prioritized(snet, message, reliable, SNET_PRIORITY_NORMAL);
+}
+
+void
+snet_send_prioritized(snet_t* snet, snet_blob_t message, bool reliable, snet_priority_t priority) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_SEND,
+			.blob = message,
+			.reliable = reliable,
+			.priority = priority,
+		});
+		return;
+	}
+
+	if (snet->transport) {
+		// Nothing may overtake what is still queued from a reconnect
+		if (snet->config.send_budget > 0 || !snet_send_queue_empty(&snet->send_queue)) {
+			snet_send_queue_push(&snet->send_queue, message, reliable, priority);
+		} else {
+			snet_send_now(snet, message, reliable);
+		}
+	} else if (
+		reliable
+		&& snet->lobby_state == SNET_RECONNECTING
+		&& snet->send_queue.size + message.size <= SNET_MAX_RECONNECT_QUEUE_SIZE
+	) {
+		snet_send_queue_push(&snet->send_queue, message, reliable, priority);
+	}
+}
+
+void
+snet_send_redundant(snet_t* snet, snet_blob_t message) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_SEND_REDUNDANT,
+			.blob = message,
+		});
+		return;
+	}
+
+	// Like other unreliable messages, nothing is kept while disconnected
+	if (snet->transport == NULL) { return; }
+	if (
+		message.size > UINT16_MAX
+		|| SNET_REDUNDANT_HEADER_SIZE + SNET_REDUNDANT_SIZE_BYTES + message.size > snet_transport_max_message_size()
+	) {
+		return;
+	}
+
+	void* copy = cf_alloc(message.size);
+	if (message.size > 0) { memcpy(copy, message.ptr, message.size); }
+	apush(snet->redundant_history, ((snet_blob_t){ .ptr = copy, .size = message.size }));
+	snet->num_unsent_redundant += 1;
+	snet->next_redundant_sequence += 1;
+
+	if (snet->config.send_budget == 0) {
+		snet_flush_redundant(snet);
+	}
+}
+
+void
+snet_exit_game(snet_t* snet) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_EXIT_GAME,
+		});
+		return;
+	}
+
+	if (snet->lobby_state == SNET_RECONNECTING) {
+		snet_task_end(&snet->join_game_task);
+		snet->lobby_state = SNET_IN_LOBBY;
+	}
+	snet_forget_game(snet);
+	snet_abort_streams(snet);
+
+	if (snet->transport) {
+		snet_transport_cleanup(snet->transport);
+		snet->transport = NULL;
+	}
+}
+
+// Game list decoder {{{
+
+// Decodes {"games": [{"join_token": "", "creator": "", "data": ""}, ...], "next_cursor": ""}
+// or its binary equivalent as the body arrives.
+// Strings go straight into the given arena.
+typedef struct {
+	barena_t* arena;
+	snet_json_reader_t reader;
+	bool games_key;
+	bool in_games;
+	bool done;
+
+	snet_blob_t* field;
+	int field_depth;
+	bool field_interned;
+	snet_game_info_t current;
+	snet_blob_t next_cursor;
+
+	snet_game_info_t* games;
+	int num_games;
+	int capacity;
+
+	// Creators and data repeat a lot across games
+	snet_intern_table_t interned;
+
+	// Binary encoding, decided by the Content-Type before the first chunk
+	bool wire_format;
+	snet_wire_reader_t wire;
+	snet_wire_string_t wire_string;
+	bool has_num_games;
+	uint64_t num_games_left;
+	int wire_field;
+} snet_game_list_decoder_t;
+
+static void
+snet_game_list_decoder_init(snet_game_list_decoder_t* decoder, barena_t* arena) {
+	*decoder = (snet_game_list_decoder_t){ .arena = arena };
+	snet_json_reader_init(&decoder->reader);
+	snet_wire_reader_init(&decoder->wire);
+}
+
+static void
+snet_game_list_decoder_cleanup(snet_game_list_decoder_t* decoder) {
+	snet_json_reader_cleanup(&decoder->reader);
+	snet_intern_table_cleanup(&decoder->interned);
+	cf_free(decoder->games);
+}
+
+static void
+snet_game_list_decoder_push(snet_game_list_decoder_t* decoder) {
+	if (decoder->num_games >= decoder->capacity) {
+		decoder->capacity = decoder->capacity > 0 ? decoder->capacity * 2 : 64;
+		decoder->games = cf_realloc(decoder->games, sizeof(snet_game_info_t) * decoder->capacity);
+	}
+
+	decoder->games[decoder->num_games++] = decoder->current;
+}
+
+static bool
+snet_game_list_decoder_feed_json(snet_game_list_decoder_t* decoder, const void* chunk, size_t size) {
+	snet_json_reader_t* reader = &decoder->reader;
+	snet_json_reader_feed(reader, chunk, size);
+
+	while (true) {
+		snet_json_token_t token = snet_json_reader_next(reader);
+		int depth = snet_json_reader_depth(reader);
+		size_t len;
+		const char* value;
+
+		switch (token) {
+			case SNET_JSON_NEED_MORE:
+				return true;
+			case SNET_JSON_ERROR:
+				return false;
+			case SNET_JSON_KEY:
+				value = snet_json_reader_value(reader, &len);
+				decoder->field = NULL;
+				decoder->field_depth = depth;
+				if (depth == 1) {
+					decoder->games_key = snet_json_key_is(value, len, "games");
+					if (snet_json_key_is(value, len, "next_cursor")) {
+						decoder->field = &decoder->next_cursor;
+					}
+				} else if (depth == 3 && decoder->in_games) {
+					if (snet_json_key_is(value, len, "join_token")) {
+						decoder->field = &decoder->current.join_token;
+					} else if (snet_json_key_is(value, len, "creator")) {
+						decoder->field = &decoder->current.creator;
+					} else if (snet_json_key_is(value, len, "data")) {
+						decoder->field = &decoder->current.data;
+					}
+				}
+				decoder->field_interned = decoder->field == &decoder->current.creator
+					|| decoder->field == &decoder->current.data;
+				break;
+			case SNET_JSON_STRING:
+				if (decoder->field != NULL && depth == decoder->field_depth) {
+					value = snet_json_reader_value(reader, &len);
+					*decoder->field = decoder->field_interned
+						? snet_intern(&decoder->interned, decoder->arena, value, len)
+						: snet_arena_strncpy(decoder->arena, value, len);
+				}
+				decoder->field = NULL;
+				break;
+			case SNET_JSON_ARRAY_BEGIN:
+				if (depth == 2 && decoder->games_key) {
+					decoder->in_games = true;
+				}
+				break;
+			case SNET_JSON_ARRAY_END:
+				if (depth == 1) {
+					decoder->in_games = false;
+					decoder->games_key = false;
+				}
+				break;
+			case SNET_JSON_OBJECT_BEGIN:
+				if (depth == 3 && decoder->in_games) {
+					decoder->current = (snet_game_info_t){ 0 };
+					decoder->field = NULL;
+				}
+				break;
+			case SNET_JSON_OBJECT_END:
+				if (depth == 2 && decoder->in_games) {
+					snet_game_list_decoder_push(decoder);
+				} else if (depth == 0) {
+					decoder->done = true;
+				}
+				break;
+			default:
+				decoder->field = NULL;
+				break;
+		}
+	}
+}
 
-			cf_destroy_json(resp);
+static bool
+snet_game_list_decoder_feed_wire(snet_game_list_decoder_t* decoder, const void* chunk, size_t size) {
+	snet_wire_reader_t* reader = &decoder->wire;
+	snet_wire_reader_feed(reader, chunk, size);
+
+	while (!decoder->done) {
+		snet_wire_status_t status;
+		if (!decoder->has_num_games) {
+			status = snet_wire_read_varint(reader, &decoder->num_games_left);
+			decoder->has_num_games = status == SNET_WIRE_OK;
+		} else if (decoder->num_games_left > 0) {
+			snet_blob_t* fields[] = {
+				&decoder->current.join_token,
+				&decoder->current.creator,
+				&decoder->current.data,
+			};
+			status = snet_wire_read_string(
+				reader, decoder->arena,
+				decoder->wire_field > 0 ? &decoder->interned : NULL,
+				&decoder->wire_string, fields[decoder->wire_field]
+			);
+			if (status == SNET_WIRE_OK && ++decoder->wire_field == 3) {
+				snet_game_list_decoder_push(decoder);
+				decoder->current = (snet_game_info_t){ 0 };
+				decoder->wire_field = 0;
+				decoder->num_games_left -= 1;
+			}
 		} else {
-			void* body_copy = snet_task_alloc(env, body_size);
-			memcpy(body_copy, resp_body, body_size);
+			status = snet_wire_read_string(reader, decoder->arena, NULL, &decoder->wire_string, &decoder->next_cursor);
+			decoder->done = status == SNET_WIRE_OK;
+		}
 
-			snet->lobby_state = SNET_IN_LOBBY;
-			snet_task_post(env, &(snet_event_t){
-				.type = SNET_EVENT_CREATE_GAME_FINISHED,
-				.create_game = {
-					.status = SNET_ERR_REJECTED,
-					.error = { .ptr = body_copy, .size = body_size },
-				},
-			});
+		if (status == SNET_WIRE_NEED_MORE) {
+			return true;
+		} else if (status == SNET_WIRE_ERROR) {
+			return false;
 		}
-	} else {
-		snet->lobby_state = SNET_IN_LOBBY;
-		snet_task_post(env, &(snet_event_t){
-			.type = SNET_EVENT_CREATE_GAME_FINISHED,
-			.create_game = { .status = SNET_ERR_IO },
-		});
 	}
 
-	snet_fetch_end(fetch);
-	sfree(req_body);
+	// Nothing is expected after the cursor
+	return reader->cur == reader->end;
 }
 
-void
-snet_create_game(snet_t* snet, const snet_game_options_t* options) {
-	snet_task_begin(snet, &snet->create_game_task, snet_task_create_game, options, sizeof(*options));
+static bool
+snet_game_list_decoder_feed(snet_game_list_decoder_t* decoder, const void* chunk, size_t size) {
+	return decoder->wire_format
+		? snet_game_list_decoder_feed_wire(decoder, chunk, size)
+		: snet_game_list_decoder_feed_json(decoder, chunk, size);
 }
 
-static void
-snet_task_join_game(const snet_task_env_t* env) {
-	SNET_TASK_ARG(snet_blob_t, join_token);
+static snet_game_info_t*
+snet_game_list_decoder_finish(snet_game_list_decoder_t* decoder) {
+	if (decoder->num_games == 0) { return NULL; }
+
+	size_t size = sizeof(snet_game_info_t) * decoder->num_games;
+	snet_game_info_t* games = barena_malloc(decoder->arena, size);
+	memcpy(games, decoder->games, size);
+	return games;
+}
+
+// }}}
+
+static const char*
+snet_list_games_query(const snet_task_env_t* env, const snet_list_games_options_t* options) {
+	const char* query = "";
+	#define SNET_QUERY_APPEND(FMT, ...) \
+		query = snet_printf(env, "%s%c" FMT, query, query[0] == '\0' ? '?' : '&', __VA_ARGS__)
+
+	if (options->page_size > 0) {
+		SNET_QUERY_APPEND("page_size=%d", options->page_size);
+	}
+	if (options->cursor.size > 0) {
+		SNET_QUERY_APPEND("cursor=%s", snet_url_encode(env, options->cursor));
+	}
+	if (options->visibility == SNET_LIST_PUBLIC_ONLY) {
+		SNET_QUERY_APPEND("visibility=%s", "public");
+	} else if (options->visibility == SNET_LIST_PRIVATE_ONLY) {
+		SNET_QUERY_APPEND("visibility=%s", "private");
+	}
+	if (options->has_free_slots) {
+		SNET_QUERY_APPEND("has_free_slots=%d", 1);
+	}
+	if (options->creator.size > 0) {
+		SNET_QUERY_APPEND("creator=%s", snet_url_encode(env, options->creator));
+	}
+	if (options->data_prefix.size > 0) {
+		SNET_QUERY_APPEND("data_prefix=%s", snet_url_encode(env, options->data_prefix));
+	}
+
+	#undef SNET_QUERY_APPEND
+	return query;
+}
+
+typedef struct {
+	snet_list_games_result_t result;
+	bool not_modified;
+	const char* etag;
+} snet_game_list_response_t;
 
+// Fetches and decodes one page of /game/list into the given arena.
+// etag can be NULL for an unconditional request.
+static void
+snet_fetch_game_list(
+	const snet_task_env_t* env,
+	const char* query,
+	const char* etag,
+	barena_t* arena,
+	snet_game_list_response_t* response
+) {
 	snet_t* snet = env->snet;
-	snet->lobby_state = SNET_JOINING_GAME;
-	snet_log(snet, "Joining game");
+	*response = (snet_game_list_response_t){
+		.result = { .status = SNET_ERR_IO },
+	};
 
-#ifndef __EMSCRIPTEN__
-	const char* transport = "cute_net";
-#else
-	const char* transport = "webtransport";
-#endif
+	snet_fetch_header_t headers[4] = {
+		snet_auth_header(env, snet),
+	};
+	int num_headers = 1;
+	if (etag != NULL) {
+		headers[num_headers++] = (snet_fetch_header_t){
+			.name = "If-None-Match",
+			.value = etag,
+		};
+	}
+	headers[num_headers++] = snet_accept_header(snet);
 
 	snet_fetch_t* fetch = snet_fetch_begin(&(snet_fetch_options_t){
-		.method = SNET_FETCH_POST,
+		.method = SNET_FETCH_GET,
 		.host = snet->config.host,
 		.port = snet->config.port,
-		.path = snet_printf(env, "%s%s?transport=%s", snet->config.path, "/game/join", transport),
+		.path = snet_printf(env, "%s%s%s", snet->config.path, "/game/list", query),
 		.verify_tls = !snet->config.insecure_tls,
+		.plain_http = snet->config.plain_http,
+		.pool = snet->shared->fetch_pool,
+		.stream_body = true,
 
-		.headers = (snet_fetch_header_t[]){
-			snet_auth_header(env, snet),
-			{ 0 }
-		},
-
-		.content = join_token.ptr, .content_length = join_token.size,
+		.headers = headers,
 	});
 
-	const void* transport_config = NULL;
+	snet_game_list_decoder_t decoder;
+	snet_game_list_decoder_init(&decoder, arena);
+	bool decode_ok = true;
+	bool decode_started = false;
 
-	snet_fetch_status_t fetch_status;
+	snet_fetch_status_t fetch_status = SNET_FETCH_ERROR;
 	while (true) {
 		if (snet_task_cancelled(env)) { break; }
 
-		if ((fetch_status = snet_fetch_process(fetch)) != SNET_FETCH_PENDING) {
-			break;
+		fetch_status = snet_fetch_process(fetch);
+
+		// Decode whatever has arrived so far
+		if (snet_fetch_status_code(fetch) == 200) {
+			size_t chunk_size;
+			const void* chunk = snet_fetch_read_body(fetch, &chunk_size);
+			if (chunk_size > 0 && decode_ok) {
+				if (!decode_started) {
+					decoder.wire_format = snet_is_wire_response(fetch);
+					decode_started = true;
+				}
+				decode_ok = snet_game_list_decoder_feed(&decoder, chunk, chunk_size);
+			}
 		}
+
+		if (fetch_status != SNET_FETCH_PENDING) { break; }
 		snet_task_yield(env);
 	}
 
@@ -606,181 +2469,443 @@ snet_task_join_game(const snet_task_env_t* env) {
 	if (fetch_status == SNET_FETCH_FINISHED) {
 		int status_code = snet_fetch_status_code(fetch);
 		snet_log(snet, "status code: %d", status_code);
-		size_t body_size;
-		const void* resp_body = snet_fetch_response_body(fetch, &body_size);
 
-		if (status_code == 200) {
-			char* body_copy = snet_task_alloc(env, body_size + 1);
-			memcpy(body_copy, resp_body, body_size);
-			body_copy[body_size] = '\0';
-			transport_config = body_copy;
-		} else {
-			void* body_copy = snet_task_alloc(env, body_size);
-			memcpy(body_copy, resp_body, body_size);
+		if (status_code == 304 && etag != NULL) {
+			response->result.status = SNET_OK;
+			response->not_modified = true;
+		} else if (status_code == 200 && decode_ok && decoder.done) {
+			response->result = (snet_list_games_result_t){
+				.status = SNET_OK,
+				.num_games = decoder.num_games,
+				.games = snet_game_list_decoder_finish(&decoder),
+				.next_cursor = decoder.next_cursor,
+			};
 
-			snet->lobby_state = SNET_IN_LOBBY;
-			snet_task_post(env, &(snet_event_t){
-				.type = SNET_EVENT_JOIN_GAME_FINISHED,
-				.join_game = {
-					.status = SNET_ERR_REJECTED,
-					.error = { .ptr = body_copy, .size = body_size },
-				},
-			});
+			size_t etag_size;
+			const char* new_etag = snet_fetch_response_header(fetch, "ETag", &etag_size);
+			if (new_etag != NULL) {
+				response->etag = snet_arena_strncpy(arena, new_etag, etag_size).ptr;
+			}
+		} else if (status_code == 200) {
+			snet_log(snet, "Malformed game list");
+		} else {
+			response->result.status = SNET_ERR_REJECTED;
 		}
+	}
+
+	snet_game_list_decoder_cleanup(&decoder);
+	snet_fetch_end(fetch);
+}
+
+static void
+snet_task_list_games(const snet_task_env_t* env) {
+	SNET_TASK_ARG(snet_list_games_options_t, options);
+	snet_t* snet = env->snet;
+	snet_log(snet, "Listing game");
+
+	// The blobs in options are only valid until the first yield
+	const char* query = snet_list_games_query(env, &options);
+	const char* session = snet_strcpy(env, snet->cookie_buf).ptr;
+	bool use_cache = snet->list_cache_etag != NULL
+		&& strcmp(snet->list_cache_query, query) == 0
+		&& strcmp(snet->list_cache_session, session) == 0;
+
+	barena_t* arena = &snet->list_cache_arenas[1 - snet->list_cache_front];
+	barena_reset(arena);
+
+	snet_game_list_response_t response;
+	snet_fetch_game_list(env, query, use_cache ? snet->list_cache_etag : NULL, arena, &response);
+	// A join usually follows
+	if (response.result.status == SNET_OK) { snet_preconnect(snet); }
+
+	// The cache is tagged with the session the request went out with so a
+	// login in the meantime does not matter
+	if (response.not_modified) {
+		snet_task_post(env, &(snet_event_t){
+			.type = SNET_EVENT_LIST_GAMES_FINISHED,
+			.list_games = snet->list_cache,
+		});
+	} else if (response.result.status == SNET_OK) {
+		snet->list_cache = response.result;
+		snet->list_cache_query = snet_arena_strncpy(arena, query, strlen(query)).ptr;
+		snet->list_cache_session = snet_arena_strncpy(arena, session, strlen(session)).ptr;
+		snet->list_cache_etag = response.etag;
+		snet->list_cache_front = 1 - snet->list_cache_front;
+
+		snet_task_post(env, &(snet_event_t){
+			.type = SNET_EVENT_LIST_GAMES_FINISHED,
+			.list_games = snet->list_cache,
+		});
 	} else {
-		snet->lobby_state = SNET_IN_LOBBY;
 		snet_task_post(env, &(snet_event_t){
-			.type = SNET_EVENT_JOIN_GAME_FINISHED,
-			.join_game = { .status = SNET_ERR_IO },
+			.type = SNET_EVENT_LIST_GAMES_FINISHED,
+			.list_games = { .status = response.result.status },
 		});
 	}
+}
 
-	if (transport_config != NULL) {
-		snet_transport_t* transport = snet_transport_init(transport_config);
-		while (true) {
-			if (snet_task_cancelled(env)) {
-				snet_transport_cleanup(transport);
-				break;
-			}
+typedef struct {
+	snet_list_games_options_t options;
+	double poll_interval;
+} snet_watch_games_arg_t;
 
-			snet_transport_update(transport);
+static void
+snet_watch_push_event(snet_t* snet, snet_event_type_t type, const snet_game_info_t* game) {
+	if (snet->num_watch_events >= snet->watch_events_capacity) {
+		snet->watch_events_capacity = snet->watch_events_capacity > 0 ? snet->watch_events_capacity * 2 : 64;
+		snet->watch_events = cf_realloc(snet->watch_events, sizeof(snet_event_t) * snet->watch_events_capacity);
+	}
 
-			snet_transport_state_t state = snet_transport_state(transport);
-			if (state == SNET_TRANSPORT_CONNECTED) {
-				snet->transport = transport;
+	snet->watch_events[snet->num_watch_events++] = (snet_event_t){
+		.type = type,
+		.game = *game,
+	};
+}
 
-				snet->lobby_state = SNET_JOINED_GAME;
-				snet_task_post(env, &(snet_event_t){
-					.type = SNET_EVENT_JOIN_GAME_FINISHED,
-					.join_game = { .status = SNET_OK },
-				});
-				break;
-			} else if (state == SNET_TRANSPORT_DISCONNECTED) {
-				snet_transport_cleanup(transport);
+static void
+snet_watch_on_removed(const snet_game_info_t* game, void* ctx) {
+	snet_watch_push_event(ctx, SNET_EVENT_GAME_REMOVED, game);
+}
 
-				snet->lobby_state = SNET_IN_LOBBY;
-				snet_task_post(env, &(snet_event_t){
-					.type = SNET_EVENT_JOIN_GAME_FINISHED,
-					.join_game = { .status = SNET_ERR_IO },
-				});
+static void
+snet_watch_apply_snapshot(snet_t* snet, const snet_list_games_result_t* list) {
+	snet_game_table_t* table = &snet->watched_games;
+	snet_game_table_begin_sync(table);
+
+	for (int i = 0; i < list->num_games; ++i) {
+		const snet_game_info_t* entry;
+		switch (snet_game_table_put(table, &list->games[i], &entry)) {
+			case SNET_GAME_TABLE_ADDED:
+				snet_watch_push_event(snet, SNET_EVENT_GAME_ADDED, entry);
+				break;
+			case SNET_GAME_TABLE_UPDATED:
+				snet_watch_push_event(snet, SNET_EVENT_GAME_UPDATED, entry);
+				break;
+			case SNET_GAME_TABLE_UNCHANGED:
 				break;
-			}
-
-			snet_task_yield(env);
 		}
 	}
 
-	snet_fetch_end(fetch);
+	snet_game_table_sweep(table, snet_watch_on_removed, snet);
 }
 
-void
-snet_join_game(snet_t* snet, snet_blob_t join_token) {
-	snet_task_begin(snet, &snet->join_game_task, snet_task_join_game, &join_token, sizeof(join_token));
+// Fetches a full list and merges it into the watched table.
+// etag is updated in place and can be empty.
+static bool
+snet_watch_sync(const snet_task_env_t* env, const char* query, char* etag, size_t etag_capacity) {
+	// The list is only needed until it has been merged into the table
+	barena_snapshot_t snapshot = barena_snapshot(&env->self->arena);
+
+	snet_game_list_response_t response;
+	snet_fetch_game_list(env, query, etag[0] != '\0' ? etag : NULL, &env->self->arena, &response);
+	if (response.result.status == SNET_OK && !response.not_modified) {
+		snet_watch_apply_snapshot(env->snet, &response.result);
+
+		size_t etag_size = response.etag != NULL ? strlen(response.etag) : 0;
+		if (etag_size < etag_capacity) {
+			memcpy(etag, response.etag != NULL ? response.etag : "", etag_size);
+			etag[etag_size] = '\0';
+		} else {
+			etag[0] = '\0';
+		}
+	}
+
+	barena_restore(&env->self->arena, snapshot);
+	return response.result.status == SNET_OK;
 }
 
-void
-snet_send(snet_t* snet, snet_blob_t message, bool reliable) {
-	if (snet->transport) {
-		snet_transport_send(snet->transport, message.ptr, message.size, reliable);
+static void
+snet_watch_poll(const snet_task_env_t* env, const char* query, char* etag, double poll_interval) {
+	while (!snet_task_cancelled(env)) {
+		snet_watch_sync(env, query, etag, SNET_MAX_ETAG_SIZE);
+		snet_task_sleep(env, poll_interval);
 	}
 }
 
-void
-snet_exit_game(snet_t* snet) {
-	if (snet->transport) {
-		snet_transport_cleanup(snet->transport);
-		snet->transport = NULL;
-	}
+static void
+snet_task_watch_games(const snet_task_env_t* env) {
+	SNET_TASK_ARG(snet_watch_games_arg_t, arg);
+
+	arg.options.cursor = (snet_blob_t){ 0 };
+	const char* query = snet_list_games_query(env, &arg.options);
+
+	char etag[SNET_MAX_ETAG_SIZE] = { 0 };
+	snet_watch_poll(env, query, etag, arg.poll_interval);
 }
 
 static void
-snet_task_list_games(const snet_task_env_t* env) {
+snet_apply_game_event(const snet_task_env_t* env, const snet_sse_event_t* event) {
 	snet_t* snet = env->snet;
-	snet_log(snet, "Listing game");
+	barena_snapshot_t snapshot = barena_snapshot(&env->self->arena);
+
+	snet_game_info_t game;
+	char* data = (char*)snet_strncpy(env, event->data, event->data_size).ptr;
+	if (!snet_decode_game_info(data, event->data_size, &game)) {
+		snet_log(snet, "Malformed %s event", event->type);
+	} else if (strcmp(event->type, "game_created") == 0 || strcmp(event->type, "game_updated") == 0) {
+		// Both are treated the same since an event can be replayed after a
+		// resync
+		const snet_game_info_t* entry;
+		switch (snet_game_table_put(&snet->watched_games, &game, &entry)) {
+			case SNET_GAME_TABLE_ADDED:
+				snet_watch_push_event(snet, SNET_EVENT_GAME_ADDED, entry);
+				break;
+			case SNET_GAME_TABLE_UPDATED:
+				snet_watch_push_event(snet, SNET_EVENT_GAME_UPDATED, entry);
+				break;
+			case SNET_GAME_TABLE_UNCHANGED:
+				break;
+		}
+	} else if (strcmp(event->type, "game_closed") == 0) {
+		snet_game_info_t removed;
+		if (snet_game_table_remove(&snet->watched_games, game.join_token, &removed)) {
+			snet_watch_push_event(snet, SNET_EVENT_GAME_REMOVED, &removed);
+		}
+	}
+
+	barena_restore(&env->self->arena, snapshot);
+}
+
+typedef enum {
+	SNET_SUBSCRIBE_FAILED,
+	SNET_SUBSCRIBE_UNSUPPORTED,
+	SNET_SUBSCRIBE_DISCONNECTED,
+} snet_subscribe_result_t;
+
+// Runs one connection to /game/events until it drops
+static snet_subscribe_result_t
+snet_subscribe_game_events(
+	const snet_task_env_t* env,
+	const char* query,
+	char* etag,
+	char* last_event_id
+) {
+	snet_t* snet = env->snet;
+	snet_fetch_header_t headers[] = {
+		snet_auth_header(env, snet),
+		{ .name = "Accept", .value = "text/event-stream" },
+		{ 0 },
+		{ 0 },
+	};
+	if (last_event_id[0] != '\0') {
+		headers[2] = (snet_fetch_header_t){
+			.name = "Last-Event-ID",
+			.value = snet_strcpy(env, last_event_id).ptr,
+		};
+	}
 
 	snet_fetch_t* fetch = snet_fetch_begin(&(snet_fetch_options_t){
 		.method = SNET_FETCH_GET,
 		.host = snet->config.host,
 		.port = snet->config.port,
-		.path = snet_printf(env, "%s%s", snet->config.path, "/game/list"),
+		.path = snet_printf(env, "%s%s%s", snet->config.path, "/game/events", query),
 		.verify_tls = !snet->config.insecure_tls,
+		.plain_http = snet->config.plain_http,
+		.pool = snet->shared->fetch_pool,
+		.stream_body = true,
 
-		.headers = (snet_fetch_header_t[]){
-			snet_auth_header(env, snet),
-			{ 0 }
-		},
+		.headers = headers,
 	});
+	if (!snet_fetch_is_streaming(fetch)) {
+		snet_fetch_end(fetch);
+		return SNET_SUBSCRIBE_UNSUPPORTED;
+	}
 
-	snet_fetch_status_t fetch_status;
-	while (true) {
-		if (snet_task_cancelled(env)) { break; }
+	snet_subscribe_result_t result = SNET_SUBSCRIBE_FAILED;
+	snet_sse_parser_t parser;
+	snet_sse_parser_init(&parser);
 
-		if ((fetch_status = snet_fetch_process(fetch)) != SNET_FETCH_PENDING) {
+	bool subscribed = false;
+	double last_received = snet_seconds();
+	while (!snet_task_cancelled(env)) {
+		snet_fetch_status_t fetch_status = snet_fetch_process(fetch);
+		int status_code = snet_fetch_status_code(fetch);
+
+		if (status_code == 404 || status_code == 405 || status_code == 501) {
+			// Only the list is served
+			result = SNET_SUBSCRIBE_UNSUPPORTED;
+			break;
+		} else if (status_code != 0 && status_code != 200) {
+			snet_log(snet, "status code: %d", status_code);
 			break;
 		}
-		snet_task_yield(env);
-	}
 
-	snet_log(snet, "fetch status: %d", fetch_status);
-	if (fetch_status == SNET_FETCH_FINISHED) {
-		int status_code = snet_fetch_status_code(fetch);
-		snet_log(snet, "status code: %d", status_code);
-		size_t body_size;
-		const void* resp_body = snet_fetch_response_body(fetch, &body_size);
+		if (status_code == 200 && !subscribed) {
+			// Events start queuing up from here so nothing that happens during
+			// the sync is missed.
+			// Replaying older events on top of the snapshot is harmless since
+			// they are applied in order.
+			subscribed = true;
+			snet_watch_sync(env, query, etag, SNET_MAX_ETAG_SIZE);
+			continue;
+		}
 
-		if (status_code == 200) {
-			CF_JDoc doc = cf_make_json(resp_body, body_size);
-			CF_JVal resp = cf_json_get_root(doc);
-			CF_JVal games = cf_json_get(resp, "games");
-			int num_entries = cf_json_get_len(games);
-			snet_game_info_t* entries = snet_task_alloc(env, sizeof(snet_game_info_t) * num_entries);
-			for (int i = 0; i < num_entries; ++i) {
-				CF_JVal entry = cf_json_array_get(games, i);
-				entries[i] = (snet_game_info_t){
-					.creator = snet_strcpy(env, cf_json_get_string(cf_json_get(entry, "creator"))),
-					.join_token = snet_strcpy(env, cf_json_get_string(cf_json_get(entry, "join_token"))),
-					.data = snet_strcpy(env, cf_json_get_string(cf_json_get(entry, "data"))),
-				};
+		size_t chunk_size;
+		const void* chunk = snet_fetch_read_body(fetch, &chunk_size);
+		if (chunk_size > 0) {
+			last_received = snet_seconds();
+			result = SNET_SUBSCRIBE_DISCONNECTED;
+
+			snet_sse_parser_feed(&parser, chunk, chunk_size);
+			snet_sse_event_t event;
+			while (snet_sse_parser_next(&parser, &event)) {
+				snet_apply_game_event(env, &event);
 			}
-			cf_destroy_json(doc);
 
-			snet_task_post(env, &(snet_event_t){
-				.type = SNET_EVENT_LIST_GAMES_FINISHED,
-				.list_games = {
-					.status = SNET_OK,
-					.num_games = num_entries,
-					.games = entries,
-				},
-			});
-		} else {
-			void* body_copy = snet_task_alloc(env, body_size);
-			memcpy(body_copy, resp_body, body_size);
+			const char* id = snet_sse_parser_last_id(&parser);
+			size_t id_size = strlen(id);
+			if (id_size < SNET_MAX_EVENT_ID_SIZE) {
+				memcpy(last_event_id, id, id_size + 1);
+			}
+		}
 
-			snet_task_post(env, &(snet_event_t){
-				.type = SNET_EVENT_LIST_GAMES_FINISHED,
-				.list_games = {
-					.status = SNET_ERR_REJECTED,
-				},
-			});
+		if (fetch_status != SNET_FETCH_PENDING) { break; }
+
+		// The server sends comments periodically so silence means the
+		// connection is dead
+		if (snet_seconds() - last_received > SNET_EVENT_STREAM_TIMEOUT) {
+			snet_log(snet, "Event stream timed out");
+			break;
 		}
-	} else {
-		snet_task_post(env, &(snet_event_t){
-			.type = SNET_EVENT_LIST_GAMES_FINISHED,
-			.list_games = { .status = SNET_ERR_IO },
-		});
+
+		snet_task_yield(env);
 	}
 
+	snet_sse_parser_cleanup(&parser);
 	snet_fetch_end(fetch);
+	return result;
+}
+
+static void
+snet_task_subscribe_games(const snet_task_env_t* env) {
+	SNET_TASK_ARG(snet_watch_games_arg_t, arg);
+
+	arg.options.cursor = (snet_blob_t){ 0 };
+	const char* query = snet_list_games_query(env, &arg.options);
+
+	char etag[SNET_MAX_ETAG_SIZE] = { 0 };
+	char last_event_id[SNET_MAX_EVENT_ID_SIZE] = { 0 };
+	double backoff = SNET_RESUBSCRIBE_MIN_DELAY;
+	while (!snet_task_cancelled(env)) {
+		barena_snapshot_t snapshot = barena_snapshot(&env->self->arena);
+		snet_subscribe_result_t result = snet_subscribe_game_events(env, query, etag, last_event_id);
+		barena_restore(&env->self->arena, snapshot);
+
+		switch (result) {
+			case SNET_SUBSCRIBE_UNSUPPORTED:
+				// Neither the server nor the platform are going to change so
+				// keep the table fresh the old way from now on
+				snet_watch_poll(env, query, etag, arg.poll_interval);
+				break;
+			case SNET_SUBSCRIBE_DISCONNECTED:
+				// The stream was working, reconnect right away and let the
+				// server replay from last_event_id
+				backoff = SNET_RESUBSCRIBE_MIN_DELAY;
+				snet_task_sleep(env, backoff);
+				break;
+			case SNET_SUBSCRIBE_FAILED:
+				// Whatever the server remembers about us may be gone
+				last_event_id[0] = '\0';
+				snet_task_sleep(env, backoff);
+				backoff = backoff * 2.0 < SNET_RESUBSCRIBE_MAX_DELAY ? backoff * 2.0 : SNET_RESUBSCRIBE_MAX_DELAY;
+				break;
+		}
+	}
+}
+
+void
+snet_watch_games(snet_t* snet, const snet_list_games_options_t* options, double poll_interval) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_WATCH_GAMES,
+			.list_options = options != NULL ? *options : (snet_list_games_options_t){ 0 },
+			.poll_interval = poll_interval,
+		});
+		return;
+	}
+
+	snet_unwatch_games(snet);
+
+	snet_watch_games_arg_t arg = {
+		.options = options != NULL ? *options : (snet_list_games_options_t){ 0 },
+		.poll_interval = poll_interval,
+	};
+	snet_task_begin(snet, &snet->watch_games_task, snet_task_watch_games, &arg, sizeof(arg));
+}
+
+void
+snet_subscribe_games(snet_t* snet, const snet_list_games_options_t* options, double poll_interval) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_SUBSCRIBE_GAMES,
+			.list_options = options != NULL ? *options : (snet_list_games_options_t){ 0 },
+			.poll_interval = poll_interval,
+		});
+		return;
+	}
+
+	snet_unwatch_games(snet);
+
+	snet_watch_games_arg_t arg = {
+		.options = options != NULL ? *options : (snet_list_games_options_t){ 0 },
+		.poll_interval = poll_interval,
+	};
+	snet_task_begin(snet, &snet->watch_games_task, snet_task_subscribe_games, &arg, sizeof(arg));
+}
+
+void
+snet_unwatch_games(snet_t* snet) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_UNWATCH_GAMES,
+		});
+		return;
+	}
+
+	snet_task_end(&snet->watch_games_task);
+
+	snet->num_watch_events = 0;
+	snet->next_watch_event = 0;
+	snet_game_table_cleanup(&snet->watched_games);
+	snet_game_table_init(&snet->watched_games);
+}
+
+const snet_game_info_t*
+snet_watched_games(snet_t* snet, int* num_games) {
+	if (snet->io != NULL) { return snet_io_watched_games(snet->io, num_games); }
+
+	*num_games = snet->watched_games.num_games;
+	return snet->watched_games.games;
+}
+
+const snet_game_info_t*
+snet_find_watched_game(snet_t* snet, snet_blob_t join_token) {
+	if (snet->io != NULL) { return snet_io_find_watched_game(snet->io, join_token); }
+
+	return snet_game_table_find(&snet->watched_games, join_token);
 }
 
 void
 snet_list_games(snet_t* snet) {
-	snet_task_begin(snet, &snet->list_games_task, snet_task_list_games, NULL, 0);
+	snet_list_games_ex(snet, &(snet_list_games_options_t){ 0 });
+}
+
+void
+snet_list_games_ex(snet_t* snet, const snet_list_games_options_t* options) {
+	if (snet->io != NULL) {
+		snet_io_post(snet->io, &(snet_io_command_t){
+			.type = SNET_IO_LIST_GAMES,
+			.list_options = *options,
+		});
+		return;
+	}
+
+	snet_task_begin(snet, &snet->list_games_task, snet_task_list_games, options, sizeof(*options));
 }
 
 size_t
 snet_max_message_size(void) {
-	return snet_transport_max_message_size();
+	return snet_transport_max_message_size() - SNET_PACKET_HEADER_SIZE;
 }
 
 #define BLIB_IMPLEMENTATION
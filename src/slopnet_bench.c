@@ -0,0 +1,209 @@
+#include "slopnet_json.h"
+#include "slopnet_msg_ring.h"
+#include "slopnet_time.h"
+#include <cute_alloc.h>
+#include <SDL3/SDL_thread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SNET_BENCH_LIST_SIZE (1024 * 1024)
+#define SNET_BENCH_CHUNK_SIZE (16 * 1024)
+#define SNET_BENCH_MIN_DURATION 1.0
+#define SNET_BENCH_NUM_MESSAGES 2000000
+#define SNET_BENCH_RING_SIZE 1024
+#define SNET_BENCH_RING_BUF_SIZE (256 * 1024)
+
+// Roughly what /game/list returns, with an escape every few games
+static char*
+snet_bench_make_game_list(size_t* size) {
+	char* json = cf_alloc(SNET_BENCH_LIST_SIZE + 1024);
+	size_t len = (size_t)sprintf(json, "{\"games\":[");
+	for (int i = 0; len < SNET_BENCH_LIST_SIZE; ++i) {
+		len += (size_t)sprintf(
+			json + len,
+			"%s{\"join_token\":\"%08x-1c2d-4e5f-8a9b-%012x\",\"creator\":\"player_%d\","
+			"\"data\":\"{\\\"map\\\":\\\"island %d\\\",\\\"mode\\\":\\\"deathmatch\\\"}%s\"}",
+			i > 0 ? "," : "", (unsigned)i * 2654435761u, (unsigned)i,
+			i % 100, i % 7, i % 5 == 0 ? "\\u00e9" : ""
+		);
+	}
+	len += (size_t)sprintf(json + len, "],\"next_cursor\":\"\"}");
+
+	*size = len;
+	return json;
+}
+
+static int
+snet_bench_read_all(snet_json_reader_t* reader) {
+	int num_tokens = 0;
+	snet_json_token_t token;
+	while ((token = snet_json_reader_next(reader)) != SNET_JSON_NEED_MORE) {
+		if (token == SNET_JSON_ERROR) { return -1; }
+		num_tokens += 1;
+	}
+	return num_tokens;
+}
+
+static int
+snet_bench_json_chunked(const char* json, size_t size, char* copy) {
+	(void)copy;
+	snet_json_reader_t reader;
+	snet_json_reader_init(&reader);
+
+	int num_tokens = 0;
+	for (size_t offset = 0; offset < size; offset += SNET_BENCH_CHUNK_SIZE) {
+		size_t chunk_size = size - offset < SNET_BENCH_CHUNK_SIZE ? size - offset : SNET_BENCH_CHUNK_SIZE;
+		snet_json_reader_feed(&reader, json + offset, chunk_size);
+		num_tokens += snet_bench_read_all(&reader);
+	}
+
+	snet_json_reader_cleanup(&reader);
+	return num_tokens;
+}
+
+static int
+snet_bench_json_in_place(const char* json, size_t size, char* copy) {
+	memcpy(copy, json, size);
+
+	snet_json_reader_t reader;
+	snet_json_reader_init_in_place(&reader, copy, size);
+	int num_tokens = snet_bench_read_all(&reader);
+	snet_json_reader_cleanup(&reader);
+	return num_tokens;
+}
+
+static void
+snet_bench_json(const char* name, int (*fn)(const char* json, size_t size, char* copy)) {
+	size_t size;
+	char* json = snet_bench_make_game_list(&size);
+	char* copy = cf_alloc(size);
+
+	int num_tokens = fn(json, size, copy);
+	int num_runs = 0;
+	double start = snet_seconds();
+	double elapsed;
+	do {
+		fn(json, size, copy);
+		num_runs += 1;
+		elapsed = snet_seconds() - start;
+	} while (elapsed < SNET_BENCH_MIN_DURATION);
+
+	printf(
+		"%-16s %8.1f MB/s  (%zu bytes, %d tokens, %d runs)\n",
+		name, (double)size * num_runs / elapsed / (1024.0 * 1024.0),
+		size, num_tokens, num_runs
+	);
+
+	cf_free(copy);
+	cf_free(json);
+}
+
+typedef struct {
+	snet_msg_ring_t ring;
+	int batch_size;
+	uint64_t checksum;
+} snet_bench_ring_t;
+
+static size_t
+snet_bench_message_size(uint32_t index) {
+	// Spread over 8 to 263 bytes, like game messages
+	return 8 + (index * 2654435761u >> 24);
+}
+
+static int
+snet_bench_ring_consumer(void* userdata) {
+	snet_bench_ring_t* bench = userdata;
+
+	uint64_t checksum = 0;
+	uint32_t num_received = 0;
+	int num_unreleased = 0;
+	while (num_received < SNET_BENCH_NUM_MESSAGES) {
+		const void* message;
+		size_t size;
+		if (!snet_msg_ring_next(&bench->ring, &message, &size)) {
+			snet_msg_ring_release(&bench->ring);
+			num_unreleased = 0;
+			continue;
+		}
+
+		uint32_t index;
+		memcpy(&index, message, sizeof(index));
+		if (index != num_received || size != snet_bench_message_size(index)) {
+			printf("Ring corrupted at message %u\n", num_received);
+			break;
+		}
+		checksum += ((const uint8_t*)message)[size - 1];
+		num_received += 1;
+
+		if (++num_unreleased >= bench->batch_size) {
+			snet_msg_ring_release(&bench->ring);
+			num_unreleased = 0;
+		}
+	}
+	snet_msg_ring_release(&bench->ring);
+
+	bench->checksum = checksum;
+	return 0;
+}
+
+// One producer and one consumer thread hammering the same ring
+static void
+snet_bench_ring(int batch_size) {
+	snet_bench_ring_t bench = { .batch_size = batch_size };
+	snet_msg_ring_init(&bench.ring, SNET_BENCH_RING_SIZE, SNET_BENCH_RING_BUF_SIZE);
+
+	double start = snet_seconds();
+	SDL_Thread* consumer = SDL_CreateThread(snet_bench_ring_consumer, "consumer", &bench);
+
+	uint64_t checksum = 0;
+	uint64_t num_bytes = 0;
+	int num_uncommitted = 0;
+	for (uint32_t i = 0; i < SNET_BENCH_NUM_MESSAGES; ++i) {
+		size_t size = snet_bench_message_size(i);
+		uint8_t* message;
+		while ((message = snet_msg_ring_reserve(&bench.ring, size)) == NULL) {
+			snet_msg_ring_commit(&bench.ring);
+			num_uncommitted = 0;
+		}
+
+		memcpy(message, &i, sizeof(i));
+		message[size - 1] = (uint8_t)i;
+		checksum += (uint8_t)i;
+		num_bytes += size;
+
+		if (++num_uncommitted >= batch_size) {
+			snet_msg_ring_commit(&bench.ring);
+			num_uncommitted = 0;
+		}
+	}
+	snet_msg_ring_commit(&bench.ring);
+
+	SDL_WaitThread(consumer, NULL);
+	double elapsed = snet_seconds() - start;
+
+	printf(
+		"ring batch %-5d %8.1f M msg/s %8.1f MB/s%s\n",
+		batch_size,
+		SNET_BENCH_NUM_MESSAGES / elapsed / 1e6,
+		(double)num_bytes / elapsed / (1024.0 * 1024.0),
+		checksum == bench.checksum ? "" : "  (checksum mismatch)"
+	);
+
+	snet_msg_ring_cleanup(&bench.ring);
+}
+
+int
+main(void) {
+#if defined(SNET_JSON_NO_SIMD)
+	printf("JSON scanner: scalar\n");
+#else
+	printf("JSON scanner: SIMD where available\n");
+#endif
+	snet_bench_json("json chunked", snet_bench_json_chunked);
+	snet_bench_json("json in place", snet_bench_json_in_place);
+
+	snet_bench_ring(1);
+	snet_bench_ring(32);
+
+	return 0;
+}
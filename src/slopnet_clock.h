@@ -0,0 +1,141 @@
+#ifndef SLOPNET_CLOCK_H
+#define SLOPNET_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define SNET_CLOCK_NUM_SAMPLES 16
+// Quickly get a first estimate, then only keep it fresh
+#define SNET_CLOCK_FAST_INTERVAL 0.2
+#define SNET_CLOCK_INTERVAL 2.0
+// A relay which never answered this many requests is taken not to support
+// them.
+// One which only forwards them would send each to every player.
+#define SNET_CLOCK_MAX_UNANSWERED 5
+// Drift is only estimated from samples at least this far apart
+#define SNET_CLOCK_MIN_DRIFT_SPAN 8.0
+// Worst drift between two clocks which is assumed, in seconds per second
+#define SNET_CLOCK_MAX_DRIFT 0.0005
+
+// NTP-style estimate of a remote clock from request and response pairs.
+// Each sample only gives the offset to within half its round trip so the
+// one with the shortest round trip is trusted the most.
+typedef struct {
+	// When the response arrived, on the local clock
+	double local_time;
+	// Remote minus local clock
+	double offset;
+	double rtt;
+} snet_clock_sample_t;
+
+typedef struct {
+	// Ring of the last samples, oldest at next_sample once full
+	snet_clock_sample_t samples[SNET_CLOCK_NUM_SAMPLES];
+	int num_samples;
+	int next_sample;
+	double next_request_time;
+	// Requests sent since the last sample
+	int num_unanswered;
+} snet_clock_t;
+
+static inline void
+snet_clock_write_time(char* buf, double time) {
+	uint64_t bits;
+	memcpy(&bits, &time, sizeof(bits));
+	for (int i = 0; i < 8; ++i) {
+		buf[i] = (char)(bits >> (i * 8));
+	}
+}
+
+static inline double
+snet_clock_read_time(const void* buf) {
+	const uint8_t* bytes = buf;
+	uint64_t bits = 0;
+	for (int i = 0; i < 8; ++i) {
+		bits |= (uint64_t)bytes[i] << (i * 8);
+	}
+	double time;
+	memcpy(&time, &bits, sizeof(time));
+	return time;
+}
+
+// Requests stop once too many went unanswered without any sample.
+// A late answer starts them again.
+static inline bool
+snet_clock_should_request(snet_clock_t* clock, double now) {
+	if (clock->num_samples == 0 && clock->num_unanswered >= SNET_CLOCK_MAX_UNANSWERED) { return false; }
+	if (now < clock->next_request_time) { return false; }
+
+	clock->next_request_time = now + (
+		clock->num_samples < SNET_CLOCK_NUM_SAMPLES / 2
+		? SNET_CLOCK_FAST_INTERVAL
+		: SNET_CLOCK_INTERVAL
+	);
+	clock->num_unanswered += 1;
+	return true;
+}
+
+// The remote clock is assumed to be read halfway through the round trip
+static inline void
+snet_clock_add_sample(snet_clock_t* clock, double request_time, double remote_time, double response_time) {
+	double rtt = response_time - request_time;
+	if (!(rtt >= 0.0) || !isfinite(remote_time)) { return; }
+
+	clock->samples[clock->next_sample] = (snet_clock_sample_t){
+		.local_time = response_time,
+		.offset = remote_time - (request_time + response_time) * 0.5,
+		.rtt = rtt,
+	};
+	clock->next_sample = (clock->next_sample + 1) % SNET_CLOCK_NUM_SAMPLES;
+	if (clock->num_samples < SNET_CLOCK_NUM_SAMPLES) { clock->num_samples += 1; }
+	clock->num_unanswered = 0;
+}
+
+// Index of the sample with the shortest round trip among the num_samples
+// ones starting from the oldest + first
+static inline int
+snet_clock_best_sample(const snet_clock_t* clock, int first, int num_samples) {
+	int oldest = clock->num_samples < SNET_CLOCK_NUM_SAMPLES ? 0 : clock->next_sample;
+	int best = -1;
+	for (int i = first; i < first + num_samples; ++i) {
+		int index = (oldest + i) % SNET_CLOCK_NUM_SAMPLES;
+		if (best < 0 || clock->samples[index].rtt < clock->samples[best].rtt) {
+			best = index;
+		}
+	}
+	return best;
+}
+
+// Returns false until there is a sample.
+// The estimate moves on with the best sample and the drift between the best
+// samples of the older and the newer half while the error grows with the
+// age of the best sample.
+static inline bool
+snet_clock_estimate(const snet_clock_t* clock, double now, double* time, double* error) {
+	if (clock->num_samples == 0) { return false; }
+
+	const snet_clock_sample_t* best = &clock->samples[snet_clock_best_sample(clock, 0, clock->num_samples)];
+
+	double drift = 0.0;
+	int num_older = clock->num_samples / 2;
+	if (num_older > 0) {
+		const snet_clock_sample_t* older = &clock->samples[snet_clock_best_sample(clock, 0, num_older)];
+		const snet_clock_sample_t* newer = &clock->samples[
+			snet_clock_best_sample(clock, num_older, clock->num_samples - num_older)
+		];
+		double span = newer->local_time - older->local_time;
+		if (span >= SNET_CLOCK_MIN_DRIFT_SPAN) {
+			drift = (newer->offset - older->offset) / span;
+			drift = fmax(-SNET_CLOCK_MAX_DRIFT, fmin(drift, SNET_CLOCK_MAX_DRIFT));
+		}
+	}
+
+	double age = fabs(now - best->local_time);
+	*time = now + best->offset + drift * (now - best->local_time);
+	if (error != NULL) { *error = best->rtt * 0.5 + age * SNET_CLOCK_MAX_DRIFT; }
+	return true;
+}
+
+#endif
@@ -1,21 +1,760 @@
 #include "slopnet_fetch.h"
+#include <string.h>
+
+static bool
+snet_fetch_str_ieq(const char* lhs, size_t lhs_len, const char* rhs) {
+	size_t rhs_len = strlen(rhs);
+	if (lhs_len != rhs_len) { return false; }
+
+	for (size_t i = 0; i < lhs_len; ++i) {
+		char l = lhs[i], r = rhs[i];
+		if ('A' <= l && l <= 'Z') { l = l - 'A' + 'a'; }
+		if ('A' <= r && r <= 'Z') { r = r - 'A' + 'a'; }
+		if (l != r) { return false; }
+	}
+
+	return true;
+}
+
+// Finds a header in a raw "Name: value\r\n" block
+static const char*
+snet_fetch_find_header(const char* headers, size_t size, const char* name, size_t* value_size) {
+	const char* end = headers + size;
+	for (const char* line = headers; line < end;) {
+		const char* line_end = memchr(line, '\n', end - line);
+		if (line_end == NULL) { line_end = end; }
+
+		const char* colon = memchr(line, ':', line_end - line);
+		if (colon != NULL && snet_fetch_str_ieq(line, colon - line, name)) {
+			const char* value = colon + 1;
+			const char* value_end = line_end;
+			while (value < value_end && (*value == ' ' || *value == '\t')) { ++value; }
+			while (value_end > value && (value_end[-1] == '\r' || value_end[-1] == ' ')) { --value_end; }
+
+			*value_size = value_end - value;
+			return value;
+		}
+
+		line = line_end + 1;
+	}
+
+	return NULL;
+}
 
 #ifndef __EMSCRIPTEN__
 
 #include <cute_https.h>
+#include <cute_alloc.h>
+#include <cute/cute_tls.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "slopnet_time.h"
+#include "slopnet_socket.h"
+
+#define SNET_FETCH_MAX_HOST_SIZE 256
+#define SNET_FETCH_MAX_HEADER_SIZE 16384
+#define SNET_FETCH_READ_SIZE 4096
+#define SNET_FETCH_SEND_SIZE 16384
+
+typedef struct {
+	char* ptr;
+	size_t size;
+	size_t capacity;
+} snet_fetch_buf_t;
+
+typedef struct snet_fetch_conn_s snet_fetch_conn_t;
+
+struct snet_fetch_conn_s {
+	snet_fetch_conn_t* next;
+	// Plain HTTP connections use socket instead of tls
+	bool plain;
+	TLS_Connection tls;
+	snet_socket_t socket;
+	// Preconnected connections sit in the pool while still handshaking
+	bool connected;
+	bool in_use;
+	double last_used;
+	int port;
+	char host[SNET_FETCH_MAX_HOST_SIZE];
+};
+
+struct snet_fetch_pool_s {
+	snet_fetch_pool_config_t config;
+	snet_fetch_conn_t* connections;
+};
+
+typedef enum {
+	SNET_FETCH_STAGE_CONNECTING,
+	SNET_FETCH_STAGE_SENDING,
+	SNET_FETCH_STAGE_RECEIVING_HEADERS,
+	SNET_FETCH_STAGE_RECEIVING_BODY,
+	SNET_FETCH_STAGE_FINISHED,
+	SNET_FETCH_STAGE_FAILED,
+} snet_fetch_stage_t;
+
+typedef enum {
+	SNET_FETCH_BODY_NONE,
+	SNET_FETCH_BODY_LENGTH,
+	SNET_FETCH_BODY_CHUNKED,
+	SNET_FETCH_BODY_UNTIL_CLOSE,
+} snet_fetch_body_mode_t;
+
+typedef enum {
+	SNET_FETCH_CHUNK_SIZE,
+	SNET_FETCH_CHUNK_DATA,
+	SNET_FETCH_CHUNK_DATA_END,
+	SNET_FETCH_CHUNK_TRAILER,
+} snet_fetch_chunk_state_t;
+
+struct snet_fetch_s {
+	// Requests without a pool or with TLS verification disabled go through
+	// cf_https since cute_tls always verifies the certificate.
+	// Plain HTTP always goes through the pool.
+	CF_HttpsRequest https;
+
+	snet_fetch_pool_t* pool;
+	snet_fetch_conn_t* conn;
+	bool conn_reused;
+	snet_fetch_stage_t stage;
+
+	snet_fetch_buf_t request;
+	size_t request_sent;
+
+	snet_fetch_buf_t headers;
+	snet_fetch_buf_t response;
+	size_t response_pos;
+	snet_fetch_buf_t body;
+	size_t body_read;
+	bool stream_body;
+
+	int status_code;
+	bool keep_alive;
+	snet_fetch_body_mode_t body_mode;
+	snet_fetch_chunk_state_t chunk_state;
+	size_t body_remaining;
+};
+
+static void
+snet_fetch_buf_reserve(snet_fetch_buf_t* buf, size_t size) {
+	if (buf->capacity >= size) { return; }
+
+	size_t capacity = buf->capacity > 0 ? buf->capacity : 256;
+	while (capacity < size) { capacity *= 2; }
+	buf->ptr = cf_realloc(buf->ptr, capacity);
+	buf->capacity = capacity;
+}
+
+static void
+snet_fetch_buf_append(snet_fetch_buf_t* buf, const void* data, size_t size) {
+	if (size == 0) { return; }
+
+	snet_fetch_buf_reserve(buf, buf->size + size);
+	memcpy(buf->ptr + buf->size, data, size);
+	buf->size += size;
+}
+
+static void
+snet_fetch_buf_printf(snet_fetch_buf_t* buf, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	va_list args_copy;
+	va_copy(args_copy, args);
+	int size = vsnprintf(NULL, 0, fmt, args);
+	if (size >= 0) {
+		snet_fetch_buf_reserve(buf, buf->size + size + 1);
+		vsnprintf(buf->ptr + buf->size, size + 1, fmt, args_copy);
+		buf->size += size;
+	}
+	va_end(args_copy);
+	va_end(args);
+}
+
+static void
+snet_fetch_buf_cleanup(snet_fetch_buf_t* buf) {
+	cf_free(buf->ptr);
+	*buf = (snet_fetch_buf_t){ 0 };
+}
+
+static bool
+snet_fetch_str_icontains(const char* haystack, size_t haystack_len, const char* needle) {
+	size_t needle_len = strlen(needle);
+	for (size_t i = 0; i + needle_len <= haystack_len; ++i) {
+		if (snet_fetch_str_ieq(haystack + i, needle_len, needle)) { return true; }
+	}
+
+	return false;
+}
+
+static const char*
+snet_fetch_find(const char* begin, const char* end, const char* needle) {
+	size_t needle_len = strlen(needle);
+	for (const char* itr = begin; itr + needle_len <= end; ++itr) {
+		if (memcmp(itr, needle, needle_len) == 0) { return itr; }
+	}
+
+	return NULL;
+}
+
+// Pool {{{
+
+static void
+snet_fetch_conn_destroy(snet_fetch_conn_t* conn) {
+	if (conn->plain) {
+		snet_socket_close(&conn->socket);
+	} else {
+		tls_disconnect(conn->tls);
+	}
+	cf_free(conn);
+}
+
+static TLS_State
+snet_fetch_conn_process(snet_fetch_conn_t* conn) {
+	if (!conn->plain) { return tls_process(conn->tls); }
+
+	switch (snet_socket_process(&conn->socket)) {
+		case SNET_SOCKET_CONNECTING: return TLS_STATE_PENDING;
+		case SNET_SOCKET_CONNECTED: return TLS_STATE_CONNECTED;
+		case SNET_SOCKET_CLOSED: return TLS_STATE_DISCONNECTED;
+		default: return TLS_STATE_UNKNOWN_ERROR;
+	}
+}
+
+// Returns the number of bytes sent or -1 on error
+static int
+snet_fetch_conn_send(snet_fetch_conn_t* conn, const void* data, int size) {
+	if (conn->plain) {
+		return snet_socket_send(&conn->socket, data, size);
+	} else {
+		return tls_send(conn->tls, data, size) < 0 ? -1 : size;
+	}
+}
+
+static int
+snet_fetch_conn_read(snet_fetch_conn_t* conn, void* buf, int size) {
+	if (conn->plain) {
+		return snet_socket_recv(&conn->socket, buf, size);
+	} else {
+		return tls_read(conn->tls, buf, size);
+	}
+}
+
+snet_fetch_pool_t*
+snet_fetch_pool_init(const snet_fetch_pool_config_t* config) {
+	snet_fetch_pool_t* pool = cf_alloc(sizeof(snet_fetch_pool_t));
+	*pool = (snet_fetch_pool_t){
+		.config = *config,
+	};
+	return pool;
+}
+
+void
+snet_fetch_pool_cleanup(snet_fetch_pool_t* pool) {
+	for (snet_fetch_conn_t* itr = pool->connections; itr != NULL;) {
+		snet_fetch_conn_t* next = itr->next;
+		snet_fetch_conn_destroy(itr);
+		itr = next;
+	}
+
+	cf_free(pool);
+}
+
+void
+snet_fetch_pool_update(snet_fetch_pool_t* pool) {
+	double now = snet_seconds();
+	for (snet_fetch_conn_t** itr = &pool->connections; *itr != NULL;) {
+		snet_fetch_conn_t* conn = *itr;
+
+		bool evict = false;
+		if (!conn->in_use) {
+			// Also drop connections which the server has closed while idle
+			TLS_State state = snet_fetch_conn_process(conn);
+			if (!conn->connected && state == TLS_STATE_CONNECTED) {
+				conn->connected = true;
+			}
+			evict = (now - conn->last_used) >= pool->config.idle_timeout
+				|| (conn->connected ? state != TLS_STATE_CONNECTED : state != TLS_STATE_PENDING);
+		}
+
+		if (evict) {
+			*itr = conn->next;
+			snet_fetch_conn_destroy(conn);
+		} else {
+			itr = &conn->next;
+		}
+	}
+}
+
+static snet_fetch_conn_t*
+snet_fetch_pool_find_idle(snet_fetch_pool_t* pool, const char* host, int port, bool plain) {
+	// Prefer a connection which has finished its handshake
+	snet_fetch_conn_t* found = NULL;
+	for (snet_fetch_conn_t* itr = pool->connections; itr != NULL; itr = itr->next) {
+		if (!itr->in_use && itr->port == port && itr->plain == plain && strcmp(itr->host, host) == 0) {
+			if (itr->connected) { return itr; }
+			if (found == NULL) { found = itr; }
+		}
+	}
+
+	return found;
+}
+
+static snet_fetch_conn_t*
+snet_fetch_pool_connect(snet_fetch_pool_t* pool, const char* host, int port, bool plain) {
+	size_t host_len = strlen(host);
+	if (host_len >= SNET_FETCH_MAX_HOST_SIZE) { return NULL; }
+
+	snet_fetch_conn_t* conn = cf_alloc(sizeof(snet_fetch_conn_t));
+	*conn = (snet_fetch_conn_t){
+		.next = pool->connections,
+		.plain = plain,
+		.port = port,
+		.last_used = snet_seconds(),
+	};
+	if (plain) {
+		conn->socket = snet_socket_connect(host, port);
+	} else {
+		conn->tls = tls_connect(host, (uint16_t)port);
+	}
+	memcpy(conn->host, host, host_len + 1);
+	pool->connections = conn;
+
+	return conn;
+}
+
+static snet_fetch_conn_t*
+snet_fetch_pool_acquire(snet_fetch_pool_t* pool, const char* host, int port, bool plain, bool* reused) {
+	snet_fetch_conn_t* conn = snet_fetch_pool_find_idle(pool, host, port, plain);
+	*reused = conn != NULL;
+	if (conn == NULL) {
+		conn = snet_fetch_pool_connect(pool, host, port, plain);
+	}
+
+	if (conn != NULL) { conn->in_use = true; }
+	return conn;
+}
+
+void
+snet_fetch_pool_preconnect(snet_fetch_pool_t* pool, const char* host, int port, bool plain) {
+	if (snet_fetch_pool_find_idle(pool, host, port, plain) == NULL) {
+		snet_fetch_pool_connect(pool, host, port, plain);
+	}
+}
+
+static void
+snet_fetch_pool_release(snet_fetch_pool_t* pool, snet_fetch_conn_t* conn, bool keep_alive) {
+	if (keep_alive) {
+		conn->in_use = false;
+		conn->last_used = snet_seconds();
+		return;
+	}
+
+	for (snet_fetch_conn_t** itr = &pool->connections; *itr != NULL; itr = &(*itr)->next) {
+		if (*itr == conn) {
+			*itr = conn->next;
+			break;
+		}
+	}
+	snet_fetch_conn_destroy(conn);
+}
+
+// }}}
+
+// HTTP/1.1 {{{
+
+static void
+snet_fetch_release_conn(snet_fetch_t* fetch, bool keep_alive) {
+	if (fetch->conn != NULL) {
+		snet_fetch_pool_release(fetch->pool, fetch->conn, keep_alive);
+		fetch->conn = NULL;
+	}
+}
+
+static snet_fetch_stage_t
+snet_fetch_conn_stage(const snet_fetch_conn_t* conn) {
+	return conn != NULL && conn->connected ? SNET_FETCH_STAGE_SENDING : SNET_FETCH_STAGE_CONNECTING;
+}
+
+static snet_fetch_status_t
+snet_fetch_fail(snet_fetch_t* fetch) {
+	// A reused connection may have been closed by the server while it was
+	// sitting in the pool.
+	// Retry once with a new connection if nothing has been received yet.
+	if (
+		fetch->conn_reused
+		&& fetch->stage <= SNET_FETCH_STAGE_RECEIVING_HEADERS
+		&& fetch->response.size == 0
+	) {
+		char host[SNET_FETCH_MAX_HOST_SIZE];
+		memcpy(host, fetch->conn->host, sizeof(host));
+		int port = fetch->conn->port;
+		bool plain = fetch->conn->plain;
+		snet_fetch_release_conn(fetch, false);
+
+		fetch->conn = snet_fetch_pool_acquire(fetch->pool, host, port, plain, &fetch->conn_reused);
+		fetch->stage = snet_fetch_conn_stage(fetch->conn);
+		fetch->request_sent = 0;
+		return SNET_FETCH_PENDING;
+	}
+
+	snet_fetch_release_conn(fetch, false);
+	fetch->stage = SNET_FETCH_STAGE_FAILED;
+	return SNET_FETCH_ERROR;
+}
+
+// Returns the end of the digits or NULL if there are none or too many
+static const char*
+snet_fetch_parse_digits(const char* itr, const char* end, int max_digits, int* value) {
+	const char* begin = itr;
+	*value = 0;
+	while (itr < end && '0' <= *itr && *itr <= '9' && itr - begin < max_digits) {
+		*value = *value * 10 + (*itr - '0');
+		++itr;
+	}
+
+	bool more = itr < end && '0' <= *itr && *itr <= '9';
+	return itr == begin || more ? NULL : itr;
+}
+
+// Such as "HTTP/1.1 200 OK", without reading past end
+static bool
+snet_fetch_parse_status_line(const char* begin, const char* end, int* major, int* minor, int* status) {
+	const char* itr = begin;
+	if (end - itr < 5 || memcmp(itr, "HTTP/", 5) != 0) { return false; }
+	itr += 5;
+
+	itr = snet_fetch_parse_digits(itr, end, 1, major);
+	if (itr == NULL || itr == end || *itr != '.') { return false; }
+	itr = snet_fetch_parse_digits(itr + 1, end, 1, minor);
+	if (itr == NULL || itr == end || *itr != ' ') { return false; }
+
+	while (itr < end && *itr == ' ') { ++itr; }
+	itr = snet_fetch_parse_digits(itr, end, 3, status);
+	return itr != NULL && (itr == end || *itr == ' ');
+}
+
+// Returns 1 when all headers are parsed, 0 when more data is needed and -1 on
+// malformed response
+static int
+snet_fetch_parse_headers(snet_fetch_t* fetch) {
+	const char* begin;
+	const char* headers_end;
+	int major, minor;
+	while (true) {
+		begin = fetch->response.ptr + fetch->response_pos;
+		const char* end = fetch->response.ptr + fetch->response.size;
+		headers_end = snet_fetch_find(begin, end, "\r\n\r\n");
+		if (headers_end == NULL) {
+			return (size_t)(end - begin) > SNET_FETCH_MAX_HEADER_SIZE ? -1 : 0;
+		}
+
+		const char* status_end = snet_fetch_find(begin, headers_end + 2, "\r\n");
+		if (!snet_fetch_parse_status_line(begin, status_end, &major, &minor, &fetch->status_code)) {
+			return -1;
+		}
+
+		// Interim responses such as 103 Early Hints precede the final one
+		int status = fetch->status_code;
+		if (100 <= status && status < 200 && status != 101) {
+			fetch->response_pos = (headers_end + 4) - fetch->response.ptr;
+		} else {
+			break;
+		}
+	}
+
+	fetch->keep_alive = major > 1 || (major == 1 && minor >= 1);
+	bool has_length = false;
+	bool chunked = false;
+	const char* line = snet_fetch_find(begin, headers_end + 2, "\r\n") + 2;
+	while (line < headers_end) {
+		const char* line_end = snet_fetch_find(line, headers_end + 2, "\r\n");
+		const char* colon = memchr(line, ':', line_end - line);
+		if (colon != NULL) {
+			const char* value = colon + 1;
+			while (value < line_end && (*value == ' ' || *value == '\t')) { ++value; }
+			size_t value_len = line_end - value;
+
+			if (snet_fetch_str_ieq(line, colon - line, "content-length")) {
+				fetch->body_remaining = (size_t)strtoull(value, NULL, 10);
+				has_length = true;
+			} else if (snet_fetch_str_ieq(line, colon - line, "transfer-encoding")) {
+				chunked = snet_fetch_str_icontains(value, value_len, "chunked");
+			} else if (snet_fetch_str_ieq(line, colon - line, "connection")) {
+				if (snet_fetch_str_icontains(value, value_len, "close")) {
+					fetch->keep_alive = false;
+				} else if (snet_fetch_str_icontains(value, value_len, "keep-alive")) {
+					fetch->keep_alive = true;
+				}
+			}
+		}
+
+		line = line_end + 2;
+	}
+
+	int status = fetch->status_code;
+	if ((100 <= status && status < 200) || status == 204 || status == 304) {
+		fetch->body_mode = SNET_FETCH_BODY_NONE;
+	} else if (chunked) {
+		fetch->body_mode = SNET_FETCH_BODY_CHUNKED;
+		fetch->chunk_state = SNET_FETCH_CHUNK_SIZE;
+	} else if (has_length) {
+		fetch->body_mode = SNET_FETCH_BODY_LENGTH;
+	} else {
+		fetch->body_mode = SNET_FETCH_BODY_UNTIL_CLOSE;
+		fetch->keep_alive = false;
+	}
+
+	snet_fetch_buf_append(&fetch->headers, begin, (headers_end + 2) - begin);
+	fetch->response_pos = (headers_end + 4) - fetch->response.ptr;
+	return 1;
+}
+
+// Hex digits optionally followed by chunk extensions after ';'
+static bool
+snet_fetch_parse_chunk_size(const char* begin, const char* end, size_t* size) {
+	const char* itr = begin;
+	*size = 0;
+	for (; itr < end; ++itr) {
+		int digit;
+		if ('0' <= *itr && *itr <= '9') {
+			digit = *itr - '0';
+		} else if ('a' <= *itr && *itr <= 'f') {
+			digit = *itr - 'a' + 10;
+		} else if ('A' <= *itr && *itr <= 'F') {
+			digit = *itr - 'A' + 10;
+		} else {
+			break;
+		}
+
+		if (*size > (SIZE_MAX >> 4)) { return false; }
+		*size = (*size << 4) | (size_t)digit;
+	}
+	if (itr == begin) { return false; }
+
+	while (itr < end && (*itr == ' ' || *itr == '\t')) { ++itr; }
+	return itr == end || *itr == ';';
+}
+
+// Returns 1 when the body is complete, 0 when more data is needed and -1 on
+// malformed framing
+static int
+snet_fetch_parse_chunked_body(snet_fetch_t* fetch) {
+	while (true) {
+		const char* begin = fetch->response.ptr + fetch->response_pos;
+		const char* end = fetch->response.ptr + fetch->response.size;
+
+		switch (fetch->chunk_state) {
+			case SNET_FETCH_CHUNK_SIZE: {
+				const char* line_end = snet_fetch_find(begin, end, "\r\n");
+				if (line_end == NULL) {
+					return (size_t)(end - begin) > SNET_FETCH_MAX_HEADER_SIZE ? -1 : 0;
+				}
+
+				size_t chunk_size;
+				if (!snet_fetch_parse_chunk_size(begin, line_end, &chunk_size)) { return -1; }
+				fetch->response_pos += (line_end + 2) - begin;
+				if (chunk_size > 0) {
+					fetch->body_remaining = chunk_size;
+					fetch->chunk_state = SNET_FETCH_CHUNK_DATA;
+				} else {
+					fetch->chunk_state = SNET_FETCH_CHUNK_TRAILER;
+				}
+			} break;
+			case SNET_FETCH_CHUNK_DATA: {
+				size_t available = end - begin;
+				if (available == 0) { return 0; }
+
+				size_t size = available < fetch->body_remaining ? available : fetch->body_remaining;
+				snet_fetch_buf_append(&fetch->body, begin, size);
+				fetch->response_pos += size;
+				fetch->body_remaining -= size;
+				if (fetch->body_remaining == 0) {
+					fetch->chunk_state = SNET_FETCH_CHUNK_DATA_END;
+				}
+			} break;
+			case SNET_FETCH_CHUNK_DATA_END: {
+				if (end - begin < 2) { return 0; }
+				if (begin[0] != '\r' || begin[1] != '\n') { return -1; }
+
+				fetch->response_pos += 2;
+				fetch->chunk_state = SNET_FETCH_CHUNK_SIZE;
+			} break;
+			case SNET_FETCH_CHUNK_TRAILER: {
+				const char* line_end = snet_fetch_find(begin, end, "\r\n");
+				if (line_end == NULL) {
+					return (size_t)(end - begin) > SNET_FETCH_MAX_HEADER_SIZE ? -1 : 0;
+				}
+
+				fetch->response_pos += (line_end + 2) - begin;
+				if (line_end == begin) { return 1; }
+			} break;
+		}
+	}
+}
+
+// Same results as snet_fetch_parse_chunked_body
+static int
+snet_fetch_parse_body(snet_fetch_t* fetch, bool closed) {
+	const char* begin = fetch->response.ptr + fetch->response_pos;
+	size_t available = fetch->response.size - fetch->response_pos;
+
+	switch (fetch->body_mode) {
+		case SNET_FETCH_BODY_NONE:
+			return 1;
+		case SNET_FETCH_BODY_LENGTH: {
+			size_t size = available < fetch->body_remaining ? available : fetch->body_remaining;
+			snet_fetch_buf_append(&fetch->body, begin, size);
+			fetch->response_pos += size;
+			fetch->body_remaining -= size;
+			return fetch->body_remaining == 0 ? 1 : 0;
+		}
+		case SNET_FETCH_BODY_CHUNKED:
+			return snet_fetch_parse_chunked_body(fetch);
+		case SNET_FETCH_BODY_UNTIL_CLOSE:
+			snet_fetch_buf_append(&fetch->body, begin, available);
+			fetch->response_pos += available;
+			return closed ? 1 : 0;
+	}
+
+	return 0;
+}
+
+static void
+snet_fetch_compact_response(snet_fetch_t* fetch) {
+	size_t remaining = fetch->response.size - fetch->response_pos;
+	memmove(fetch->response.ptr, fetch->response.ptr + fetch->response_pos, remaining);
+	fetch->response.size = remaining;
+	fetch->response_pos = 0;
+}
+
+static snet_fetch_status_t
+snet_fetch_process_pooled(snet_fetch_t* fetch) {
+	while (true) {
+		switch (fetch->stage) {
+			case SNET_FETCH_STAGE_CONNECTING: {
+				if (fetch->conn == NULL) { return snet_fetch_fail(fetch); }
+
+				TLS_State state = snet_fetch_conn_process(fetch->conn);
+				if (state == TLS_STATE_PENDING) {
+					return SNET_FETCH_PENDING;
+				} else if (state == TLS_STATE_CONNECTED || state == TLS_STATE_PACKET_QUEUE_FILLED) {
+					fetch->conn->connected = true;
+					fetch->stage = SNET_FETCH_STAGE_SENDING;
+				} else {
+					return snet_fetch_fail(fetch);
+				}
+			} break;
+			case SNET_FETCH_STAGE_SENDING: {
+				if (fetch->conn == NULL) { return snet_fetch_fail(fetch); }
+
+				while (fetch->request_sent < fetch->request.size) {
+					size_t size = fetch->request.size - fetch->request_sent;
+					if (size > SNET_FETCH_SEND_SIZE) { size = SNET_FETCH_SEND_SIZE; }
+
+					int num_bytes = snet_fetch_conn_send(fetch->conn, fetch->request.ptr + fetch->request_sent, (int)size);
+					if (num_bytes < 0) { return snet_fetch_fail(fetch); }
+					if (num_bytes == 0) { return SNET_FETCH_PENDING; }
+					fetch->request_sent += num_bytes;
+				}
+
+				fetch->stage = SNET_FETCH_STAGE_RECEIVING_HEADERS;
+			} break;
+			case SNET_FETCH_STAGE_RECEIVING_HEADERS:
+			case SNET_FETCH_STAGE_RECEIVING_BODY: {
+				TLS_State state = snet_fetch_conn_process(fetch->conn);
+				bool closed = state == TLS_STATE_DISCONNECTED;
+				if (state <= TLS_STATE_UNKNOWN_ERROR) {
+					return snet_fetch_fail(fetch);
+				}
+
+				while (true) {
+					snet_fetch_buf_reserve(&fetch->response, fetch->response.size + SNET_FETCH_READ_SIZE);
+					int num_bytes = snet_fetch_conn_read(fetch->conn, fetch->response.ptr + fetch->response.size, SNET_FETCH_READ_SIZE);
+					if (num_bytes < 0) { return snet_fetch_fail(fetch); }
+					if (num_bytes == 0) { break; }
+					fetch->response.size += num_bytes;
+				}
+
+				if (fetch->stage == SNET_FETCH_STAGE_RECEIVING_HEADERS) {
+					int result = snet_fetch_parse_headers(fetch);
+					if (result > 0) {
+						fetch->stage = SNET_FETCH_STAGE_RECEIVING_BODY;
+					} else if (result < 0 || closed) {
+						return snet_fetch_fail(fetch);
+					} else {
+						return SNET_FETCH_PENDING;
+					}
+				}
+
+				int result = snet_fetch_parse_body(fetch, closed);
+				if (result < 0) { return snet_fetch_fail(fetch); }
+
+				snet_fetch_compact_response(fetch);
+				if (result > 0) {
+					// Anything left over means the server is out of sync with us
+					snet_fetch_release_conn(fetch, fetch->keep_alive && !closed && fetch->response.size == 0);
+					fetch->stage = SNET_FETCH_STAGE_FINISHED;
+				} else if (closed) {
+					return snet_fetch_fail(fetch);
+				} else {
+					return SNET_FETCH_PENDING;
+				}
+			} break;
+			case SNET_FETCH_STAGE_FINISHED:
+				return SNET_FETCH_FINISHED;
+			case SNET_FETCH_STAGE_FAILED:
+				return SNET_FETCH_ERROR;
+		}
+	}
+}
+
+// }}}
 
 snet_fetch_t*
 snet_fetch_begin(const snet_fetch_options_t* options) {
-	CF_HttpsRequest request = { 0 };
+	snet_fetch_t* fetch = cf_alloc(sizeof(snet_fetch_t));
+	*fetch = (snet_fetch_t){ 0 };
+
+	if (options->pool != NULL && (options->verify_tls || options->plain_http)) {
+		fetch->pool = options->pool;
+		fetch->stream_body = options->stream_body;
+
+		snet_fetch_buf_t* req = &fetch->request;
+		snet_fetch_buf_printf(
+			req, "%s %s HTTP/1.1\r\n",
+			options->method == SNET_FETCH_POST ? "POST" : "GET", options->path
+		);
+		if (options->port == (options->plain_http ? 80 : 443)) {
+			snet_fetch_buf_printf(req, "Host: %s\r\n", options->host);
+		} else {
+			snet_fetch_buf_printf(req, "Host: %s:%d\r\n", options->host, options->port);
+		}
+		snet_fetch_buf_printf(req, "Connection: keep-alive\r\n");
+		if (options->method == SNET_FETCH_POST) {
+			snet_fetch_buf_printf(req, "Content-Length: %zu\r\n", options->content_length);
+		}
+		for (int i = 0; options->headers != NULL && options->headers[i].name != NULL; ++i) {
+			snet_fetch_buf_printf(req, "%s: %s\r\n", options->headers[i].name, options->headers[i].value);
+		}
+		snet_fetch_buf_printf(req, "\r\n");
+		if (options->method == SNET_FETCH_POST) {
+			snet_fetch_buf_append(req, options->content, options->content_length);
+		}
+
+		fetch->conn = snet_fetch_pool_acquire(fetch->pool, options->host, options->port, options->plain_http, &fetch->conn_reused);
+		fetch->stage = snet_fetch_conn_stage(fetch->conn);
+		return fetch;
+	}
+
 	if (options->method == SNET_FETCH_GET) {
-		request = cf_https_get(
+		fetch->https = cf_https_get(
 			options->host,
 			options->port,
 			options->path,
 			options->verify_tls
 		);
 	} else if (options->method == SNET_FETCH_POST){
-		request = cf_https_post(
+		fetch->https = cf_https_post(
 			options->host,
 			options->port,
 			options->path,
@@ -24,70 +763,194 @@ snet_fetch_begin(const snet_fetch_options_t* options) {
 		);
 	}
 
-	if (request.id != 0) {
+	if (fetch->https.id != 0) {
 		for (int i = 0; options->headers != NULL && options->headers[i].name != NULL; ++i) {
-			cf_https_add_header(request, options->headers[i].name, options->headers[i].value);
+			cf_https_add_header(fetch->https, options->headers[i].name, options->headers[i].value);
 		}
 	}
 
-	return (snet_fetch_t*)request.id;
+	return fetch;
 }
 
 snet_fetch_status_t
 snet_fetch_process(snet_fetch_t* fetch) {
 	if (fetch == NULL) { return SNET_FETCH_ERROR; }
 
-	CF_HttpsRequest request = { .id = (uintptr_t)fetch };
-	CF_HttpsResult result = cf_https_process(request);
+	if (fetch->pool != NULL) {
+		if (fetch->stream_body && fetch->body_read > 0) {
+			// Drop what has been read so a streamed body never piles up
+			size_t remaining = fetch->body.size - fetch->body_read;
+			memmove(fetch->body.ptr, fetch->body.ptr + fetch->body_read, remaining);
+			fetch->body.size = remaining;
+			fetch->body_read = 0;
+		}
+
+		return snet_fetch_process_pooled(fetch);
+	}
+	if (fetch->https.id == 0) { return SNET_FETCH_ERROR; }
+
+	CF_HttpsResult result = cf_https_process(fetch->https);
 	switch (result) {
-		case CF_HTTPS_RESULT_PENDING: return SNET_FETCH_PENDING;
-		case CF_HTTPS_RESULT_OK: return SNET_FETCH_FINISHED;
-		default: return SNET_FETCH_ERROR;
+		case CF_HTTPS_RESULT_PENDING:
+			return SNET_FETCH_PENDING;
+		case CF_HTTPS_RESULT_OK:
+			fetch->stage = SNET_FETCH_STAGE_FINISHED;
+			return SNET_FETCH_FINISHED;
+		default:
+			return SNET_FETCH_ERROR;
 	}
 }
 
 int
 snet_fetch_status_code(snet_fetch_t* fetch) {
 	if (fetch == NULL) { return 0; }
+	if (fetch->pool != NULL) { return fetch->status_code; }
+	if (fetch->https.id == 0) { return 0; }
 
-	CF_HttpsRequest request = { .id = (uintptr_t)fetch };
-	CF_HttpsResponse response = cf_https_response(request);
+	CF_HttpsResponse response = cf_https_response(fetch->https);
 	return cf_https_response_code(response);
 }
 
+bool
+snet_fetch_is_streaming(snet_fetch_t* fetch) {
+	return fetch != NULL && fetch->pool != NULL && fetch->stream_body;
+}
+
 const void*
 snet_fetch_response_body(snet_fetch_t* fetch, size_t* size) {
 	if (fetch == NULL) { return NULL; }
 
-	CF_HttpsRequest request = { .id = (uintptr_t)fetch };
-	CF_HttpsResponse response = cf_https_response(request);
+	if (fetch->pool != NULL) {
+		if (size) { *size = fetch->body.size; }
+		return fetch->body.ptr;
+	}
+
+	if (fetch->https.id == 0) {
+		if (size) { *size = 0; }
+		return NULL;
+	}
+
+	CF_HttpsResponse response = cf_https_response(fetch->https);
 	if (size) { *size = cf_https_response_content_length(response); }
 	return cf_https_response_content(response);
 }
 
+const char*
+snet_fetch_response_header(snet_fetch_t* fetch, const char* name, size_t* size) {
+	// cf_https does not expose response headers
+	if (fetch == NULL || fetch->pool == NULL) { return NULL; }
+
+	return snet_fetch_find_header(fetch->headers.ptr, fetch->headers.size, name, size);
+}
+
+const void*
+snet_fetch_read_body(snet_fetch_t* fetch, size_t* size) {
+	*size = 0;
+	if (fetch == NULL) { return NULL; }
+
+	// cf_https only hands out the body once it is complete
+	if (fetch->pool == NULL && fetch->stage != SNET_FETCH_STAGE_FINISHED) { return NULL; }
+
+	size_t body_size;
+	const char* body = snet_fetch_response_body(fetch, &body_size);
+	if (body == NULL || body_size <= fetch->body_read) { return NULL; }
+
+	const char* chunk = body + fetch->body_read;
+	*size = body_size - fetch->body_read;
+	fetch->body_read = body_size;
+	return chunk;
+}
+
 void
 snet_fetch_end(snet_fetch_t* fetch) {
 	if (fetch == NULL) { return; }
 
-	CF_HttpsRequest request = { .id = (uintptr_t)fetch };
-	cf_https_destroy(request);
+	if (fetch->pool != NULL) {
+		// Abandoned mid-request, the connection state is unknown
+		snet_fetch_release_conn(fetch, false);
+		snet_fetch_buf_cleanup(&fetch->request);
+		snet_fetch_buf_cleanup(&fetch->headers);
+		snet_fetch_buf_cleanup(&fetch->response);
+		snet_fetch_buf_cleanup(&fetch->body);
+	} else if (fetch->https.id != 0) {
+		cf_https_destroy(fetch->https);
+	}
+
+	cf_free(fetch);
 }
 
 #else
 
 #include <emscripten/fetch.h>
-#include <string.h>
 #include <cute_array.h>
+#include <cute_alloc.h>
+
+// The browser already keeps connections alive and pools them per origin
+struct snet_fetch_pool_s {
+	snet_fetch_pool_config_t config;
+};
+
+snet_fetch_pool_t*
+snet_fetch_pool_init(const snet_fetch_pool_config_t* config) {
+	snet_fetch_pool_t* pool = cf_alloc(sizeof(snet_fetch_pool_t));
+	*pool = (snet_fetch_pool_t){
+		.config = *config,
+	};
+	return pool;
+}
+
+void
+snet_fetch_pool_cleanup(snet_fetch_pool_t* pool) {
+	cf_free(pool);
+}
+
+void
+snet_fetch_pool_update(snet_fetch_pool_t* pool) {
+}
+
+void
+snet_fetch_pool_preconnect(snet_fetch_pool_t* pool, const char* host, int port, bool plain) {
+}
+
+#define SNET_FETCH_MAX_HEADER_VALUE 512
+
+extern int
+snet_fetch_impl_begin(const char* method, const char* url, const char** headers, const void* content, size_t content_length);
+
+extern int
+snet_fetch_impl_state(int handle);
+
+extern int
+snet_fetch_impl_status_code(int handle);
+
+extern size_t
+snet_fetch_impl_available(int handle);
+
+extern size_t
+snet_fetch_impl_read(int handle, void* buf, size_t size);
+
+extern int
+snet_fetch_impl_header(int handle, const char* name, char* buf, size_t size);
+
+extern void
+snet_fetch_impl_end(int handle);
+
+struct snet_fetch_s {
+	// NULL for streamed requests which go through snet_fetch_impl_* instead
+	emscripten_fetch_t* handle;
+	size_t body_read;
+	char* headers;
+	size_t headers_size;
+
+	int stream;
+	char* stream_buf;
+	size_t stream_buf_capacity;
+	char header_value[SNET_FETCH_MAX_HEADER_VALUE];
+};
 
 snet_fetch_t*
 snet_fetch_begin(const snet_fetch_options_t* options) {
-	emscripten_fetch_attr_t fetch_attr;
-	emscripten_fetch_attr_init(&fetch_attr);
-
-	strcpy(fetch_attr.requestMethod, options->method == SNET_FETCH_POST ? "POST" : "GET");
-	fetch_attr.requestData = options->content;
-	fetch_attr.requestDataSize = options->content_length;
-	fetch_attr.attributes = EMSCRIPTEN_FETCH_LOAD_TO_MEMORY | EMSCRIPTEN_FETCH_REPLACE;
+	const char* method = options->method == SNET_FETCH_POST ? "POST" : "GET";
 
 	dyna const char** headers = NULL;
 	for (int i = 0; options->headers != NULL && options->headers[i].name != NULL; ++i) {
@@ -95,20 +958,46 @@ snet_fetch_begin(const snet_fetch_options_t* options) {
 		apush(headers, options->headers[i].value);
 	}
 	apush(headers, NULL);
-	fetch_attr.requestHeaders = headers;
 
 	char url[1024];
-	snprintf(url, sizeof(url), "https://%s:%d%s", options->host, options->port, options->path);
+	snprintf(
+		url, sizeof(url), "%s://%s:%d%s",
+		options->plain_http ? "http" : "https", options->host, options->port, options->path
+	);
+
+	snet_fetch_t* fetch = cf_alloc(sizeof(snet_fetch_t));
+	*fetch = (snet_fetch_t){ 0 };
+
+	if (options->stream_body) {
+		fetch->stream = snet_fetch_impl_begin(method, url, headers, options->content, options->content_length);
+	} else {
+		emscripten_fetch_attr_t fetch_attr;
+		emscripten_fetch_attr_init(&fetch_attr);
+
+		strcpy(fetch_attr.requestMethod, method);
+		fetch_attr.requestData = options->content;
+		fetch_attr.requestDataSize = options->content_length;
+		fetch_attr.attributes = EMSCRIPTEN_FETCH_LOAD_TO_MEMORY | EMSCRIPTEN_FETCH_REPLACE;
+		fetch_attr.requestHeaders = headers;
 
-	emscripten_fetch_t* fetch = emscripten_fetch(&fetch_attr, url);
+		fetch->handle = emscripten_fetch(&fetch_attr, url);
+	}
 	afree(headers);
 
-	return (snet_fetch_t*)fetch;
+	return fetch;
 }
 
 snet_fetch_status_t
 snet_fetch_process(snet_fetch_t* fetch_in) {
-	emscripten_fetch_t* fetch = (emscripten_fetch_t*)fetch_in;
+	if (fetch_in->handle == NULL) {
+		switch (snet_fetch_impl_state(fetch_in->stream)) {
+			case 0: return SNET_FETCH_PENDING;
+			case 1: return SNET_FETCH_FINISHED;
+			default: return SNET_FETCH_ERROR;
+		}
+	}
+
+	emscripten_fetch_t* fetch = fetch_in->handle;
 	if (fetch->readyState != 4) {
 		return SNET_FETCH_PENDING;
 	} else if (fetch->status == 0) {
@@ -120,20 +1009,101 @@ snet_fetch_process(snet_fetch_t* fetch_in) {
 
 int
 snet_fetch_status_code(snet_fetch_t* fetch_in) {
-	emscripten_fetch_t* fetch = (emscripten_fetch_t*)fetch_in;
+	if (fetch_in->handle == NULL) {
+		return snet_fetch_impl_status_code(fetch_in->stream);
+	}
+
+	emscripten_fetch_t* fetch = fetch_in->handle;
 	return fetch->status;
 }
 
+bool
+snet_fetch_is_streaming(snet_fetch_t* fetch) {
+	return fetch->handle == NULL;
+}
+
 const void*
 snet_fetch_response_body(snet_fetch_t* fetch_in, size_t* size) {
-	emscripten_fetch_t* fetch = (emscripten_fetch_t*)fetch_in;
+	if (fetch_in->handle == NULL) {
+		return snet_fetch_read_body(fetch_in, size);
+	}
+
+	emscripten_fetch_t* fetch = fetch_in->handle;
 	*size = fetch->numBytes;
 	return fetch->data;
 }
 
+const char*
+snet_fetch_response_header(snet_fetch_t* fetch_in, const char* name, size_t* size) {
+	if (fetch_in->handle == NULL) {
+		int length = snet_fetch_impl_header(
+			fetch_in->stream, name,
+			fetch_in->header_value, sizeof(fetch_in->header_value)
+		);
+		if (length < 0) { return NULL; }
+
+		*size = (size_t)length;
+		return fetch_in->header_value;
+	}
+
+	emscripten_fetch_t* fetch = fetch_in->handle;
+	if (fetch->readyState < 2) { return NULL; }  // HEADERS_RECEIVED
+
+	if (fetch_in->headers == NULL) {
+		size_t headers_size = emscripten_fetch_get_response_headers_length(fetch);
+		fetch_in->headers = cf_alloc(headers_size + 1);
+		fetch_in->headers_size = emscripten_fetch_get_response_headers(fetch, fetch_in->headers, headers_size + 1);
+	}
+
+	return snet_fetch_find_header(fetch_in->headers, fetch_in->headers_size, name, size);
+}
+
+const void*
+snet_fetch_read_body(snet_fetch_t* fetch_in, size_t* size) {
+	if (fetch_in->handle == NULL) {
+		// Drain everything that has arrived so a finished request never leaves
+		// anything behind
+		size_t available = snet_fetch_impl_available(fetch_in->stream);
+		if (available == 0) {
+			*size = 0;
+			return NULL;
+		}
+
+		if (available > fetch_in->stream_buf_capacity) {
+			cf_free(fetch_in->stream_buf);
+			fetch_in->stream_buf = cf_alloc(available);
+			fetch_in->stream_buf_capacity = available;
+		}
+
+		*size = snet_fetch_impl_read(fetch_in->stream, fetch_in->stream_buf, available);
+		return fetch_in->stream_buf;
+	}
+
+	// The body is only available once the XHR is done
+	emscripten_fetch_t* fetch = fetch_in->handle;
+	if (fetch->readyState != 4 || fetch->numBytes <= fetch_in->body_read) {
+		*size = 0;
+		return NULL;
+	}
+
+	const char* chunk = fetch->data + fetch_in->body_read;
+	*size = fetch->numBytes - fetch_in->body_read;
+	fetch_in->body_read = fetch->numBytes;
+	return chunk;
+}
+
 void
 snet_fetch_end(snet_fetch_t* fetch) {
-	emscripten_fetch_close((emscripten_fetch_t*)fetch);
+	if (fetch == NULL) { return; }
+
+	if (fetch->handle != NULL) {
+		emscripten_fetch_close(fetch->handle);
+	} else {
+		snet_fetch_impl_end(fetch->stream);
+	}
+	cf_free(fetch->headers);
+	cf_free(fetch->stream_buf);
+	cf_free(fetch);
 }
 
 #endif
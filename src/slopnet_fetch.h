@@ -5,6 +5,7 @@
 #include <stdbool.h>
 
 typedef struct snet_fetch_s snet_fetch_t;
+typedef struct snet_fetch_pool_s snet_fetch_pool_t;
 
 typedef enum {
 	SNET_FETCH_GET,
@@ -22,9 +23,18 @@ typedef struct {
 	const char* value;
 } snet_fetch_header_t;
 
+typedef struct {
+	// Idle connections are closed after this many seconds
+	double idle_timeout;
+} snet_fetch_pool_config_t;
+
 typedef struct {
 	snet_fetch_method_t method;
 
+	// Keep-alive connections are taken from and returned to this pool.
+	// NULL means a new connection for every request.
+	snet_fetch_pool_t* pool;
+
 	const char* host;
 	const char* path;
 	int port;
@@ -35,8 +45,30 @@ typedef struct {
 	size_t content_length;
 
 	bool verify_tls;
+	// Natively, this requires a pool
+	bool plain_http;
+
+	// Do not buffer the whole body, read it with snet_fetch_read_body as it
+	// arrives instead
+	bool stream_body;
 } snet_fetch_options_t;
 
+snet_fetch_pool_t*
+snet_fetch_pool_init(const snet_fetch_pool_config_t* config);
+
+void
+snet_fetch_pool_cleanup(snet_fetch_pool_t* pool);
+
+void
+snet_fetch_pool_update(snet_fetch_pool_t* pool);
+
+// Opens a connection in the background unless an idle one is already there
+// so the next request skips the handshake.
+// Name resolution happens right away and blocks.
+// Does nothing on the web where the browser manages connections.
+void
+snet_fetch_pool_preconnect(snet_fetch_pool_t* pool, const char* host, int port, bool plain);
+
 snet_fetch_t*
 snet_fetch_begin(const snet_fetch_options_t* options);
 
@@ -46,9 +78,25 @@ snet_fetch_process(snet_fetch_t* fetch);
 int
 snet_fetch_status_code(snet_fetch_t* fetch);
 
+// Whether snet_fetch_read_body hands out the body as it arrives.
+// Only true if stream_body was requested and the backend supports it.
+bool
+snet_fetch_is_streaming(snet_fetch_t* fetch);
+
 const void*
 snet_fetch_response_body(snet_fetch_t* fetch, size_t* size);
 
+// The value is not null-terminated.
+// Returns NULL if the header is missing or the backend does not expose it.
+const char*
+snet_fetch_response_header(snet_fetch_t* fetch, const char* name, size_t* size);
+
+// Returns the body bytes received since the last call, valid until the next
+// call to snet_fetch_process or snet_fetch_read_body.
+// Backends which cannot stream return the whole body once it has arrived.
+const void*
+snet_fetch_read_body(snet_fetch_t* fetch, size_t* size);
+
 void
 snet_fetch_end(snet_fetch_t* fetch);
 
@@ -0,0 +1,131 @@
+// Streaming requests.
+// emscripten_fetch is built on XHR which only hands out the body once it is
+// complete so streamed bodies go through fetch() instead.
+// See: https://emscripten.org/docs/porting/connecting_cpp_and_javascript/Interacting-with-code.html#javascript-limits-in-library-files
+addToLibrary({
+	$snet_fetch_init__postset: 'snet_fetch_init();',
+	$snet_fetch_init: () => {
+		const handles = new Map();
+		let nextHandle = 0;
+
+		_snet_fetch_impl_begin = (method, url, headers, content, contentLength) => {
+			const handle = nextHandle++;
+			const request = {
+				state: 0,
+				status: 0,
+				headers: null,
+				chunks: [],
+				numBytes: 0,
+				abortController: new AbortController(),
+			};
+			handles.set(handle, request);
+
+			const requestHeaders = new Headers();
+			for (let i = headers >> 2; HEAPU32[i] !== 0; i += 2) {
+				requestHeaders.append(UTF8ToString(HEAPU32[i]), UTF8ToString(HEAPU32[i + 1]));
+			}
+
+			const init = {
+				method: UTF8ToString(method),
+				headers: requestHeaders,
+				signal: request.abortController.signal,
+			};
+			if (contentLength > 0) {
+				// The body is sent asynchronously so it has to be copied
+				init.body = HEAPU8.slice(content, content + contentLength);
+			}
+
+			start(request, UTF8ToString(url), init).then(() => {
+				request.state = 1;
+			}).catch(() => {
+				request.state = 2;
+			});
+
+			return handle;
+		};
+
+		const start = async (request, url, init) => {
+			const response = await fetch(url, init);
+			request.status = response.status;
+			request.headers = response.headers;
+
+			const reader = response.body.getReader();
+			while (true) {
+				const { value, done } = await reader.read();
+				if (done) { break; }
+
+				request.chunks.push(value);
+				request.numBytes += value.length;
+			}
+		};
+
+		_snet_fetch_impl_state = (handle) => {
+			const request = handles.get(handle);
+			return request ? request.state : 2;
+		};
+
+		_snet_fetch_impl_status_code = (handle) => {
+			const request = handles.get(handle);
+			return request ? request.status : 0;
+		};
+
+		_snet_fetch_impl_available = (handle) => {
+			const request = handles.get(handle);
+			return request ? request.numBytes : 0;
+		};
+
+		_snet_fetch_impl_read = (handle, buf, size) => {
+			const request = handles.get(handle);
+			if (!request) { return 0; }
+
+			let numRead = 0;
+			while (numRead < size && request.chunks.length > 0) {
+				const chunk = request.chunks[0];
+				const numCopied = Math.min(size - numRead, chunk.length);
+				HEAPU8.set(chunk.subarray(0, numCopied), buf + numRead);
+				numRead += numCopied;
+
+				if (numCopied === chunk.length) {
+					request.chunks.shift();
+				} else {
+					request.chunks[0] = chunk.subarray(numCopied);
+				}
+			}
+
+			request.numBytes -= numRead;
+			return numRead;
+		};
+
+		_snet_fetch_impl_header = (handle, name, buf, size) => {
+			const request = handles.get(handle);
+			if (!request || request.headers === null) { return -1; }
+
+			const value = request.headers.get(UTF8ToString(name));
+			if (value === null) { return -1; }
+
+			return stringToUTF8(value, buf, size);
+		};
+
+		_snet_fetch_impl_end = (handle) => {
+			const request = handles.get(handle);
+			if (request) {
+				handles.delete(handle);
+				request.abortController.abort();
+			}
+		};
+	},
+	snet_fetch_impl_begin: () => {},
+	snet_fetch_impl_begin__deps: ['$snet_fetch_init'],
+	snet_fetch_impl_state: () => {},
+	snet_fetch_impl_state__deps: ['$snet_fetch_init'],
+	snet_fetch_impl_status_code: () => {},
+	snet_fetch_impl_status_code__deps: ['$snet_fetch_init'],
+	snet_fetch_impl_available: () => {},
+	snet_fetch_impl_available__deps: ['$snet_fetch_init'],
+	snet_fetch_impl_read: () => {},
+	snet_fetch_impl_read__deps: ['$snet_fetch_init'],
+	snet_fetch_impl_header: () => {},
+	snet_fetch_impl_header__deps: ['$snet_fetch_init'],
+	snet_fetch_impl_end: () => {},
+	snet_fetch_impl_end__deps: ['$snet_fetch_init'],
+});
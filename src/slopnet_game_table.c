@@ -0,0 +1,323 @@
+#include "slopnet_game_table.h"
+#include "slopnet_test.h"
+#include <cute_alloc.h>
+#include <string.h>
+
+#define SNET_GAME_TABLE_EMPTY_SLOT -1
+
+static uint32_t
+snet_game_table_hash(snet_blob_t key) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	const unsigned char* bytes = key.ptr;
+	for (size_t i = 0; i < key.size; ++i) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static bool
+snet_blob_equal(snet_blob_t lhs, snet_blob_t rhs) {
+	return lhs.size == rhs.size
+		&& (lhs.size == 0 || memcmp(lhs.ptr, rhs.ptr, lhs.size) == 0);
+}
+
+static snet_blob_t
+snet_game_table_copy_blob(char** itr, snet_blob_t blob) {
+	char* copy = *itr;
+	if (blob.size > 0) { memcpy(copy, blob.ptr, blob.size); }
+	copy[blob.size] = '\0';
+	*itr += blob.size + 1;
+
+	return (snet_blob_t){ .ptr = copy, .size = blob.size };
+}
+
+// The join token comes first so its pointer is also the allocation
+static snet_game_info_t
+snet_game_table_make_entry(const snet_game_info_t* info) {
+	size_t size = info->join_token.size + 1 + info->creator.size + 1 + info->data.size + 1;
+	char* itr = cf_alloc(size);
+
+	snet_game_info_t entry;
+	entry.join_token = snet_game_table_copy_blob(&itr, info->join_token);
+	entry.creator = snet_game_table_copy_blob(&itr, info->creator);
+	entry.data = snet_game_table_copy_blob(&itr, info->data);
+	return entry;
+}
+
+static void
+snet_game_table_bury(snet_game_table_t* table, const snet_game_info_t* entry) {
+	if (table->num_graveyard >= table->graveyard_capacity) {
+		table->graveyard_capacity = table->graveyard_capacity > 0 ? table->graveyard_capacity * 2 : 16;
+		table->graveyard = cf_realloc(table->graveyard, sizeof(void*) * table->graveyard_capacity);
+	}
+
+	table->graveyard[table->num_graveyard++] = (void*)entry->join_token.ptr;
+}
+
+static int
+snet_game_table_find_slot(snet_game_table_t* table, snet_blob_t join_token) {
+	if (table->index_capacity == 0) { return -1; }
+
+	uint32_t mask = (uint32_t)table->index_capacity - 1;
+	for (uint32_t slot = snet_game_table_hash(join_token) & mask;; slot = (slot + 1) & mask) {
+		int32_t dense_index = table->index[slot];
+		if (dense_index == SNET_GAME_TABLE_EMPTY_SLOT) { return -1; }
+
+		if (snet_blob_equal(table->games[dense_index].join_token, join_token)) {
+			return (int)slot;
+		}
+	}
+}
+
+static void
+snet_game_table_index_insert(snet_game_table_t* table, int32_t dense_index) {
+	uint32_t mask = (uint32_t)table->index_capacity - 1;
+	uint32_t slot = snet_game_table_hash(table->games[dense_index].join_token) & mask;
+	while (table->index[slot] != SNET_GAME_TABLE_EMPTY_SLOT) {
+		slot = (slot + 1) & mask;
+	}
+	table->index[slot] = dense_index;
+}
+
+static void
+snet_game_table_index_remove(snet_game_table_t* table, int slot) {
+	// Backward shift deletion so that no tombstone is needed
+	uint32_t mask = (uint32_t)table->index_capacity - 1;
+	uint32_t hole = (uint32_t)slot;
+	for (uint32_t next = (hole + 1) & mask; table->index[next] != SNET_GAME_TABLE_EMPTY_SLOT; next = (next + 1) & mask) {
+		uint32_t ideal = snet_game_table_hash(table->games[table->index[next]].join_token) & mask;
+		if (((next - ideal) & mask) >= ((next - hole) & mask)) {
+			table->index[hole] = table->index[next];
+			hole = next;
+		}
+	}
+	table->index[hole] = SNET_GAME_TABLE_EMPTY_SLOT;
+}
+
+static void
+snet_game_table_reserve(snet_game_table_t* table, int num_games) {
+	if (num_games > table->capacity) {
+		table->capacity = table->capacity > 0 ? table->capacity * 2 : 64;
+		table->games = cf_realloc(table->games, sizeof(snet_game_info_t) * table->capacity);
+		table->generations = cf_realloc(table->generations, sizeof(uint32_t) * table->capacity);
+	}
+
+	// Keep the load factor under 1/2
+	if (num_games * 2 > table->index_capacity) {
+		cf_free(table->index);
+		table->index_capacity = table->index_capacity > 0 ? table->index_capacity * 2 : 128;
+		table->index = cf_alloc(sizeof(int32_t) * table->index_capacity);
+		for (int i = 0; i < table->index_capacity; ++i) {
+			table->index[i] = SNET_GAME_TABLE_EMPTY_SLOT;
+		}
+		for (int i = 0; i < table->num_games; ++i) {
+			snet_game_table_index_insert(table, i);
+		}
+	}
+}
+
+static void
+snet_game_table_remove_at(snet_game_table_t* table, int slot, snet_game_info_t* removed) {
+	int32_t dense_index = table->index[slot];
+	snet_game_table_index_remove(table, slot);
+
+	*removed = table->games[dense_index];
+	snet_game_table_bury(table, removed);
+
+	int32_t last = table->num_games - 1;
+	if (dense_index != last) {
+		int last_slot = snet_game_table_find_slot(table, table->games[last].join_token);
+		table->games[dense_index] = table->games[last];
+		table->generations[dense_index] = table->generations[last];
+		table->index[last_slot] = dense_index;
+	}
+	table->num_games -= 1;
+}
+
+void
+snet_game_table_init(snet_game_table_t* table) {
+	*table = (snet_game_table_t){ 0 };
+}
+
+void
+snet_game_table_cleanup(snet_game_table_t* table) {
+	for (int i = 0; i < table->num_games; ++i) {
+		cf_free((void*)table->games[i].join_token.ptr);
+	}
+	snet_game_table_collect_garbage(table);
+
+	cf_free(table->games);
+	cf_free(table->generations);
+	cf_free(table->index);
+	cf_free(table->graveyard);
+	*table = (snet_game_table_t){ 0 };
+}
+
+const snet_game_info_t*
+snet_game_table_find(snet_game_table_t* table, snet_blob_t join_token) {
+	int slot = snet_game_table_find_slot(table, join_token);
+	return slot >= 0 ? &table->games[table->index[slot]] : NULL;
+}
+
+snet_game_table_change_t
+snet_game_table_put(snet_game_table_t* table, const snet_game_info_t* info, const snet_game_info_t** entry) {
+	int slot = snet_game_table_find_slot(table, info->join_token);
+	if (slot >= 0) {
+		int32_t dense_index = table->index[slot];
+		snet_game_info_t* existing = &table->games[dense_index];
+		table->generations[dense_index] = table->generation;
+		*entry = existing;
+
+		if (
+			snet_blob_equal(existing->creator, info->creator)
+			&& snet_blob_equal(existing->data, info->data)
+		) {
+			return SNET_GAME_TABLE_UNCHANGED;
+		}
+
+		// The join token stays the same so the index is still valid
+		snet_game_table_bury(table, existing);
+		*existing = snet_game_table_make_entry(info);
+		return SNET_GAME_TABLE_UPDATED;
+	}
+
+	snet_game_table_reserve(table, table->num_games + 1);
+
+	int32_t dense_index = table->num_games++;
+	table->games[dense_index] = snet_game_table_make_entry(info);
+	table->generations[dense_index] = table->generation;
+	snet_game_table_index_insert(table, dense_index);
+
+	*entry = &table->games[dense_index];
+	return SNET_GAME_TABLE_ADDED;
+}
+
+bool
+snet_game_table_remove(snet_game_table_t* table, snet_blob_t join_token, snet_game_info_t* removed) {
+	int slot = snet_game_table_find_slot(table, join_token);
+	if (slot < 0) { return false; }
+
+	snet_game_table_remove_at(table, slot, removed);
+	return true;
+}
+
+void
+snet_game_table_begin_sync(snet_game_table_t* table) {
+	table->generation += 1;
+}
+
+void
+snet_game_table_sweep(
+	snet_game_table_t* table,
+	void (*removed)(const snet_game_info_t* info, void* ctx),
+	void* ctx
+) {
+	// Go backward so the swap with the last entry never skips one
+	for (int i = table->num_games - 1; i >= 0; --i) {
+		if (table->generations[i] == table->generation) { continue; }
+
+		snet_game_info_t info;
+		int slot = snet_game_table_find_slot(table, table->games[i].join_token);
+		snet_game_table_remove_at(table, slot, &info);
+		removed(&info, ctx);
+	}
+}
+
+void
+snet_game_table_collect_garbage(snet_game_table_t* table) {
+	for (int i = 0; i < table->num_graveyard; ++i) {
+		cf_free(table->graveyard[i]);
+	}
+	table->num_graveyard = 0;
+}
+
+#if SNET_ENABLE_TESTS
+
+#define SNET_GAME_TABLE_TEST_NUM_GAMES 500
+
+static snet_game_info_t
+snet_game_table_test_info(char* token, int id, const char* data) {
+	snprintf(token, 16, "game%d", id);
+	return (snet_game_info_t){
+		.join_token = { .ptr = token, .size = strlen(token) },
+		.creator = { .ptr = "creator", .size = 7 },
+		.data = { .ptr = data, .size = strlen(data) },
+	};
+}
+
+static void
+snet_game_table_test_count_removed(const snet_game_info_t* info, void* ctx) {
+	(void)info;
+	*(int*)ctx += 1;
+}
+
+void
+snet_game_table_test(void) {
+	snet_game_table_t table;
+	snet_game_table_init(&table);
+
+	char token[16];
+	const snet_game_info_t* entry;
+	for (int i = 0; i < SNET_GAME_TABLE_TEST_NUM_GAMES; ++i) {
+		snet_game_info_t info = snet_game_table_test_info(token, i, "v1");
+		snet_check(snet_game_table_put(&table, &info, &entry) == SNET_GAME_TABLE_ADDED);
+		snet_check(entry->join_token.ptr != token);
+		snet_check(snet_blob_equal(entry->join_token, info.join_token));
+	}
+	snet_check(table.num_games == SNET_GAME_TABLE_TEST_NUM_GAMES);
+
+	for (int i = 0; i < SNET_GAME_TABLE_TEST_NUM_GAMES; ++i) {
+		snet_game_info_t info = snet_game_table_test_info(token, i, i % 2 == 0 ? "v1" : "v2");
+		snet_check(
+			snet_game_table_put(&table, &info, &entry)
+			== (i % 2 == 0 ? SNET_GAME_TABLE_UNCHANGED : SNET_GAME_TABLE_UPDATED)
+		);
+	}
+
+	// Removal shifts other entries around in both the index and the array
+	int num_games = SNET_GAME_TABLE_TEST_NUM_GAMES;
+	for (int i = 0; i < SNET_GAME_TABLE_TEST_NUM_GAMES; i += 3) {
+		snet_game_info_t info = snet_game_table_test_info(token, i, "");
+		snet_game_info_t removed;
+		snet_check(snet_game_table_remove(&table, info.join_token, &removed));
+		snet_check(snet_blob_equal(removed.join_token, info.join_token));
+		snet_check(!snet_game_table_remove(&table, info.join_token, &removed));
+		num_games -= 1;
+	}
+	snet_check(table.num_games == num_games);
+
+	for (int i = 0; i < SNET_GAME_TABLE_TEST_NUM_GAMES; ++i) {
+		snet_game_info_t info = snet_game_table_test_info(token, i, "");
+		const snet_game_info_t* found = snet_game_table_find(&table, info.join_token);
+		if (i % 3 == 0) {
+			snet_check(found == NULL);
+		} else {
+			snet_check(found != NULL);
+			snet_check(strcmp(found->data.ptr, i % 2 == 0 ? "v1" : "v2") == 0);
+		}
+	}
+
+	// Only the even games are still listed
+	snet_game_table_begin_sync(&table);
+	int num_kept = 0;
+	for (int i = 0; i < SNET_GAME_TABLE_TEST_NUM_GAMES; i += 2) {
+		snet_game_info_t info = snet_game_table_test_info(token, i, "v1");
+		snet_game_table_put(&table, &info, &entry);
+		num_kept += 1;
+	}
+	int num_removed = 0;
+	snet_game_table_sweep(&table, snet_game_table_test_count_removed, &num_removed);
+	snet_check(table.num_games == num_kept);
+	snet_check(num_removed + num_kept == num_games + (SNET_GAME_TABLE_TEST_NUM_GAMES + 5) / 6);
+	for (int i = 1; i < SNET_GAME_TABLE_TEST_NUM_GAMES; i += 2) {
+		snet_game_info_t info = snet_game_table_test_info(token, i, "");
+		snet_check(snet_game_table_find(&table, info.join_token) == NULL);
+	}
+
+	snet_game_table_collect_garbage(&table);
+	snet_game_table_cleanup(&table);
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SLOPNET_GAME_TABLE_H
+#define SLOPNET_GAME_TABLE_H
+
+#include <slopnet.h>
+#include <stdint.h>
+
+// Games indexed by join token.
+// Games are kept densely packed so the whole table can be handed out as an
+// array.
+// Each game owns one allocation holding its strings.
+// Replaced and removed allocations are only freed by
+// snet_game_table_collect_garbage so they can still be referenced by events
+// which have not been consumed.
+typedef struct {
+	snet_game_info_t* games;
+	uint32_t* generations;
+	int num_games;
+	int capacity;
+
+	int32_t* index;
+	int index_capacity;
+
+	void** graveyard;
+	int num_graveyard;
+	int graveyard_capacity;
+
+	uint32_t generation;
+} snet_game_table_t;
+
+typedef enum {
+	SNET_GAME_TABLE_UNCHANGED,
+	SNET_GAME_TABLE_ADDED,
+	SNET_GAME_TABLE_UPDATED,
+} snet_game_table_change_t;
+
+void
+snet_game_table_init(snet_game_table_t* table);
+
+void
+snet_game_table_cleanup(snet_game_table_t* table);
+
+const snet_game_info_t*
+snet_game_table_find(snet_game_table_t* table, snet_blob_t join_token);
+
+// Adds or updates a game.
+// *entry receives the stored copy.
+snet_game_table_change_t
+snet_game_table_put(snet_game_table_t* table, const snet_game_info_t* info, const snet_game_info_t** entry);
+
+// Returns false if the game was not in the table
+bool
+snet_game_table_remove(snet_game_table_t* table, snet_blob_t join_token, snet_game_info_t* removed);
+
+// Marks the start of a full snapshot.
+// Every game which is not put again before snet_game_table_sweep is removed
+// by it.
+void
+snet_game_table_begin_sync(snet_game_table_t* table);
+
+void
+snet_game_table_sweep(
+	snet_game_table_t* table,
+	void (*removed)(const snet_game_info_t* info, void* ctx),
+	void* ctx
+);
+
+void
+snet_game_table_collect_garbage(snet_game_table_t* table);
+
+#endif
@@ -0,0 +1,266 @@
+#include <slopnet.h>
+#include <cute_alloc.h>
+#include <cute_array.h>
+#include <SDL3/SDL_thread.h>
+#include <SDL3/SDL_mutex.h>
+#include <stdatomic.h>
+#include "slopnet_shared.h"
+#include "slopnet_time.h"
+#include "slopnet_msg_ring.h"
+
+// More shards than threads so a thread which finishes early can take over
+// work from the others
+#define SNET_GROUP_SHARDS_PER_THREAD 4
+
+typedef struct {
+	snet_t* snet;
+	void* userdata;
+} snet_group_member_t;
+
+// Shards sit next to each other in one array and are padded rather than
+// aligned since cf_alloc does not honour extended alignment
+typedef struct {
+	char pad[SNET_CACHE_LINE_SIZE];
+
+	// Only touched by the thread holding the shard
+	snet_shared_t* shared;
+	dyna snet_group_member_t* members;
+
+	int num_authorized;
+	int num_in_game;
+	uint64_t num_messages_received;
+	uint64_t num_bytes_received;
+	double update_time;
+} snet_group_shard_t;
+
+struct snet_group_s {
+	snet_group_config_t config;
+
+	snet_group_shard_t* shards;
+	int num_shards;
+	int num_instances;
+
+	// Counters of removed instances
+	uint64_t num_messages_sent;
+	uint64_t num_bytes_sent;
+
+	SDL_Thread** workers;
+	int num_workers;
+	SDL_Semaphore* start;
+	SDL_Semaphore* done;
+	atomic_bool quit;
+
+	// Taken by every worker so it gets cache lines of its own
+	char pad0[SNET_CACHE_LINE_SIZE];
+	atomic_int next_shard;
+	char pad1[SNET_CACHE_LINE_SIZE];
+
+	double update_time;
+};
+
+static void
+snet_group_update_shard(snet_group_t* group, snet_group_shard_t* shard) {
+	double start_time = snet_seconds();
+	const snet_group_config_t* config = &group->config;
+
+	snet_shared_update(shard->shared);
+
+	shard->num_authorized = 0;
+	shard->num_in_game = 0;
+	for (int i = 0; i < alen(shard->members); ++i) {
+		snet_group_member_t* member = &shard->members[i];
+		snet_update(member->snet);
+
+		const snet_event_t* event;
+		while ((event = snet_next_event(member->snet)) != NULL) {
+			if (event->type == SNET_EVENT_MESSAGE) {
+				shard->num_messages_received += 1;
+				shard->num_bytes_received += event->message.data.size;
+			}
+
+			if (config->event != NULL) {
+				config->event(member->snet, event, member->userdata, config->userdata);
+			}
+		}
+
+		if (config->update != NULL) {
+			config->update(member->snet, member->userdata, config->userdata);
+		}
+
+		shard->num_authorized += snet_auth_state(member->snet) == SNET_AUTHORIZED;
+		shard->num_in_game += snet_lobby_state(member->snet) == SNET_JOINED_GAME;
+	}
+
+	shard->update_time = snet_seconds() - start_time;
+}
+
+static void
+snet_group_run(snet_group_t* group) {
+	int shard_index;
+	while ((shard_index = atomic_fetch_add(&group->next_shard, 1)) < group->num_shards) {
+		snet_group_update_shard(group, &group->shards[shard_index]);
+	}
+}
+
+static int
+snet_group_worker(void* userdata) {
+	snet_group_t* group = userdata;
+
+	while (true) {
+		SDL_WaitSemaphore(group->start);
+		if (atomic_load(&group->quit)) { break; }
+
+		snet_group_run(group);
+		SDL_SignalSemaphore(group->done);
+	}
+
+	return 0;
+}
+
+snet_group_t*
+snet_group_init(const snet_group_config_t* config) {
+	int num_workers = config->num_workers > 0 ? config->num_workers : 0;
+#ifdef __EMSCRIPTEN__
+	num_workers = 0;
+#endif
+
+	snet_group_t* group = cf_alloc(sizeof(snet_group_t));
+	*group = (snet_group_t){
+		.config = *config,
+		.num_shards = (num_workers + 1) * SNET_GROUP_SHARDS_PER_THREAD,
+		.num_workers = num_workers,
+	};
+	atomic_init(&group->quit, false);
+	atomic_init(&group->next_shard, 0);
+
+	group->shards = cf_alloc(sizeof(snet_group_shard_t) * group->num_shards);
+	for (int i = 0; i < group->num_shards; ++i) {
+		group->shards[i] = (snet_group_shard_t){
+			.shared = snet_shared_init(),
+		};
+	}
+
+	if (num_workers > 0) {
+		group->start = SDL_CreateSemaphore(0);
+		group->done = SDL_CreateSemaphore(0);
+		group->workers = cf_alloc(sizeof(SDL_Thread*) * num_workers);
+		for (int i = 0; i < num_workers; ++i) {
+			group->workers[i] = SDL_CreateThread(snet_group_worker, "slopnet group", group);
+		}
+	}
+
+	return group;
+}
+
+void
+snet_group_cleanup(snet_group_t* group) {
+	if (group->num_workers > 0) {
+		atomic_store(&group->quit, true);
+		for (int i = 0; i < group->num_workers; ++i) {
+			SDL_SignalSemaphore(group->start);
+		}
+		for (int i = 0; i < group->num_workers; ++i) {
+			SDL_WaitThread(group->workers[i], NULL);
+		}
+
+		cf_free(group->workers);
+		SDL_DestroySemaphore(group->start);
+		SDL_DestroySemaphore(group->done);
+	}
+
+	for (int i = 0; i < group->num_shards; ++i) {
+		snet_group_shard_t* shard = &group->shards[i];
+		for (int j = 0; j < alen(shard->members); ++j) {
+			snet_cleanup(shard->members[j].snet);
+		}
+		afree(shard->members);
+		snet_shared_cleanup(shard->shared);
+	}
+	cf_free(group->shards);
+
+	cf_free(group);
+}
+
+snet_t*
+snet_group_add(snet_group_t* group, void* instance_userdata) {
+	snet_group_shard_t* shard = &group->shards[0];
+	for (int i = 1; i < group->num_shards; ++i) {
+		if (alen(group->shards[i].members) < alen(shard->members)) {
+			shard = &group->shards[i];
+		}
+	}
+
+	snet_t* snet = snet_init_shared(&group->config.config, shard->shared);
+	apush(shard->members, ((snet_group_member_t){
+		.snet = snet,
+		.userdata = instance_userdata,
+	}));
+	group->num_instances += 1;
+
+	return snet;
+}
+
+void
+snet_group_remove(snet_group_t* group, snet_t* snet) {
+	for (int i = 0; i < group->num_shards; ++i) {
+		snet_group_shard_t* shard = &group->shards[i];
+		for (int j = 0; j < alen(shard->members); ++j) {
+			if (shard->members[j].snet != snet) { continue; }
+
+			uint64_t num_messages, num_bytes;
+			snet_send_counters(snet, &num_messages, &num_bytes);
+			group->num_messages_sent += num_messages;
+			group->num_bytes_sent += num_bytes;
+
+			snet_cleanup(snet);
+			shard->members[j] = shard->members[alen(shard->members) - 1];
+			apop(shard->members);
+			group->num_instances -= 1;
+			return;
+		}
+	}
+}
+
+void
+snet_group_update(snet_group_t* group) {
+	double start_time = snet_seconds();
+	atomic_store(&group->next_shard, 0);
+
+	for (int i = 0; i < group->num_workers; ++i) {
+		SDL_SignalSemaphore(group->start);
+	}
+	snet_group_run(group);
+	for (int i = 0; i < group->num_workers; ++i) {
+		SDL_WaitSemaphore(group->done);
+	}
+
+	group->update_time = snet_seconds() - start_time;
+}
+
+void
+snet_group_stats(snet_group_t* group, snet_group_stats_t* stats) {
+	*stats = (snet_group_stats_t){
+		.num_instances = group->num_instances,
+		.num_messages_sent = group->num_messages_sent,
+		.num_bytes_sent = group->num_bytes_sent,
+		.update_time = group->update_time,
+	};
+
+	for (int i = 0; i < group->num_shards; ++i) {
+		const snet_group_shard_t* shard = &group->shards[i];
+		stats->num_authorized += shard->num_authorized;
+		stats->num_in_game += shard->num_in_game;
+		stats->num_messages_received += shard->num_messages_received;
+		stats->num_bytes_received += shard->num_bytes_received;
+		if (shard->update_time > stats->max_shard_time) {
+			stats->max_shard_time = shard->update_time;
+		}
+
+		for (int j = 0; j < alen(shard->members); ++j) {
+			uint64_t num_messages, num_bytes;
+			snet_send_counters(shard->members[j].snet, &num_messages, &num_bytes);
+			stats->num_messages_sent += num_messages;
+			stats->num_bytes_sent += num_bytes;
+		}
+	}
+}
@@ -0,0 +1,662 @@
+#include "slopnet_io.h"
+#include "slopnet_msg_ring.h"
+#include "slopnet_game_table.h"
+#include "slopnet_shared.h"
+#include "slopnet_time.h"
+#include <cute_alloc.h>
+#include <cute_array.h>
+#include <SDL3/SDL_thread.h>
+#include <SDL3/SDL_mutex.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define SNET_IO_QUEUE_SIZE 1024
+#define SNET_IO_RING_BUF_SIZE (256 * 1024)
+// Larger items get their own allocation and only a pointer goes through the
+// ring
+#define SNET_IO_MAX_INLINE_SIZE (16 * 1024)
+// Every item in a ring starts at a multiple of this
+#define SNET_IO_ALIGNMENT 16
+#define SNET_IO_WAIT_MS 1
+
+// Commands and events are each one item holding the struct followed by
+// everything it points to
+typedef struct {
+	uint32_t watch_epoch;
+	snet_event_t event;
+} snet_io_event_t;
+
+// Items are written straight into a message ring.
+// Those which are too large or arrive while older ones are still waiting for
+// room are kept in their own allocation by the producer until the ring can
+// take a pointer to them so it never has to block.
+typedef struct {
+	snet_msg_ring_t ring;
+	dyna void** backlog;
+	int next_backlog;
+
+	// Consumer only, allocations of the items returned since the last release
+	dyna void** consumed;
+} snet_io_ring_t;
+
+typedef struct {
+	// NULL when the item follows the record in the ring
+	void* indirect;
+} snet_io_record_t;
+
+typedef struct {
+	const void* src;
+	snet_blob_t copy;
+} snet_io_shared_blob_t;
+
+struct snet_io_s {
+	snet_t* snet;
+	SDL_Thread* thread;
+	SDL_Semaphore* wake;
+	atomic_bool quit;
+
+	snet_io_ring_t commands;
+	snet_io_ring_t events;
+
+	atomic_int auth_state;
+	atomic_int lobby_state;
+	// Copied from the I/O thread's instance after every update
+	SDL_Mutex* clock_mutex;
+	snet_clock_t clock;
+
+	// I/O thread only
+	uint32_t io_watch_epoch;
+
+	// Game thread only
+	uint32_t watch_epoch;
+	bool reset_watched_games;
+	bool wake_pending;
+	snet_game_table_t watched_games;
+	// Point into the event ring until the next update
+	dyna snet_io_event_t** pending_events;
+	int next_event;
+	// Copied out of the ring and kept until the next one like a regular
+	// instance does
+	snet_io_event_t* list_games_result;
+	snet_io_event_t* create_game_result;
+	// Replaced results, freed on the next update
+	dyna snet_io_event_t** retired_results;
+};
+
+// Ring {{{
+
+static size_t
+snet_io_align(size_t size) {
+	return (size + SNET_IO_ALIGNMENT - 1) & ~(size_t)(SNET_IO_ALIGNMENT - 1);
+}
+
+static void
+snet_io_ring_init(snet_io_ring_t* ring) {
+	*ring = (snet_io_ring_t){ 0 };
+	snet_msg_ring_init(&ring->ring, SNET_IO_QUEUE_SIZE, SNET_IO_RING_BUF_SIZE);
+}
+
+// Returns the item or NULL if the ring is empty.
+// Items stay valid until snet_io_ring_release.
+static void*
+snet_io_ring_pop(snet_io_ring_t* ring) {
+	const void* message;
+	size_t size;
+	if (!snet_msg_ring_next(&ring->ring, &message, &size)) { return NULL; }
+
+	snet_io_record_t* record = (snet_io_record_t*)message;
+	if (record->indirect != NULL) {
+		apush(ring->consumed, record->indirect);
+		return record->indirect;
+	} else {
+		return (char*)record + snet_io_align(sizeof(snet_io_record_t));
+	}
+}
+
+static void
+snet_io_ring_release(snet_io_ring_t* ring) {
+	for (int i = 0; i < alen(ring->consumed); ++i) {
+		cf_free(ring->consumed[i]);
+	}
+	aclear(ring->consumed);
+	snet_msg_ring_release(&ring->ring);
+}
+
+static void
+snet_io_ring_cleanup(snet_io_ring_t* ring) {
+	while (snet_io_ring_pop(ring) != NULL) {}
+	snet_io_ring_release(ring);
+	for (int i = ring->next_backlog; i < alen(ring->backlog); ++i) {
+		cf_free(ring->backlog[i]);
+	}
+
+	afree(ring->backlog);
+	afree(ring->consumed);
+	snet_msg_ring_cleanup(&ring->ring);
+}
+
+static void
+snet_io_ring_flush(snet_io_ring_t* ring) {
+	while (ring->next_backlog < alen(ring->backlog)) {
+		snet_io_record_t* record = snet_msg_ring_reserve(&ring->ring, snet_io_align(sizeof(snet_io_record_t)));
+		if (record == NULL) { break; }
+
+		record->indirect = ring->backlog[ring->next_backlog++];
+	}
+
+	if (ring->next_backlog > 0 && ring->next_backlog == alen(ring->backlog)) {
+		aclear(ring->backlog);
+		ring->next_backlog = 0;
+	}
+}
+
+// Returns where an item of the given size should be written.
+// It is only visible to the consumer after snet_io_ring_commit.
+static void*
+snet_io_ring_push(snet_io_ring_t* ring, size_t size) {
+	// Order must be kept so nothing jumps ahead of the backlog
+	snet_io_ring_flush(ring);
+
+	size_t header_size = snet_io_align(sizeof(snet_io_record_t));
+	if (ring->next_backlog == alen(ring->backlog) && size <= SNET_IO_MAX_INLINE_SIZE) {
+		snet_io_record_t* record = snet_msg_ring_reserve(&ring->ring, header_size + snet_io_align(size));
+		if (record != NULL) {
+			record->indirect = NULL;
+			return (char*)record + header_size;
+		}
+	}
+
+	void* item = cf_alloc(size);
+	apush(ring->backlog, item);
+	return item;
+}
+
+static void
+snet_io_ring_commit(snet_io_ring_t* ring) {
+	snet_msg_ring_commit(&ring->ring);
+}
+
+// }}}
+
+// Copy {{{
+
+static size_t
+snet_io_blob_size(snet_blob_t blob) {
+	return blob.ptr != NULL ? blob.size + 1 : 0;
+}
+
+static snet_blob_t
+snet_io_copy_blob(char** itr, snet_blob_t blob) {
+	if (blob.ptr == NULL) { return blob; }
+
+	char* copy = *itr;
+	memcpy(copy, blob.ptr, blob.size);
+	copy[blob.size] = '\0';
+	*itr += blob.size + 1;
+
+	return (snet_blob_t){ .ptr = copy, .size = blob.size };
+}
+
+static size_t
+snet_io_game_size(const snet_game_info_t* game) {
+	return snet_io_blob_size(game->join_token)
+		+ snet_io_blob_size(game->creator)
+		+ snet_io_blob_size(game->data);
+}
+
+static snet_game_info_t
+snet_io_copy_game(char** itr, const snet_game_info_t* game) {
+	return (snet_game_info_t){
+		.join_token = snet_io_copy_blob(itr, game->join_token),
+		.creator = snet_io_copy_blob(itr, game->creator),
+		.data = snet_io_copy_blob(itr, game->data),
+	};
+}
+
+// Interned strings stay shared in the copy
+static snet_blob_t
+snet_io_copy_shared_blob(
+	char** itr,
+	snet_io_shared_blob_t* shared,
+	size_t capacity,
+	snet_blob_t blob
+) {
+	if (blob.ptr == NULL) { return blob; }
+
+	size_t mask = capacity - 1;
+	for (size_t slot = ((uintptr_t)blob.ptr >> 3) * 2654435761u & mask;; slot = (slot + 1) & mask) {
+		if (shared[slot].src == blob.ptr) {
+			return shared[slot].copy;
+		} else if (shared[slot].src == NULL) {
+			shared[slot].src = blob.ptr;
+			shared[slot].copy = snet_io_copy_blob(itr, blob);
+			return shared[slot].copy;
+		}
+	}
+}
+
+static void
+snet_io_copy_game_list(char** itr, snet_list_games_result_t* list) {
+	size_t games_size = sizeof(snet_game_info_t) * list->num_games;
+	snet_game_info_t* games = (snet_game_info_t*)*itr;
+	*itr += games_size;
+
+	size_t capacity = 16;
+	while (capacity < (size_t)list->num_games * 4) { capacity *= 2; }
+	snet_io_shared_blob_t* shared = cf_alloc(sizeof(snet_io_shared_blob_t) * capacity);
+	memset(shared, 0, sizeof(snet_io_shared_blob_t) * capacity);
+
+	for (int i = 0; i < list->num_games; ++i) {
+		const snet_game_info_t* game = &list->games[i];
+		games[i] = (snet_game_info_t){
+			.join_token = snet_io_copy_blob(itr, game->join_token),
+			.creator = snet_io_copy_shared_blob(itr, shared, capacity, game->creator),
+			.data = snet_io_copy_shared_blob(itr, shared, capacity, game->data),
+		};
+	}
+	cf_free(shared);
+
+	list->games = list->num_games > 0 ? games : NULL;
+	list->next_cursor = snet_io_copy_blob(itr, list->next_cursor);
+}
+
+static size_t
+snet_io_event_size(const snet_event_t* event) {
+	size_t size = sizeof(snet_io_event_t);
+	switch (event->type) {
+		case SNET_EVENT_LOGIN_FINISHED:
+			size += snet_io_blob_size(event->login.data);
+			break;
+		case SNET_EVENT_CREATE_GAME_FINISHED:
+			if (event->create_game.status == SNET_OK) {
+				size += snet_io_game_size(&event->create_game.info);
+			} else {
+				size += snet_io_blob_size(event->create_game.error);
+			}
+			break;
+		case SNET_EVENT_LIST_GAMES_FINISHED:
+			// Enough for the worst case where nothing is shared
+			size += sizeof(snet_game_info_t) * event->list_games.num_games;
+			for (int i = 0; i < event->list_games.num_games; ++i) {
+				size += snet_io_game_size(&event->list_games.games[i]);
+			}
+			size += snet_io_blob_size(event->list_games.next_cursor);
+			break;
+		case SNET_EVENT_JOIN_GAME_FINISHED:
+			size += snet_io_blob_size(event->join_game.error);
+			break;
+		case SNET_EVENT_MESSAGE:
+			size += snet_io_blob_size(event->message.data);
+			break;
+		case SNET_EVENT_STREAM_DATA:
+			size += snet_io_blob_size(event->stream.data);
+			break;
+		case SNET_EVENT_GAME_ADDED:
+		case SNET_EVENT_GAME_UPDATED:
+		case SNET_EVENT_GAME_REMOVED:
+			size += snet_io_game_size(&event->game);
+			break;
+		case SNET_EVENT_DISCONNECTED:
+		case SNET_EVENT_RECONNECTING:
+		case SNET_EVENT_RECONNECTED:
+		case SNET_EVENT_STREAM_PROGRESS:
+		case SNET_EVENT_STREAM_OPENED:
+		case SNET_EVENT_STREAM_CLOSED:
+			break;
+	}
+
+	return size;
+}
+
+static void
+snet_io_write_event(snet_io_event_t* copy, const snet_event_t* event, uint32_t watch_epoch) {
+	copy->watch_epoch = watch_epoch;
+	copy->event = *event;
+
+	char* itr = (char*)(copy + 1);
+	snet_event_t* out = &copy->event;
+	switch (event->type) {
+		case SNET_EVENT_LOGIN_FINISHED:
+			out->login.data = snet_io_copy_blob(&itr, event->login.data);
+			break;
+		case SNET_EVENT_CREATE_GAME_FINISHED:
+			if (event->create_game.status == SNET_OK) {
+				out->create_game.info = snet_io_copy_game(&itr, &event->create_game.info);
+			} else {
+				out->create_game.error = snet_io_copy_blob(&itr, event->create_game.error);
+			}
+			break;
+		case SNET_EVENT_LIST_GAMES_FINISHED:
+			snet_io_copy_game_list(&itr, &out->list_games);
+			break;
+		case SNET_EVENT_JOIN_GAME_FINISHED:
+			out->join_game.error = snet_io_copy_blob(&itr, event->join_game.error);
+			break;
+		case SNET_EVENT_MESSAGE:
+			out->message.data = snet_io_copy_blob(&itr, event->message.data);
+			break;
+		case SNET_EVENT_STREAM_DATA:
+			out->stream.data = snet_io_copy_blob(&itr, event->stream.data);
+			break;
+		case SNET_EVENT_GAME_ADDED:
+		case SNET_EVENT_GAME_UPDATED:
+		case SNET_EVENT_GAME_REMOVED:
+			out->game = snet_io_copy_game(&itr, &event->game);
+			break;
+		case SNET_EVENT_DISCONNECTED:
+		case SNET_EVENT_RECONNECTING:
+		case SNET_EVENT_RECONNECTED:
+		case SNET_EVENT_STREAM_PROGRESS:
+		case SNET_EVENT_STREAM_OPENED:
+		case SNET_EVENT_STREAM_CLOSED:
+			break;
+	}
+
+}
+
+static snet_io_event_t*
+snet_io_copy_event(const snet_io_event_t* event) {
+	snet_io_event_t* copy = cf_alloc(snet_io_event_size(&event->event));
+	snet_io_write_event(copy, &event->event, event->watch_epoch);
+	return copy;
+}
+
+static size_t
+snet_io_command_size(const snet_io_command_t* command) {
+	return sizeof(snet_io_command_t)
+		+ snet_io_blob_size(command->blob)
+		+ snet_io_blob_size(command->game_options.data)
+		+ snet_io_blob_size(command->list_options.cursor)
+		+ snet_io_blob_size(command->list_options.creator)
+		+ snet_io_blob_size(command->list_options.data_prefix);
+}
+
+static void
+snet_io_copy_command(snet_io_command_t* copy, const snet_io_command_t* command) {
+	*copy = *command;
+
+	char* itr = (char*)(copy + 1);
+	copy->blob = snet_io_copy_blob(&itr, command->blob);
+	copy->game_options.data = snet_io_copy_blob(&itr, command->game_options.data);
+	copy->list_options.cursor = snet_io_copy_blob(&itr, command->list_options.cursor);
+	copy->list_options.creator = snet_io_copy_blob(&itr, command->list_options.creator);
+	copy->list_options.data_prefix = snet_io_copy_blob(&itr, command->list_options.data_prefix);
+}
+
+// }}}
+
+// I/O thread {{{
+
+static void
+snet_io_execute(snet_io_t* io, const snet_io_command_t* command) {
+	snet_t* snet = io->snet;
+	switch (command->type) {
+		case SNET_IO_LOGIN_WITH_COOKIE:
+			snet_login_with_cookie(snet, command->blob);
+			break;
+		case SNET_IO_LOGIN_WITH_ITCHIO:
+			snet_login_with_itchio(snet);
+			break;
+		case SNET_IO_CREATE_GAME:
+			snet_create_game(snet, &command->game_options);
+			break;
+		case SNET_IO_JOIN_GAME:
+			snet_join_game(snet, command->blob);
+			break;
+		case SNET_IO_SEND:
+			snet_send_prioritized(snet, command->blob, command->reliable, command->priority);
+			break;
+		case SNET_IO_SEND_REDUNDANT:
+			snet_send_redundant(snet, command->blob);
+			break;
+		case SNET_IO_EXIT_GAME:
+			snet_exit_game(snet);
+			break;
+		case SNET_IO_LIST_GAMES:
+			snet_list_games_ex(snet, &command->list_options);
+			break;
+		case SNET_IO_WATCH_GAMES:
+			io->io_watch_epoch = command->watch_epoch;
+			snet_watch_games(snet, &command->list_options, command->poll_interval);
+			break;
+		case SNET_IO_SUBSCRIBE_GAMES:
+			io->io_watch_epoch = command->watch_epoch;
+			snet_subscribe_games(snet, &command->list_options, command->poll_interval);
+			break;
+		case SNET_IO_UNWATCH_GAMES:
+			io->io_watch_epoch = command->watch_epoch;
+			snet_unwatch_games(snet);
+			break;
+		case SNET_IO_STREAM_OPEN:
+			snet_stream_open_with_id(snet, command->stream);
+			break;
+		case SNET_IO_STREAM_WRITE:
+			snet_stream_write(snet, command->stream, command->blob);
+			break;
+		case SNET_IO_STREAM_CLOSE:
+			snet_stream_close(snet, command->stream);
+			break;
+	}
+}
+
+static int
+snet_io_thread(void* userdata) {
+	snet_io_t* io = userdata;
+
+	while (!atomic_load(&io->quit)) {
+		snet_io_ring_flush(&io->events);
+		snet_io_ring_commit(&io->events);
+
+		snet_io_command_t* command;
+		while ((command = snet_io_ring_pop(&io->commands)) != NULL) {
+			snet_io_execute(io, command);
+		}
+		snet_io_ring_release(&io->commands);
+
+		snet_update(io->snet);
+
+		const snet_event_t* event;
+		while ((event = snet_next_event(io->snet)) != NULL) {
+			snet_io_event_t* copy = snet_io_ring_push(&io->events, snet_io_event_size(event));
+			snet_io_write_event(copy, event, io->io_watch_epoch);
+		}
+		snet_io_ring_commit(&io->events);
+
+		atomic_store(&io->auth_state, (int)snet_auth_state(io->snet));
+		atomic_store(&io->lobby_state, (int)snet_lobby_state(io->snet));
+		SDL_LockMutex(io->clock_mutex);
+		io->clock = *snet_relay_clock(io->snet);
+		SDL_UnlockMutex(io->clock_mutex);
+
+		// Woken up early by new commands
+		SDL_WaitSemaphoreTimeout(io->wake, SNET_IO_WAIT_MS);
+	}
+
+	return 0;
+}
+
+// }}}
+
+snet_io_t*
+snet_io_init(const snet_config_t* config) {
+	snet_io_t* io = cf_alloc(sizeof(snet_io_t));
+	*io = (snet_io_t){
+		.snet = snet_init(config),
+		.wake = SDL_CreateSemaphore(0),
+		.clock_mutex = SDL_CreateMutex(),
+	};
+	atomic_init(&io->quit, false);
+	atomic_init(&io->auth_state, (int)snet_auth_state(io->snet));
+	atomic_init(&io->lobby_state, (int)snet_lobby_state(io->snet));
+	snet_io_ring_init(&io->commands);
+	snet_io_ring_init(&io->events);
+	snet_game_table_init(&io->watched_games);
+
+	io->thread = SDL_CreateThread(snet_io_thread, "slopnet", io);
+	return io;
+}
+
+void
+snet_io_cleanup(snet_io_t* io) {
+	atomic_store(&io->quit, true);
+	SDL_SignalSemaphore(io->wake);
+	SDL_WaitThread(io->thread, NULL);
+
+	afree(io->pending_events);
+	for (int i = 0; i < alen(io->retired_results); ++i) {
+		cf_free(io->retired_results[i]);
+	}
+	afree(io->retired_results);
+	cf_free(io->list_games_result);
+	cf_free(io->create_game_result);
+
+	snet_io_ring_cleanup(&io->commands);
+	snet_io_ring_cleanup(&io->events);
+	snet_game_table_cleanup(&io->watched_games);
+	SDL_DestroySemaphore(io->wake);
+	SDL_DestroyMutex(io->clock_mutex);
+	snet_cleanup(io->snet);
+	cf_free(io);
+}
+
+void
+snet_io_post(snet_io_t* io, const snet_io_command_t* command) {
+	snet_io_command_t* copy = snet_io_ring_push(&io->commands, snet_io_command_size(command));
+	snet_io_copy_command(copy, command);
+
+	switch (command->type) {
+		case SNET_IO_WATCH_GAMES:
+		case SNET_IO_SUBSCRIBE_GAMES:
+		case SNET_IO_UNWATCH_GAMES:
+			// Events from the previous watch which are still in flight are
+			// dropped.
+			// The table itself is only reset by the next update.
+			copy->watch_epoch = ++io->watch_epoch;
+			io->reset_watched_games = true;
+			break;
+		default:
+			break;
+	}
+	snet_io_ring_commit(&io->commands);
+
+	switch (command->type) {
+		case SNET_IO_SEND:
+		case SNET_IO_SEND_REDUNDANT:
+		case SNET_IO_STREAM_WRITE:
+			// Woken up once per update instead since there are usually many
+			io->wake_pending = true;
+			break;
+		default:
+			SDL_SignalSemaphore(io->wake);
+			break;
+	}
+}
+
+// Replaces the previous result of the same kind, which is only freed on the
+// next update since it could have been returned by this one
+static snet_io_event_t*
+snet_io_keep_result(snet_io_t* io, snet_io_event_t** slot, const snet_io_event_t* event) {
+	if (*slot != NULL) { apush(io->retired_results, *slot); }
+
+	*slot = snet_io_copy_event(event);
+	return *slot;
+}
+
+static bool
+snet_io_apply_event(snet_io_t* io, const snet_io_event_t* event) {
+	switch (event->event.type) {
+		case SNET_EVENT_GAME_ADDED:
+		case SNET_EVENT_GAME_UPDATED: {
+			if (event->watch_epoch != io->watch_epoch) { return false; }
+
+			const snet_game_info_t* entry;
+			snet_game_table_put(&io->watched_games, &event->event.game, &entry);
+		} return true;
+		case SNET_EVENT_GAME_REMOVED: {
+			if (event->watch_epoch != io->watch_epoch) { return false; }
+
+			snet_game_info_t removed;
+			snet_game_table_remove(&io->watched_games, event->event.game.join_token, &removed);
+		} return true;
+		default:
+			return true;
+	}
+}
+
+void
+snet_io_update(snet_io_t* io) {
+	snet_io_ring_release(&io->events);
+	aclear(io->pending_events);
+	io->next_event = 0;
+	for (int i = 0; i < alen(io->retired_results); ++i) {
+		cf_free(io->retired_results[i]);
+	}
+	aclear(io->retired_results);
+	snet_game_table_collect_garbage(&io->watched_games);
+
+	snet_io_ring_flush(&io->commands);
+	snet_io_ring_commit(&io->commands);
+	if (io->wake_pending) {
+		io->wake_pending = false;
+		SDL_SignalSemaphore(io->wake);
+	}
+
+	// Like a regular update, the watched games only change here
+	if (io->reset_watched_games) {
+		io->reset_watched_games = false;
+		snet_game_table_cleanup(&io->watched_games);
+		snet_game_table_init(&io->watched_games);
+	}
+
+	// Events stay in the ring until the next update
+	snet_io_event_t* event;
+	while ((event = snet_io_ring_pop(&io->events)) != NULL) {
+		if (!snet_io_apply_event(io, event)) { continue; }
+
+		if (event->event.type == SNET_EVENT_LIST_GAMES_FINISHED) {
+			event = snet_io_keep_result(io, &io->list_games_result, event);
+		} else if (event->event.type == SNET_EVENT_CREATE_GAME_FINISHED) {
+			event = snet_io_keep_result(io, &io->create_game_result, event);
+		}
+		apush(io->pending_events, event);
+	}
+}
+
+const snet_event_t*
+snet_io_next_event(snet_io_t* io) {
+	if (io->next_event < alen(io->pending_events)) {
+		return &io->pending_events[io->next_event++]->event;
+	} else {
+		return NULL;
+	}
+}
+
+snet_auth_state_t
+snet_io_auth_state(snet_io_t* io) {
+	return (snet_auth_state_t)atomic_load(&io->auth_state);
+}
+
+snet_lobby_state_t
+snet_io_lobby_state(snet_io_t* io) {
+	return (snet_lobby_state_t)atomic_load(&io->lobby_state);
+}
+
+bool
+snet_io_server_time(snet_io_t* io, double* time, double* error) {
+	SDL_LockMutex(io->clock_mutex);
+	snet_clock_t clock = io->clock;
+	SDL_UnlockMutex(io->clock_mutex);
+
+	return snet_clock_estimate(&clock, snet_seconds(), time, error);
+}
+
+const snet_game_info_t*
+snet_io_watched_games(snet_io_t* io, int* num_games) {
+	*num_games = io->watched_games.num_games;
+	return io->watched_games.games;
+}
+
+const snet_game_info_t*
+snet_io_find_watched_game(snet_io_t* io, snet_blob_t join_token) {
+	return snet_game_table_find(&io->watched_games, join_token);
+}
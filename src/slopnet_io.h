@@ -0,0 +1,76 @@
+#ifndef SLOPNET_IO_H
+#define SLOPNET_IO_H
+
+#include <slopnet.h>
+#include <stdint.h>
+
+// Runs a regular snet_t on a background thread.
+// The game thread only exchanges commands and events with it.
+typedef struct snet_io_s snet_io_t;
+
+typedef enum {
+	SNET_IO_LOGIN_WITH_COOKIE,
+	SNET_IO_LOGIN_WITH_ITCHIO,
+	SNET_IO_CREATE_GAME,
+	SNET_IO_JOIN_GAME,
+	SNET_IO_SEND,
+	SNET_IO_SEND_REDUNDANT,
+	SNET_IO_EXIT_GAME,
+	SNET_IO_LIST_GAMES,
+	SNET_IO_WATCH_GAMES,
+	SNET_IO_SUBSCRIBE_GAMES,
+	SNET_IO_UNWATCH_GAMES,
+	SNET_IO_STREAM_OPEN,
+	SNET_IO_STREAM_WRITE,
+	SNET_IO_STREAM_CLOSE,
+} snet_io_command_type_t;
+
+typedef struct {
+	snet_io_command_type_t type;
+
+	// Cookie, join token, message or stream data depending on the type
+	snet_blob_t blob;
+	bool reliable;
+	snet_priority_t priority;
+	uint64_t stream;
+	snet_game_options_t game_options;
+	snet_list_games_options_t list_options;
+	double poll_interval;
+
+	// Set by snet_io_post
+	uint32_t watch_epoch;
+} snet_io_command_t;
+
+snet_io_t*
+snet_io_init(const snet_config_t* config);
+
+void
+snet_io_cleanup(snet_io_t* io);
+
+// Everything the command points to is copied
+void
+snet_io_post(snet_io_t* io, const snet_io_command_t* command);
+
+// Releases the events returned since the last call
+void
+snet_io_update(snet_io_t* io);
+
+const snet_event_t*
+snet_io_next_event(snet_io_t* io);
+
+snet_auth_state_t
+snet_io_auth_state(snet_io_t* io);
+
+snet_lobby_state_t
+snet_io_lobby_state(snet_io_t* io);
+
+bool
+snet_io_server_time(snet_io_t* io, double* time, double* error);
+
+const snet_game_info_t*
+snet_io_watched_games(snet_io_t* io, int* num_games);
+
+const snet_game_info_t*
+snet_io_find_watched_game(snet_io_t* io, snet_blob_t join_token);
+
+#endif
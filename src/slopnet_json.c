@@ -0,0 +1,539 @@
+#include "slopnet_json.h"
+#include "slopnet_test.h"
+#include <cute_alloc.h>
+#include <string.h>
+
+#if defined(SNET_JSON_NO_SIMD)
+	// Scalar only, for comparison
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define SNET_JSON_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#	include <arm_neon.h>
+#	define SNET_JSON_NEON
+#elif defined(__wasm_simd128__)
+#	include <wasm_simd128.h>
+#	define SNET_JSON_WASM_SIMD
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#	include <intrin.h>
+#endif
+
+#define SNET_JSON_REPLACEMENT_CHAR 0xFFFD
+
+static inline int
+snet_json_ctz(uint64_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+	// _BitScanForward64 is not available on 32-bit targets
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)mask)) { return (int)index; }
+	_BitScanForward(&index, (unsigned long)(mask >> 32));
+	return (int)index + 32;
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+// Finds the first quote, backslash or control character, 16 bytes at a time
+// where possible
+static const char*
+snet_json_scan_string(const char* itr, const char* end) {
+#if defined(SNET_JSON_SSE2)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i max_control = _mm_set1_epi8(0x1F);
+	for (; end - itr >= 16; itr += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)itr);
+		// There is no unsigned compare, x <= 0x1F is max(x, 0x1F) == 0x1F
+		__m128i control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, max_control), max_control);
+		__m128i found = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+			control
+		);
+		int mask = _mm_movemask_epi8(found);
+		if (mask != 0) { return itr + snet_json_ctz((uint64_t)mask); }
+	}
+#elif defined(SNET_JSON_NEON)
+	const uint8x16_t quote = vdupq_n_u8('"');
+	const uint8x16_t backslash = vdupq_n_u8('\\');
+	const uint8x16_t space = vdupq_n_u8(0x20);
+	for (; end - itr >= 16; itr += 16) {
+		uint8x16_t chunk = vld1q_u8((const uint8_t*)itr);
+		uint8x16_t found = vorrq_u8(
+			vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)),
+			vcltq_u8(chunk, space)
+		);
+		// There is no movemask, narrow to 4 bits per byte instead
+		uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(found), 4);
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+		if (mask != 0) { return itr + (snet_json_ctz(mask) >> 2); }
+	}
+#elif defined(SNET_JSON_WASM_SIMD)
+	const v128_t quote = wasm_i8x16_splat('"');
+	const v128_t backslash = wasm_i8x16_splat('\\');
+	const v128_t space = wasm_i8x16_splat(0x20);
+	for (; end - itr >= 16; itr += 16) {
+		v128_t chunk = wasm_v128_load(itr);
+		v128_t found = wasm_v128_or(
+			wasm_v128_or(wasm_i8x16_eq(chunk, quote), wasm_i8x16_eq(chunk, backslash)),
+			wasm_u8x16_lt(chunk, space)
+		);
+		uint32_t mask = wasm_i8x16_bitmask(found);
+		if (mask != 0) { return itr + snet_json_ctz(mask); }
+	}
+#endif
+
+	while (itr < end && *itr != '"' && *itr != '\\' && (unsigned char)*itr >= 0x20) { ++itr; }
+	return itr;
+}
+
+static void
+snet_json_str_append(snet_json_reader_t* reader, const char* data, size_t size) {
+	if (size == 0) { return; }
+
+	if (reader->in_place) {
+		// Unescaped text is never longer than its source so it can be written
+		// over what has already been read
+		char* dst = reader->str + reader->str_len;
+		if (dst != data) { memmove(dst, data, size); }
+		reader->str_len += size;
+		return;
+	}
+
+	size_t required = reader->str_len + size;
+	if (required > reader->str_capacity) {
+		size_t capacity = reader->str_capacity > 0 ? reader->str_capacity : 64;
+		while (capacity < required) { capacity *= 2; }
+		reader->str = cf_realloc(reader->str, capacity);
+		reader->str_capacity = capacity;
+	}
+
+	memcpy(reader->str + reader->str_len, data, size);
+	reader->str_len += size;
+}
+
+static void
+snet_json_str_append_codepoint(snet_json_reader_t* reader, uint32_t codepoint) {
+	char utf8[4];
+	size_t size;
+	if (codepoint < 0x80) {
+		utf8[0] = (char)codepoint;
+		size = 1;
+	} else if (codepoint < 0x800) {
+		utf8[0] = (char)(0xC0 | (codepoint >> 6));
+		utf8[1] = (char)(0x80 | (codepoint & 0x3F));
+		size = 2;
+	} else if (codepoint < 0x10000) {
+		utf8[0] = (char)(0xE0 | (codepoint >> 12));
+		utf8[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+		utf8[2] = (char)(0x80 | (codepoint & 0x3F));
+		size = 3;
+	} else {
+		utf8[0] = (char)(0xF0 | (codepoint >> 18));
+		utf8[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+		utf8[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+		utf8[3] = (char)(0x80 | (codepoint & 0x3F));
+		size = 4;
+	}
+
+	snet_json_str_append(reader, utf8, size);
+}
+
+static void
+snet_json_flush_surrogate(snet_json_reader_t* reader) {
+	// A high surrogate which is not followed by a low surrogate
+	if (reader->high_surrogate != 0) {
+		snet_json_str_append_codepoint(reader, SNET_JSON_REPLACEMENT_CHAR);
+		reader->high_surrogate = 0;
+	}
+}
+
+static bool
+snet_json_in_object(snet_json_reader_t* reader) {
+	return reader->depth > 0
+		&& (reader->object_mask & (1u << (reader->depth - 1))) != 0;
+}
+
+static snet_json_token_t
+snet_json_push(snet_json_reader_t* reader, bool object) {
+	if (reader->depth >= SNET_JSON_MAX_DEPTH) { return SNET_JSON_ERROR; }
+
+	if (object) {
+		reader->object_mask |= 1u << reader->depth;
+	} else {
+		reader->object_mask &= ~(1u << reader->depth);
+	}
+	reader->depth += 1;
+	reader->expect_key = object;
+
+	return object ? SNET_JSON_OBJECT_BEGIN : SNET_JSON_ARRAY_BEGIN;
+}
+
+static snet_json_token_t
+snet_json_pop(snet_json_reader_t* reader, bool object) {
+	if (reader->depth == 0 || snet_json_in_object(reader) != object) {
+		return SNET_JSON_ERROR;
+	}
+
+	reader->depth -= 1;
+	reader->expect_key = false;
+
+	return object ? SNET_JSON_OBJECT_END : SNET_JSON_ARRAY_END;
+}
+
+static bool
+snet_json_is_scalar_char(char ch) {
+	return ('0' <= ch && ch <= '9')
+		|| ('a' <= ch && ch <= 'z')
+		|| ('A' <= ch && ch <= 'Z')
+		|| ch == '-' || ch == '+' || ch == '.';
+}
+
+static int
+snet_json_hex_value(char ch) {
+	if ('0' <= ch && ch <= '9') { return ch - '0'; }
+	if ('a' <= ch && ch <= 'f') { return ch - 'a' + 10; }
+	if ('A' <= ch && ch <= 'F') { return ch - 'A' + 10; }
+	return -1;
+}
+
+static snet_json_token_t
+snet_json_end_scalar(snet_json_reader_t* reader) {
+	reader->lex = SNET_JSON_LEX_VALUE;
+	reader->scalar[reader->scalar_len] = '\0';
+	reader->value = reader->scalar;
+	reader->value_len = reader->scalar_len;
+
+	if (strcmp(reader->scalar, "true") == 0) {
+		return SNET_JSON_TRUE;
+	} else if (strcmp(reader->scalar, "false") == 0) {
+		return SNET_JSON_FALSE;
+	} else if (strcmp(reader->scalar, "null") == 0) {
+		return SNET_JSON_NULL;
+	} else if (reader->scalar[0] == '-' || ('0' <= reader->scalar[0] && reader->scalar[0] <= '9')) {
+		return SNET_JSON_NUMBER;
+	} else {
+		return SNET_JSON_ERROR;
+	}
+}
+
+static snet_json_token_t
+snet_json_end_string(snet_json_reader_t* reader, const char* value, size_t value_len) {
+	reader->lex = SNET_JSON_LEX_VALUE;
+	reader->value = value;
+	reader->value_len = value_len;
+	if (reader->in_place) {
+		// At most overwrites the closing quote
+		reader->str[value_len] = '\0';
+	}
+
+	if (snet_json_in_object(reader) && reader->expect_key) {
+		reader->expect_key = false;
+		return SNET_JSON_KEY;
+	} else {
+		return SNET_JSON_STRING;
+	}
+}
+
+static void
+snet_json_end_unicode_escape(snet_json_reader_t* reader) {
+	uint32_t codepoint = reader->codepoint;
+	reader->lex = SNET_JSON_LEX_STRING;
+
+	if (0xD800 <= codepoint && codepoint < 0xDC00) {
+		snet_json_flush_surrogate(reader);
+		reader->high_surrogate = codepoint;
+	} else if (0xDC00 <= codepoint && codepoint < 0xE000) {
+		if (reader->high_surrogate != 0) {
+			codepoint = 0x10000 + ((reader->high_surrogate - 0xD800) << 10) + (codepoint - 0xDC00);
+			reader->high_surrogate = 0;
+			snet_json_str_append_codepoint(reader, codepoint);
+		} else {
+			snet_json_str_append_codepoint(reader, SNET_JSON_REPLACEMENT_CHAR);
+		}
+	} else {
+		snet_json_flush_surrogate(reader);
+		snet_json_str_append_codepoint(reader, codepoint);
+	}
+}
+
+void
+snet_json_reader_init(snet_json_reader_t* reader) {
+	*reader = (snet_json_reader_t){
+		.lex = SNET_JSON_LEX_VALUE,
+	};
+}
+
+void
+snet_json_reader_init_in_place(snet_json_reader_t* reader, char* data, size_t size) {
+	snet_json_reader_init(reader);
+	reader->in_place = true;
+	snet_json_reader_feed(reader, data, size);
+}
+
+void
+snet_json_reader_cleanup(snet_json_reader_t* reader) {
+	if (!reader->in_place) { cf_free(reader->str); }
+	reader->str = NULL;
+	reader->str_capacity = 0;
+}
+
+void
+snet_json_reader_feed(snet_json_reader_t* reader, const void* data, size_t size) {
+	reader->cur = data;
+	reader->end = reader->cur + size;
+}
+
+snet_json_token_t
+snet_json_reader_next(snet_json_reader_t* reader) {
+	while (reader->cur < reader->end) {
+		switch (reader->lex) {
+			case SNET_JSON_LEX_VALUE: {
+				char ch = *reader->cur++;
+				switch (ch) {
+					case ' ': case '\t': case '\r': case '\n':
+						break;
+					case ',':
+						reader->expect_key = snet_json_in_object(reader);
+						break;
+					case ':':
+						reader->expect_key = false;
+						break;
+					case '{':
+						return snet_json_push(reader, true);
+					case '}':
+						return snet_json_pop(reader, true);
+					case '[':
+						return snet_json_push(reader, false);
+					case ']':
+						return snet_json_pop(reader, false);
+					case '"':
+						reader->lex = SNET_JSON_LEX_STRING;
+						reader->str_len = 0;
+						reader->high_surrogate = 0;
+						if (reader->in_place) {
+							reader->str = (char*)reader->cur;
+						}
+						break;
+					default:
+						if (!snet_json_is_scalar_char(ch)) { return SNET_JSON_ERROR; }
+
+						reader->lex = SNET_JSON_LEX_SCALAR;
+						reader->scalar[0] = ch;
+						reader->scalar_len = 1;
+						break;
+				}
+			} break;
+			case SNET_JSON_LEX_STRING: {
+				const char* run_begin = reader->cur;
+				const char* run_end = snet_json_scan_string(run_begin, reader->end);
+
+				if (
+					run_end < reader->end && *run_end == '"'
+					&& reader->str_len == 0 && reader->high_surrogate == 0
+				) {
+					// Nothing to unescape and nothing buffered so far, hand out
+					// the input directly
+					reader->cur = run_end + 1;
+					if (reader->in_place) { reader->str = (char*)run_begin; }
+					return snet_json_end_string(reader, run_begin, run_end - run_begin);
+				}
+
+				if (run_end > run_begin) {
+					snet_json_flush_surrogate(reader);
+					snet_json_str_append(reader, run_begin, run_end - run_begin);
+				}
+
+				reader->cur = run_end;
+				if (reader->cur == reader->end) { break; }
+
+				// Control characters must be escaped
+				if ((unsigned char)*reader->cur < 0x20) { return SNET_JSON_ERROR; }
+
+				if (*reader->cur++ == '"') {
+					snet_json_flush_surrogate(reader);
+					return snet_json_end_string(reader, reader->str, reader->str_len);
+				} else {
+					reader->lex = SNET_JSON_LEX_ESCAPE;
+				}
+			} break;
+			case SNET_JSON_LEX_ESCAPE: {
+				char ch = *reader->cur++;
+				char decoded;
+				switch (ch) {
+					case '"': case '\\': case '/': decoded = ch; break;
+					case 'b': decoded = '\b'; break;
+					case 'f': decoded = '\f'; break;
+					case 'n': decoded = '\n'; break;
+					case 'r': decoded = '\r'; break;
+					case 't': decoded = '\t'; break;
+					case 'u':
+						reader->lex = SNET_JSON_LEX_UNICODE;
+						reader->num_hex_digits = 0;
+						reader->codepoint = 0;
+						continue;
+					default:
+						return SNET_JSON_ERROR;
+				}
+
+				snet_json_flush_surrogate(reader);
+				snet_json_str_append(reader, &decoded, 1);
+				reader->lex = SNET_JSON_LEX_STRING;
+			} break;
+			case SNET_JSON_LEX_UNICODE: {
+				int digit = snet_json_hex_value(*reader->cur++);
+				if (digit < 0) { return SNET_JSON_ERROR; }
+
+				reader->codepoint = (reader->codepoint << 4) | (uint32_t)digit;
+				if (++reader->num_hex_digits == 4) {
+					snet_json_end_unicode_escape(reader);
+				}
+			} break;
+			case SNET_JSON_LEX_SCALAR: {
+				char ch = *reader->cur;
+				if (!snet_json_is_scalar_char(ch)) {
+					return snet_json_end_scalar(reader);
+				}
+
+				if (reader->scalar_len >= SNET_JSON_MAX_SCALAR_SIZE - 1) {
+					return SNET_JSON_ERROR;
+				}
+				reader->scalar[reader->scalar_len++] = ch;
+				++reader->cur;
+			} break;
+		}
+	}
+
+	return SNET_JSON_NEED_MORE;
+}
+
+#if SNET_ENABLE_TESTS
+
+static const char snet_json_test_doc[] =
+	"{\"key\": \"a\\\"b\\\\c\\/\\n\\u00e9\\ud83d\\ude00\\ud800!\", \"plain\": \"0123456789abcdefghij\","
+	" \"list\": [12, -3.5e2, true, false, null, {}]}";
+
+static const snet_json_token_t snet_json_test_tokens[] = {
+	SNET_JSON_OBJECT_BEGIN,
+	SNET_JSON_KEY, SNET_JSON_STRING,
+	SNET_JSON_KEY, SNET_JSON_STRING,
+	SNET_JSON_KEY, SNET_JSON_ARRAY_BEGIN,
+	SNET_JSON_NUMBER, SNET_JSON_NUMBER, SNET_JSON_TRUE, SNET_JSON_FALSE, SNET_JSON_NULL,
+	SNET_JSON_OBJECT_BEGIN, SNET_JSON_OBJECT_END,
+	SNET_JSON_ARRAY_END,
+	SNET_JSON_OBJECT_END,
+};
+
+// U+00E9, U+1F600 and a replacement character for the lone high surrogate
+static const char snet_json_test_unescaped[] =
+	"a\"b\\c/\n\xC3\xA9\xF0\x9F\x98\x80\xEF\xBF\xBD!";
+
+static void
+snet_json_test_check_token(snet_json_reader_t* reader, snet_json_token_t token, int index) {
+	snet_check(token == snet_json_test_tokens[index]);
+
+	size_t len;
+	const char* value = snet_json_reader_value(reader, &len);
+	if (index == 2) {
+		snet_check(len == sizeof(snet_json_test_unescaped) - 1);
+		snet_check(memcmp(value, snet_json_test_unescaped, len) == 0);
+	} else if (index == 4) {
+		snet_check(len == 20 && memcmp(value, "0123456789abcdefghij", len) == 0);
+	} else if (index == 8) {
+		snet_check(len == 6 && memcmp(value, "-3.5e2", len) == 0);
+	}
+}
+
+// Every split of the input must give the same tokens
+static void
+snet_json_test_chunked(size_t chunk_size) {
+	snet_json_reader_t reader;
+	snet_json_reader_init(&reader);
+
+	const char* itr = snet_json_test_doc;
+	const char* end = itr + sizeof(snet_json_test_doc) - 1;
+	int num_tokens = 0;
+	while (itr < end) {
+		size_t size = (size_t)(end - itr) < chunk_size ? (size_t)(end - itr) : chunk_size;
+		snet_json_reader_feed(&reader, itr, size);
+		itr += size;
+
+		snet_json_token_t token;
+		while ((token = snet_json_reader_next(&reader)) != SNET_JSON_NEED_MORE) {
+			snet_check(num_tokens < (int)(sizeof(snet_json_test_tokens) / sizeof(snet_json_test_tokens[0])));
+			snet_json_test_check_token(&reader, token, num_tokens++);
+		}
+	}
+	snet_check(num_tokens == sizeof(snet_json_test_tokens) / sizeof(snet_json_test_tokens[0]));
+
+	snet_json_reader_cleanup(&reader);
+}
+
+static void
+snet_json_test_in_place(void) {
+	char doc[sizeof(snet_json_test_doc)];
+	memcpy(doc, snet_json_test_doc, sizeof(doc));
+
+	snet_json_reader_t reader;
+	snet_json_reader_init_in_place(&reader, doc, sizeof(doc) - 1);
+
+	const char* key = NULL;
+	int num_tokens = 0;
+	snet_json_token_t token;
+	while ((token = snet_json_reader_next(&reader)) != SNET_JSON_NEED_MORE) {
+		snet_json_test_check_token(&reader, token, num_tokens);
+		if (num_tokens == 2) {
+			size_t len;
+			key = snet_json_reader_value(&reader, &len);
+		}
+		++num_tokens;
+	}
+	snet_check(num_tokens == sizeof(snet_json_test_tokens) / sizeof(snet_json_test_tokens[0]));
+	// Still valid and null-terminated after the rest was read
+	snet_check(strcmp(key, snet_json_test_unescaped) == 0);
+
+	snet_json_reader_cleanup(&reader);
+}
+
+static snet_json_token_t
+snet_json_test_last_token(const char* doc) {
+	snet_json_reader_t reader;
+	snet_json_reader_init(&reader);
+	snet_json_reader_feed(&reader, doc, strlen(doc));
+
+	snet_json_token_t token, last = SNET_JSON_NEED_MORE;
+	while ((token = snet_json_reader_next(&reader)) != SNET_JSON_NEED_MORE) {
+		last = token;
+		if (token == SNET_JSON_ERROR) { break; }
+	}
+
+	snet_json_reader_cleanup(&reader);
+	return last;
+}
+
+static void
+snet_json_test_errors(void) {
+	snet_check(snet_json_test_last_token("[\"\\q\"]") == SNET_JSON_ERROR);
+	snet_check(snet_json_test_last_token("[\"\\u12G4\"]") == SNET_JSON_ERROR);
+	snet_check(snet_json_test_last_token("[1]]") == SNET_JSON_ERROR);
+	snet_check(snet_json_test_last_token("[1}") == SNET_JSON_ERROR);
+	snet_check(snet_json_test_last_token("[\"ok\"]") == SNET_JSON_ARRAY_END);
+
+	// Raw control characters, both in the vector and in the scalar part
+	snet_check(snet_json_test_last_token("[\"tab\there\"]") == SNET_JSON_ERROR);
+	snet_check(snet_json_test_last_token("[\"0123456789abcdef\n0123456789abcdef\"]") == SNET_JSON_ERROR);
+	snet_check(snet_json_test_last_token("[\"0123456789abcdef0123456789\x1F\"]") == SNET_JSON_ERROR);
+	snet_check(snet_json_test_last_token("[\"0123456789abcdef\x7F\xC3\xA9\"]") == SNET_JSON_ARRAY_END);
+}
+
+void
+snet_json_test(void) {
+	for (size_t chunk_size = 1; chunk_size <= sizeof(snet_json_test_doc); ++chunk_size) {
+		snet_json_test_chunked(chunk_size);
+	}
+	snet_json_test_in_place();
+	snet_json_test_errors();
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef SLOPNET_JSON_H
+#define SLOPNET_JSON_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SNET_JSON_MAX_DEPTH 32
+#define SNET_JSON_MAX_SCALAR_SIZE 64
+
+typedef enum {
+	SNET_JSON_NEED_MORE,
+	SNET_JSON_ERROR,
+	SNET_JSON_OBJECT_BEGIN,
+	SNET_JSON_OBJECT_END,
+	SNET_JSON_ARRAY_BEGIN,
+	SNET_JSON_ARRAY_END,
+	SNET_JSON_KEY,
+	SNET_JSON_STRING,
+	SNET_JSON_NUMBER,
+	SNET_JSON_TRUE,
+	SNET_JSON_FALSE,
+	SNET_JSON_NULL,
+} snet_json_token_t;
+
+typedef enum {
+	SNET_JSON_LEX_VALUE,
+	SNET_JSON_LEX_STRING,
+	SNET_JSON_LEX_ESCAPE,
+	SNET_JSON_LEX_UNICODE,
+	SNET_JSON_LEX_SCALAR,
+} snet_json_lex_state_t;
+
+// Incremental pull tokenizer.
+// Input can be split at any byte, tokens which span several chunks are
+// accumulated internally.
+typedef struct {
+	const char* cur;
+	const char* end;
+
+	snet_json_lex_state_t lex;
+	int depth;
+	uint32_t object_mask;  // Bit n is set if container at depth n is an object
+	bool expect_key;
+	bool in_place;
+
+	char* str;
+	size_t str_len;
+	size_t str_capacity;
+
+	int num_hex_digits;
+	uint32_t codepoint;
+	uint32_t high_surrogate;
+
+	char scalar[SNET_JSON_MAX_SCALAR_SIZE];
+	int scalar_len;
+
+	const char* value;
+	size_t value_len;
+} snet_json_reader_t;
+
+void
+snet_json_reader_init(snet_json_reader_t* reader);
+
+// Reads a complete document and unescapes strings over the input itself.
+// Values returned by snet_json_reader_value then point into data and are
+// null-terminated so they can be kept for as long as data is.
+void
+snet_json_reader_init_in_place(snet_json_reader_t* reader, char* data, size_t size);
+
+void
+snet_json_reader_cleanup(snet_json_reader_t* reader);
+
+// The data must stay valid until snet_json_reader_next returns
+// SNET_JSON_NEED_MORE
+void
+snet_json_reader_feed(snet_json_reader_t* reader, const void* data, size_t size);
+
+snet_json_token_t
+snet_json_reader_next(snet_json_reader_t* reader);
+
+// Text of the last key, string or number token.
+// Valid until the next call to snet_json_reader_next or snet_json_reader_feed,
+// except for strings read in place.
+static inline const char*
+snet_json_reader_value(snet_json_reader_t* reader, size_t* size) {
+	*size = reader->value_len;
+	return reader->value;
+}
+
+static inline int
+snet_json_reader_depth(snet_json_reader_t* reader) {
+	return reader->depth;
+}
+
+#endif
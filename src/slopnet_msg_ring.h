@@ -0,0 +1,146 @@
+#ifndef SLOPNET_MSG_RING_H
+#define SLOPNET_MSG_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cute_alloc.h>
+
+#define SNET_CACHE_LINE_SIZE 64
+
+// Bounded lock-free queue of variable sized messages for exactly one producer
+// thread and one consumer thread.
+// Descriptors live in one ring and point into a second ring holding the
+// bytes so every message is contiguous.
+// Both sides work on private copies of the indices and only publish them in
+// batches: the producer with snet_msg_ring_commit and the consumer with
+// snet_msg_ring_release.
+typedef struct {
+	uint32_t begin;  // Position in the byte ring, not wrapped
+	uint32_t size;
+} snet_msg_desc_t;
+
+// Each group is padded by a whole cache line instead of being aligned since
+// rings live in cf_alloc'd structs which do not honour extended alignment.
+typedef struct {
+	// Read only after init
+	snet_msg_desc_t* descs;
+	char* bytes;
+	uint32_t desc_capacity;  // Power of two
+	uint32_t byte_capacity;  // Power of two
+
+	char pad0[SNET_CACHE_LINE_SIZE];
+
+	// Published by the producer
+	_Atomic uint32_t tail;
+
+	char pad1[SNET_CACHE_LINE_SIZE];
+
+	// Published by the consumer
+	_Atomic uint32_t head;
+	_Atomic uint32_t byte_head;
+
+	char pad2[SNET_CACHE_LINE_SIZE];
+
+	// Producer only
+	uint32_t write_tail;
+	uint32_t write_byte_tail;
+	uint32_t cached_head;
+	uint32_t cached_byte_head;
+
+	char pad3[SNET_CACHE_LINE_SIZE];
+
+	// Consumer only
+	uint32_t read_head;
+	uint32_t read_byte_head;
+	uint32_t cached_tail;
+} snet_msg_ring_t;
+
+static inline void
+snet_msg_ring_init(snet_msg_ring_t* ring, uint32_t desc_capacity, uint32_t byte_capacity) {
+	*ring = (snet_msg_ring_t){
+		.descs = cf_alloc(sizeof(snet_msg_desc_t) * desc_capacity),
+		.bytes = cf_alloc(byte_capacity),
+		.desc_capacity = desc_capacity,
+		.byte_capacity = byte_capacity,
+	};
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->byte_head, 0);
+}
+
+static inline void
+snet_msg_ring_cleanup(snet_msg_ring_t* ring) {
+	cf_free(ring->descs);
+	cf_free(ring->bytes);
+	ring->descs = NULL;
+	ring->bytes = NULL;
+}
+
+// Returns where the message should be written or NULL if the ring is full.
+// The message is only visible to the consumer after snet_msg_ring_commit.
+static inline void*
+snet_msg_ring_reserve(snet_msg_ring_t* ring, size_t size) {
+	if (size > ring->byte_capacity) { return NULL; }
+
+	uint32_t tail = ring->write_tail;
+	if (tail - ring->cached_head >= ring->desc_capacity) {
+		ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		if (tail - ring->cached_head >= ring->desc_capacity) { return NULL; }
+	}
+
+	// A message which would straddle the end starts over at the beginning
+	uint32_t begin = ring->write_byte_tail;
+	uint32_t offset = begin & (ring->byte_capacity - 1);
+	if (offset + size > ring->byte_capacity) {
+		begin += ring->byte_capacity - offset;
+	}
+
+	uint32_t end = begin + (uint32_t)size;
+	if (end - ring->cached_byte_head > ring->byte_capacity) {
+		ring->cached_byte_head = atomic_load_explicit(&ring->byte_head, memory_order_acquire);
+		if (end - ring->cached_byte_head > ring->byte_capacity) { return NULL; }
+	}
+
+	ring->descs[tail & (ring->desc_capacity - 1)] = (snet_msg_desc_t){
+		.begin = begin,
+		.size = (uint32_t)size,
+	};
+	ring->write_tail = tail + 1;
+	ring->write_byte_tail = end;
+	return ring->bytes + (begin & (ring->byte_capacity - 1));
+}
+
+// Publishes every message reserved so far
+static inline void
+snet_msg_ring_commit(snet_msg_ring_t* ring) {
+	atomic_store_explicit(&ring->tail, ring->write_tail, memory_order_release);
+}
+
+// The message stays valid until snet_msg_ring_release
+static inline bool
+snet_msg_ring_next(snet_msg_ring_t* ring, const void** message, size_t* size) {
+	uint32_t head = ring->read_head;
+	if (head == ring->cached_tail) {
+		ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+		if (head == ring->cached_tail) { return false; }
+	}
+
+	snet_msg_desc_t desc = ring->descs[head & (ring->desc_capacity - 1)];
+	ring->read_head = head + 1;
+	ring->read_byte_head = desc.begin + desc.size;
+
+	*message = ring->bytes + (desc.begin & (ring->byte_capacity - 1));
+	*size = desc.size;
+	return true;
+}
+
+// Hands the space of every message returned so far back to the producer
+static inline void
+snet_msg_ring_release(snet_msg_ring_t* ring) {
+	atomic_store_explicit(&ring->byte_head, ring->read_byte_head, memory_order_release);
+	atomic_store_explicit(&ring->head, ring->read_head, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SLOPNET_PACKET_H
+#define SLOPNET_PACKET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Framing of game messages, shared with the relay in server/
+
+#define SNET_PACKET_HEADER_SIZE 1
+// Packet type followed by the time the request was sent, echoed back as is
+#define SNET_CLOCK_REQUEST_SIZE (SNET_PACKET_HEADER_SIZE + 8)
+// Same as the request followed by the relay's clock as a little endian double
+#define SNET_CLOCK_RESPONSE_SIZE (SNET_CLOCK_REQUEST_SIZE + 8)
+
+// Every game message starts with one of these
+typedef enum {
+	SNET_PACKET_MESSAGE,
+	SNET_PACKET_STREAM_OPEN,
+	SNET_PACKET_STREAM_DATA,
+	SNET_PACKET_STREAM_CLOSE,
+	SNET_PACKET_REDUNDANT,
+	// Answered by the relay instead of being forwarded
+	SNET_PACKET_CLOCK_REQUEST,
+	SNET_PACKET_CLOCK_RESPONSE,
+	// SNET_PACKET_MESSAGE sent unreliably
+	SNET_PACKET_UNRELIABLE_MESSAGE,
+} snet_packet_type_t;
+
+// Transports do not tell how a packet was sent so relays go by its type to
+// pass it on the same way
+static inline bool
+snet_packet_is_reliable(uint8_t type) {
+	return type != SNET_PACKET_UNRELIABLE_MESSAGE
+		&& type != SNET_PACKET_REDUNDANT
+		&& type != SNET_PACKET_CLOCK_REQUEST
+		&& type != SNET_PACKET_CLOCK_RESPONSE;
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include "slopnet_send_queue.h"
+#include "slopnet_test.h"
+#include <cute_alloc.h>
+#include <string.h>
+
+void
+snet_send_queue_cleanup(snet_send_queue_t* queue) {
+	for (int i = 0; i < SNET_NUM_PRIORITIES; ++i) {
+		for (int j = 0; j < alen(queue->queues[i]); ++j) {
+			cf_free((void*)queue->queues[i][j].message.ptr);
+		}
+		afree(queue->queues[i]);
+	}
+	queue->size = 0;
+}
+
+void
+snet_send_queue_push(snet_send_queue_t* queue, snet_blob_t message, bool reliable, snet_priority_t priority) {
+	void* copy = cf_alloc(message.size);
+	memcpy(copy, message.ptr, message.size);
+	apush(queue->queues[priority], ((snet_queued_send_t){
+		.message = { .ptr = copy, .size = message.size },
+		.reliable = reliable,
+	}));
+	queue->size += message.size;
+}
+
+bool
+snet_send_queue_empty(const snet_send_queue_t* queue) {
+	for (int i = 0; i < SNET_NUM_PRIORITIES; ++i) {
+		if (alen(queue->queues[i]) > 0) { return false; }
+	}
+	return true;
+}
+
+size_t
+snet_send_queue_flush(
+	snet_send_queue_t* queue,
+	size_t budget,
+	size_t num_bytes_sent,
+	snet_send_fn_t send_fn,
+	void* ctx
+) {
+	static const snet_priority_t order[] = {
+		SNET_PRIORITY_HIGH,
+		SNET_PRIORITY_NORMAL,
+		SNET_PRIORITY_LOW,
+	};
+
+	bool full = false;
+	for (int i = 0; i < SNET_NUM_PRIORITIES; ++i) {
+		dyna snet_queued_send_t* sends = queue->queues[order[i]];
+		if (sends == NULL) { continue; }
+
+		int num_kept = 0;
+		for (int j = 0; j < alen(sends); ++j) {
+			snet_queued_send_t send = sends[j];
+			// A message bigger than the whole budget still goes out on its own
+			full = full
+				|| (budget > 0 && num_bytes_sent > 0 && num_bytes_sent + send.message.size > budget);
+
+			if (full && send.reliable) {
+				sends[num_kept++] = send;
+				continue;
+			}
+
+			if (!full) {
+				if (send_fn(ctx, send.message, send.reliable)) {
+					num_bytes_sent += send.message.size;
+				} else if (send.reliable) {
+					full = true;
+					sends[num_kept++] = send;
+					continue;
+				}
+			}
+			queue->size -= send.message.size;
+			cf_free((void*)send.message.ptr);
+		}
+		asetlen(queue->queues[order[i]], num_kept);
+	}
+
+	return num_bytes_sent;
+}
+
+#if SNET_ENABLE_TESTS
+
+#define SNET_SEND_QUEUE_TEST_NUM_MESSAGES 100
+// Like WebTransport which refuses reliable messages past this many in flight
+#define SNET_SEND_QUEUE_TEST_WINDOW 32
+
+typedef struct {
+	int num_accepted;
+	int window;
+	int received[SNET_SEND_QUEUE_TEST_NUM_MESSAGES];
+	int num_received;
+} snet_send_queue_test_transport_t;
+
+static bool
+snet_send_queue_test_send(void* ctx, snet_blob_t message, bool reliable) {
+	snet_send_queue_test_transport_t* transport = ctx;
+	if (transport->num_accepted >= transport->window) { return false; }
+
+	transport->num_accepted += 1;
+	int id;
+	memcpy(&id, message.ptr, sizeof(id));
+	transport->received[transport->num_received++] = id;
+	return true;
+}
+
+static void
+snet_send_queue_test_push(snet_send_queue_t* queue, int id, bool reliable, snet_priority_t priority) {
+	snet_send_queue_push(queue, (snet_blob_t){ .ptr = &id, .size = sizeof(id) }, reliable, priority);
+}
+
+// More reliable messages than the transport takes at once, such as after a
+// reconnect, go out over several flushes without losing any
+static void
+snet_send_queue_test_window(void) {
+	snet_send_queue_t queue = { 0 };
+	for (int i = 0; i < SNET_SEND_QUEUE_TEST_NUM_MESSAGES; ++i) {
+		snet_send_queue_test_push(&queue, i, true, SNET_PRIORITY_NORMAL);
+	}
+
+	snet_send_queue_test_transport_t transport = { .window = SNET_SEND_QUEUE_TEST_WINDOW };
+	int num_flushes = 0;
+	while (!snet_send_queue_empty(&queue)) {
+		// Acknowledgements free up the window between updates
+		transport.num_accepted = 0;
+		size_t num_bytes_sent = snet_send_queue_flush(&queue, 0, 0, snet_send_queue_test_send, &transport);
+		snet_check(num_bytes_sent == (size_t)transport.num_accepted * sizeof(int));
+		snet_check(++num_flushes <= SNET_SEND_QUEUE_TEST_NUM_MESSAGES);
+	}
+	snet_check(num_flushes == (SNET_SEND_QUEUE_TEST_NUM_MESSAGES + SNET_SEND_QUEUE_TEST_WINDOW - 1) / SNET_SEND_QUEUE_TEST_WINDOW);
+	snet_check(queue.size == 0);
+
+	snet_check(transport.num_received == SNET_SEND_QUEUE_TEST_NUM_MESSAGES);
+	for (int i = 0; i < SNET_SEND_QUEUE_TEST_NUM_MESSAGES; ++i) {
+		snet_check(transport.received[i] == i);
+	}
+
+	snet_send_queue_cleanup(&queue);
+}
+
+static void
+snet_send_queue_test_budget(void) {
+	snet_send_queue_t queue = { 0 };
+	snet_send_queue_test_push(&queue, 0, true, SNET_PRIORITY_LOW);
+	snet_send_queue_test_push(&queue, 1, false, SNET_PRIORITY_NORMAL);
+	snet_send_queue_test_push(&queue, 2, true, SNET_PRIORITY_NORMAL);
+	snet_send_queue_test_push(&queue, 3, false, SNET_PRIORITY_HIGH);
+
+	// Room for two: the unreliable normal one is sent, the rest do not fit
+	// and only the reliable ones are kept
+	snet_send_queue_test_transport_t transport = { .window = SNET_SEND_QUEUE_TEST_WINDOW };
+	snet_send_queue_flush(&queue, 2 * sizeof(int), 0, snet_send_queue_test_send, &transport);
+	snet_check(transport.num_received == 2);
+	snet_check(transport.received[0] == 3);
+	snet_check(transport.received[1] == 1);
+	snet_check(queue.size == 2 * sizeof(int));
+
+	snet_send_queue_flush(&queue, 0, 0, snet_send_queue_test_send, &transport);
+	snet_check(transport.num_received == 4);
+	snet_check(transport.received[2] == 2);
+	snet_check(transport.received[3] == 0);
+	snet_check(snet_send_queue_empty(&queue));
+
+	// A refused unreliable message is dropped while a refused reliable one
+	// stops the flush
+	snet_send_queue_test_push(&queue, 4, false, SNET_PRIORITY_HIGH);
+	snet_send_queue_test_push(&queue, 5, true, SNET_PRIORITY_NORMAL);
+	snet_send_queue_test_push(&queue, 6, false, SNET_PRIORITY_LOW);
+	transport.num_accepted = transport.window;
+	snet_send_queue_flush(&queue, 0, 0, snet_send_queue_test_send, &transport);
+	snet_check(transport.num_received == 4);
+	snet_check(alen(queue.queues[SNET_PRIORITY_HIGH]) == 0);
+	snet_check(alen(queue.queues[SNET_PRIORITY_NORMAL]) == 1);
+	snet_check(alen(queue.queues[SNET_PRIORITY_LOW]) == 0);
+	snet_check(queue.size == sizeof(int));
+
+	snet_send_queue_cleanup(&queue);
+}
+
+void
+snet_send_queue_test(void) {
+	snet_send_queue_test_window();
+	snet_send_queue_test_budget();
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef SLOPNET_SEND_QUEUE_H
+#define SLOPNET_SEND_QUEUE_H
+
+#include <slopnet.h>
+#include <cute_array.h>
+
+#define SNET_NUM_PRIORITIES (SNET_PRIORITY_LOW + 1)
+
+// Messages waiting for the send budget or for the connection to come back,
+// by priority.
+// Each message is copied into its own allocation.
+typedef struct {
+	snet_blob_t message;
+	bool reliable;
+} snet_queued_send_t;
+
+typedef struct {
+	dyna snet_queued_send_t* queues[SNET_NUM_PRIORITIES];
+	size_t size;
+} snet_send_queue_t;
+
+// Returns false when the transport has no room for the message right now
+typedef bool (*snet_send_fn_t)(void* ctx, snet_blob_t message, bool reliable);
+
+void
+snet_send_queue_cleanup(snet_send_queue_t* queue);
+
+void
+snet_send_queue_push(snet_send_queue_t* queue, snet_blob_t message, bool reliable, snet_priority_t priority);
+
+bool
+snet_send_queue_empty(const snet_send_queue_t* queue);
+
+// Sends queued messages highest priority first until budget bytes have been
+// sent, counting the num_bytes_sent already sent this update, 0 meaning
+// everything.
+// Unreliable messages which do not fit are dropped since they would be stale
+// by the next update.
+// Everything stops at the first reliable message the transport refuses, which
+// stays in front of its queue.
+// Returns the number of bytes sent in total.
+size_t
+snet_send_queue_flush(
+	snet_send_queue_t* queue,
+	size_t budget,
+	size_t num_bytes_sent,
+	snet_send_fn_t send,
+	void* ctx
+);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SLOPNET_SHARED_H
+#define SLOPNET_SHARED_H
+
+#include <slopnet.h>
+#include <stdint.h>
+#include "slopnet_clock.h"
+
+// Arena and connection pools shared by instances which are always updated
+// from the same thread
+typedef struct snet_shared_s snet_shared_t;
+
+snet_shared_t*
+snet_shared_init(void);
+
+// Every instance using it must have been cleaned up
+void
+snet_shared_cleanup(snet_shared_t* shared);
+
+// Must be called once per update of its instances
+void
+snet_shared_update(snet_shared_t* shared);
+
+// snet_update no longer updates the pools.
+// config->threaded is ignored.
+snet_t*
+snet_init_shared(const snet_config_t* config, snet_shared_t* shared);
+
+void
+snet_send_counters(snet_t* snet, uint64_t* num_messages, uint64_t* num_bytes);
+
+// snet_stream_open with an id picked by the caller, for the I/O thread
+void
+snet_stream_open_with_id(snet_t* snet, uint64_t id);
+
+// For the I/O thread to hand it over to the game thread
+const snet_clock_t*
+snet_relay_clock(snet_t* snet);
+
+#endif
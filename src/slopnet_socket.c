@@ -0,0 +1,397 @@
+// getaddrinfo and getifaddrs are hidden by a strict -std=c11 on glibc
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#	define _DEFAULT_SOURCE 1
+#endif
+
+#include "slopnet_socket.h"
+
+#ifndef __EMSCRIPTEN__
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <iphlpapi.h>
+#include <cute_alloc.h>
+
+typedef SOCKET snet_socket_handle_t;
+#define SNET_INVALID_SOCKET INVALID_SOCKET
+#define SNET_SEND_FLAGS 0
+
+static bool
+snet_socket_would_block(void) {
+	int error = WSAGetLastError();
+	return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+}
+
+static void
+snet_socket_close_handle(snet_socket_handle_t handle) {
+	closesocket(handle);
+}
+
+static bool
+snet_socket_startup(void) {
+	WSADATA wsa_data;
+	return WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0;
+}
+
+static void
+snet_socket_shutdown(void) {
+	WSACleanup();
+}
+
+static int
+snet_socket_poll_write(snet_socket_handle_t handle, short* revents) {
+	WSAPOLLFD poll_fd = { .fd = handle, .events = POLLOUT };
+	int result = WSAPoll(&poll_fd, 1, 0);
+	*revents = poll_fd.revents;
+	return result;
+}
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+typedef int snet_socket_handle_t;
+#define SNET_INVALID_SOCKET (-1)
+#ifdef MSG_NOSIGNAL
+#define SNET_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SNET_SEND_FLAGS 0
+#endif
+
+static bool
+snet_socket_would_block(void) {
+	return errno == EWOULDBLOCK || errno == EAGAIN || errno == EINPROGRESS;
+}
+
+static void
+snet_socket_close_handle(snet_socket_handle_t handle) {
+	close(handle);
+}
+
+static bool
+snet_socket_startup(void) {
+	return true;
+}
+
+static void
+snet_socket_shutdown(void) {
+}
+
+// Unlike select, poll works with any fd no matter how many are open
+static int
+snet_socket_poll_write(snet_socket_handle_t handle, short* revents) {
+	struct pollfd poll_fd = { .fd = handle, .events = POLLOUT };
+	int result = poll(&poll_fd, 1, 0);
+	*revents = poll_fd.revents;
+	return result;
+}
+
+#endif
+
+static uint64_t
+snet_socket_hash_address(const struct sockaddr* addr) {
+	const uint8_t* bytes;
+	size_t size;
+	if (addr->sa_family == AF_INET) {
+		bytes = (const uint8_t*)&((const struct sockaddr_in*)addr)->sin_addr;
+		size = sizeof(struct in_addr);
+	} else {
+		bytes = (const uint8_t*)&((const struct sockaddr_in6*)addr)->sin6_addr;
+		size = sizeof(struct in6_addr);
+	}
+
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull ^ addr->sa_family;
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+static snet_socket_handle_t
+snet_socket_handle(const snet_socket_t* sock) {
+	return (snet_socket_handle_t)sock->handle;
+}
+
+static void
+snet_socket_fail(snet_socket_t* sock) {
+	snet_socket_close(sock);
+	sock->state = SNET_SOCKET_ERROR;
+}
+
+// Tries the remaining resolved addresses until one connects or starts
+// connecting.
+// Such as "localhost" resolving to ::1 first for a server on 127.0.0.1.
+static void
+snet_socket_connect_next(snet_socket_t* sock) {
+	struct addrinfo* addr;
+	while ((addr = sock->next_addr) != NULL) {
+		sock->next_addr = addr->ai_next;
+
+		snet_socket_handle_t handle = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+		if (handle == SNET_INVALID_SOCKET) { continue; }
+
+#ifdef _WIN32
+		u_long non_blocking = 1;
+		ioctlsocket(handle, FIONBIO, &non_blocking);
+#else
+		fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+		int no_sigpipe = 1;
+		setsockopt(handle, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+#endif
+
+		// Requests are written in one go, there is nothing to coalesce
+		int no_delay = 1;
+		setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+
+		if (connect(handle, addr->ai_addr, (int)addr->ai_addrlen) == 0) {
+			sock->handle = (intptr_t)handle;
+			sock->state = SNET_SOCKET_CONNECTED;
+			freeaddrinfo(sock->addrs);
+			sock->addrs = NULL;
+			sock->next_addr = NULL;
+			return;
+		} else if (snet_socket_would_block()) {
+			sock->handle = (intptr_t)handle;
+			sock->state = SNET_SOCKET_CONNECTING;
+			return;
+		} else {
+			snet_socket_close_handle(handle);
+		}
+	}
+
+	snet_socket_fail(sock);
+}
+
+snet_socket_t
+snet_socket_connect(const char* host, int port) {
+	snet_socket_t sock = {
+		.handle = (intptr_t)SNET_INVALID_SOCKET,
+		.state = SNET_SOCKET_ERROR,
+	};
+
+	if (!snet_socket_startup()) { return sock; }
+
+	char port_str[16];
+	snprintf(port_str, sizeof(port_str), "%d", port);
+
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+		.ai_protocol = IPPROTO_TCP,
+	};
+	struct addrinfo* addrs;
+	if (getaddrinfo(host, port_str, &hints, &addrs) != 0) {
+		snet_socket_shutdown();
+		return sock;
+	}
+
+	sock.addrs = addrs;
+	sock.next_addr = addrs;
+	snet_socket_connect_next(&sock);
+	return sock;
+}
+
+snet_socket_state_t
+snet_socket_process(snet_socket_t* sock) {
+	snet_socket_handle_t handle = snet_socket_handle(sock);
+
+	if (sock->state == SNET_SOCKET_CONNECTING) {
+		short revents = 0;
+		int num_ready = snet_socket_poll_write(handle, &revents);
+		if (num_ready < 0) {
+			snet_socket_fail(sock);
+		} else if (num_ready > 0) {
+			int error = 0;
+			socklen_t error_size = sizeof(error);
+			getsockopt(handle, SOL_SOCKET, SO_ERROR, (char*)&error, &error_size);
+			if (error != 0 || (revents & (POLLERR | POLLHUP | POLLNVAL))) {
+				snet_socket_close_handle(handle);
+				sock->handle = (intptr_t)SNET_INVALID_SOCKET;
+				snet_socket_connect_next(sock);
+			} else {
+				sock->state = SNET_SOCKET_CONNECTED;
+				freeaddrinfo(sock->addrs);
+				sock->addrs = NULL;
+				sock->next_addr = NULL;
+			}
+		}
+	} else if (sock->state == SNET_SOCKET_CONNECTED) {
+		// Notice a close by the peer even when nothing is being read
+		char byte;
+		int result = recv(handle, &byte, 1, MSG_PEEK);
+		if (result == 0) {
+			sock->state = SNET_SOCKET_CLOSED;
+		} else if (result < 0 && !snet_socket_would_block()) {
+			snet_socket_fail(sock);
+		}
+	}
+
+	return sock->state;
+}
+
+int
+snet_socket_send(snet_socket_t* sock, const void* data, int size) {
+	if (sock->state != SNET_SOCKET_CONNECTED) { return -1; }
+
+	int result = send(snet_socket_handle(sock), data, size, SNET_SEND_FLAGS);
+	if (result >= 0) {
+		return result;
+	} else if (snet_socket_would_block()) {
+		return 0;
+	} else {
+		snet_socket_fail(sock);
+		return -1;
+	}
+}
+
+int
+snet_socket_recv(snet_socket_t* sock, void* buf, int size) {
+	if (sock->state == SNET_SOCKET_CLOSED) { return 0; }
+	if (sock->state != SNET_SOCKET_CONNECTED) { return -1; }
+
+	int result = recv(snet_socket_handle(sock), buf, size, 0);
+	if (result > 0) {
+		return result;
+	} else if (result == 0) {
+		sock->state = SNET_SOCKET_CLOSED;
+		return 0;
+	} else if (snet_socket_would_block()) {
+		return 0;
+	} else {
+		snet_socket_fail(sock);
+		return -1;
+	}
+}
+
+bool
+snet_socket_route_address(uint64_t* hash) {
+	if (!snet_socket_startup()) { return false; }
+
+	bool found = false;
+	snet_socket_handle_t handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (handle != SNET_INVALID_SOCKET) {
+		// Connecting a UDP socket only looks up the route, nothing is sent.
+		// Any public address will do.
+		struct sockaddr_in remote = {
+			.sin_family = AF_INET,
+			.sin_port = htons(9),
+			.sin_addr.s_addr = htonl(0x08080808),
+		};
+		struct sockaddr_in local = { 0 };
+		socklen_t local_size = sizeof(local);
+		if (
+			connect(handle, (const struct sockaddr*)&remote, sizeof(remote)) == 0
+			&& getsockname(handle, (struct sockaddr*)&local, &local_size) == 0
+			&& local.sin_addr.s_addr != htonl(INADDR_ANY)
+		) {
+			*hash = snet_socket_hash_address((const struct sockaddr*)&local);
+			found = true;
+		}
+		snet_socket_close_handle(handle);
+	}
+
+	snet_socket_shutdown();
+	return found;
+}
+
+#ifdef _WIN32
+
+int
+snet_socket_local_addresses(uint64_t* hashes, int max_hashes) {
+	ULONG flags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER;
+	ULONG size = 16 * 1024;
+	IP_ADAPTER_ADDRESSES* adapters = NULL;
+	ULONG result;
+	do {
+		cf_free(adapters);
+		adapters = cf_alloc(size);
+		result = GetAdaptersAddresses(AF_UNSPEC, flags, NULL, adapters, &size);
+	} while (result == ERROR_BUFFER_OVERFLOW);
+
+	if (result != NO_ERROR) {
+		cf_free(adapters);
+		return -1;
+	}
+
+	int num_hashes = 0;
+	for (IP_ADAPTER_ADDRESSES* adapter = adapters; adapter != NULL; adapter = adapter->Next) {
+		if (adapter->OperStatus != IfOperStatusUp || adapter->IfType == IF_TYPE_SOFTWARE_LOOPBACK) {
+			continue;
+		}
+
+		for (IP_ADAPTER_UNICAST_ADDRESS* itr = adapter->FirstUnicastAddress; itr != NULL; itr = itr->Next) {
+			const struct sockaddr* addr = itr->Address.lpSockaddr;
+			if ((addr->sa_family == AF_INET || addr->sa_family == AF_INET6) && num_hashes < max_hashes) {
+				hashes[num_hashes++] = snet_socket_hash_address(addr);
+			}
+		}
+	}
+
+	cf_free(adapters);
+	return num_hashes;
+}
+
+#else
+
+int
+snet_socket_local_addresses(uint64_t* hashes, int max_hashes) {
+	struct ifaddrs* addrs;
+	if (getifaddrs(&addrs) != 0) { return -1; }
+
+	int num_hashes = 0;
+	for (struct ifaddrs* itr = addrs; itr != NULL; itr = itr->ifa_next) {
+		if (itr->ifa_addr == NULL || !(itr->ifa_flags & IFF_UP) || (itr->ifa_flags & IFF_LOOPBACK)) {
+			continue;
+		}
+
+		int family = itr->ifa_addr->sa_family;
+		if ((family == AF_INET || family == AF_INET6) && num_hashes < max_hashes) {
+			hashes[num_hashes++] = snet_socket_hash_address(itr->ifa_addr);
+		}
+	}
+
+	freeifaddrs(addrs);
+	return num_hashes;
+}
+
+#endif
+
+void
+snet_socket_close(snet_socket_t* sock) {
+	// The socket library stays started while there is a handle or addresses
+	// left to try
+	bool started = snet_socket_handle(sock) != SNET_INVALID_SOCKET || sock->addrs != NULL;
+
+	if (snet_socket_handle(sock) != SNET_INVALID_SOCKET) {
+		snet_socket_close_handle(snet_socket_handle(sock));
+		sock->handle = (intptr_t)SNET_INVALID_SOCKET;
+	}
+	if (sock->addrs != NULL) {
+		freeaddrinfo(sock->addrs);
+		sock->addrs = NULL;
+		sock->next_addr = NULL;
+	}
+	if (started) { snet_socket_shutdown(); }
+	sock->state = SNET_SOCKET_CLOSED;
+}
+
+#endif
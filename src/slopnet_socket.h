@@ -0,0 +1,57 @@
+#ifndef SLOPNET_SOCKET_H
+#define SLOPNET_SOCKET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Minimal non-blocking TCP client for plain HTTP
+typedef enum {
+	SNET_SOCKET_ERROR,
+	SNET_SOCKET_CLOSED,
+	SNET_SOCKET_CONNECTING,
+	SNET_SOCKET_CONNECTED,
+} snet_socket_state_t;
+
+typedef struct {
+	intptr_t handle;
+	snet_socket_state_t state;
+
+	// Resolved addresses which are tried in turn until one connects
+	void* addrs;
+	void* next_addr;
+} snet_socket_t;
+
+// Name resolution blocks.
+// Every resolved address is tried until one connects.
+snet_socket_t
+snet_socket_connect(const char* host, int port);
+
+snet_socket_state_t
+snet_socket_process(snet_socket_t* sock);
+
+// Returns the number of bytes sent which may be less than size or -1 on error
+int
+snet_socket_send(snet_socket_t* sock, const void* data, int size);
+
+// Returns 0 if nothing is available or -1 on error.
+// The state becomes SNET_SOCKET_CLOSED once the peer has closed the
+// connection.
+int
+snet_socket_recv(snet_socket_t* sock, void* buf, int size);
+
+void
+snet_socket_close(snet_socket_t* sock);
+
+// Fills hashes with one hash per address of the local interfaces which are
+// up, skipping loopback, so a network handover can be noticed.
+// Returns the number of hashes or -1 if the addresses cannot be listed.
+int
+snet_socket_local_addresses(uint64_t* hashes, int max_hashes);
+
+// Hash of the local IPv4 address which the default route goes out from,
+// comparable with those of snet_socket_local_addresses.
+// Returns false when there is no such route.
+bool
+snet_socket_route_address(uint64_t* hash);
+
+#endif
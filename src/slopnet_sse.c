@@ -0,0 +1,216 @@
+#include "slopnet_sse.h"
+#include "slopnet_test.h"
+#include <cute_alloc.h>
+#include <string.h>
+
+static void
+snet_sse_buf_append(snet_sse_buf_t* buf, const char* data, size_t size) {
+	// Always leave room for the null terminator
+	size_t required = buf->size + size + 1;
+	if (required > buf->capacity) {
+		size_t capacity = buf->capacity > 0 ? buf->capacity : 64;
+		while (capacity < required) { capacity *= 2; }
+		buf->ptr = cf_realloc(buf->ptr, capacity);
+		buf->capacity = capacity;
+	}
+
+	if (size > 0) { memcpy(buf->ptr + buf->size, data, size); }
+	buf->size += size;
+	buf->ptr[buf->size] = '\0';
+}
+
+static void
+snet_sse_buf_set(snet_sse_buf_t* buf, const char* data, size_t size) {
+	buf->size = 0;
+	snet_sse_buf_append(buf, data, size);
+}
+
+static void
+snet_sse_buf_cleanup(snet_sse_buf_t* buf) {
+	cf_free(buf->ptr);
+	*buf = (snet_sse_buf_t){ 0 };
+}
+
+static bool
+snet_sse_field_is(const char* field, size_t size, const char* name) {
+	return strlen(name) == size && memcmp(field, name, size) == 0;
+}
+
+// Returns true if the line completes an event
+static bool
+snet_sse_process_line(snet_sse_parser_t* parser) {
+	const char* line = parser->line.ptr;
+	size_t size = parser->line.size;
+
+	if (size == 0) {
+		if (parser->data.size > 0) { return true; }
+
+		// An event without data is dropped
+		parser->type.size = 0;
+		return false;
+	}
+
+	// Comment, commonly used as a keep-alive
+	if (line[0] == ':') { return false; }
+
+	const char* colon = memchr(line, ':', size);
+	size_t field_size = colon != NULL ? (size_t)(colon - line) : size;
+	const char* value = colon != NULL ? colon + 1 : line + size;
+	size_t value_size = size - (size_t)(value - line);
+	if (value_size > 0 && value[0] == ' ') {
+		value += 1;
+		value_size -= 1;
+	}
+
+	if (snet_sse_field_is(line, field_size, "event")) {
+		snet_sse_buf_set(&parser->type, value, value_size);
+	} else if (snet_sse_field_is(line, field_size, "data")) {
+		snet_sse_buf_append(&parser->data, value, value_size);
+		snet_sse_buf_append(&parser->data, "\n", 1);
+	} else if (snet_sse_field_is(line, field_size, "id")) {
+		if (memchr(value, '\0', value_size) == NULL) {
+			snet_sse_buf_set(&parser->id, value, value_size);
+		}
+	}
+	// "retry" is ignored, reconnection is paced by the caller
+
+	return false;
+}
+
+void
+snet_sse_parser_init(snet_sse_parser_t* parser) {
+	*parser = (snet_sse_parser_t){ 0 };
+}
+
+void
+snet_sse_parser_cleanup(snet_sse_parser_t* parser) {
+	snet_sse_buf_cleanup(&parser->line);
+	snet_sse_buf_cleanup(&parser->type);
+	snet_sse_buf_cleanup(&parser->data);
+	snet_sse_buf_cleanup(&parser->id);
+}
+
+void
+snet_sse_parser_feed(snet_sse_parser_t* parser, const void* data, size_t size) {
+	parser->cur = data;
+	parser->end = parser->cur + size;
+}
+
+bool
+snet_sse_parser_next(snet_sse_parser_t* parser, snet_sse_event_t* event) {
+	if (parser->dispatched) {
+		parser->type.size = 0;
+		parser->data.size = 0;
+		parser->dispatched = false;
+	}
+
+	while (parser->cur < parser->end) {
+		if (parser->skip_lf) {
+			parser->skip_lf = false;
+			if (*parser->cur == '\n') {
+				parser->cur += 1;
+				continue;
+			}
+		}
+
+		// Lines end with CR, LF or CRLF
+		const char* eol = parser->cur;
+		while (eol < parser->end && *eol != '\n' && *eol != '\r') { ++eol; }
+
+		snet_sse_buf_append(&parser->line, parser->cur, (size_t)(eol - parser->cur));
+		if (eol == parser->end) {
+			parser->cur = eol;
+			break;
+		}
+
+		parser->skip_lf = *eol == '\r';
+		parser->cur = eol + 1;
+
+		bool dispatch = snet_sse_process_line(parser);
+		parser->line.size = 0;
+
+		if (dispatch) {
+			// Drop the newline after the last data line
+			parser->data.size -= 1;
+			parser->data.ptr[parser->data.size] = '\0';
+			parser->dispatched = true;
+
+			*event = (snet_sse_event_t){
+				.type = parser->type.size > 0 ? parser->type.ptr : "message",
+				.data = parser->data.ptr,
+				.data_size = parser->data.size,
+				.id = snet_sse_parser_last_id(parser),
+			};
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#if SNET_ENABLE_TESTS
+
+// Mixes every line ending, including a CRLF which can be split between chunks
+static const char snet_sse_test_stream[] =
+	": keep-alive\n"
+	"event: game_added\r\n"
+	"id: 7\r\n"
+	"data: first\r"
+	"data:second\n"
+	"\r\n"
+	"event: ignored\n"
+	"\n"
+	"data: {\"x\":1}\r"
+	"\r"
+	"id\n"
+	"data\n"
+	"\n";
+
+typedef struct {
+	const char* type;
+	const char* data;
+	const char* id;
+} snet_sse_test_event_t;
+
+static const snet_sse_test_event_t snet_sse_test_events[] = {
+	{ "game_added", "first\nsecond", "7" },
+	{ "message", "{\"x\":1}", "7" },
+	{ "message", "", "" },
+};
+
+static void
+snet_sse_test_chunked(size_t chunk_size) {
+	snet_sse_parser_t parser;
+	snet_sse_parser_init(&parser);
+
+	const char* itr = snet_sse_test_stream;
+	const char* end = itr + sizeof(snet_sse_test_stream) - 1;
+	int num_events = 0;
+	while (itr < end) {
+		size_t size = (size_t)(end - itr) < chunk_size ? (size_t)(end - itr) : chunk_size;
+		snet_sse_parser_feed(&parser, itr, size);
+		itr += size;
+
+		snet_sse_event_t event;
+		while (snet_sse_parser_next(&parser, &event)) {
+			snet_check(num_events < (int)(sizeof(snet_sse_test_events) / sizeof(snet_sse_test_events[0])));
+			const snet_sse_test_event_t* expected = &snet_sse_test_events[num_events++];
+			snet_check(strcmp(event.type, expected->type) == 0);
+			snet_check(strcmp(event.data, expected->data) == 0);
+			snet_check(event.data_size == strlen(expected->data));
+			snet_check(strcmp(event.id, expected->id) == 0);
+		}
+	}
+	snet_check(num_events == sizeof(snet_sse_test_events) / sizeof(snet_sse_test_events[0]));
+
+	snet_sse_parser_cleanup(&parser);
+}
+
+void
+snet_sse_test(void) {
+	for (size_t chunk_size = 1; chunk_size <= sizeof(snet_sse_test_stream); ++chunk_size) {
+		snet_sse_test_chunked(chunk_size);
+	}
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SLOPNET_SSE_H
+#define SLOPNET_SSE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct {
+	char* ptr;
+	size_t size;
+	size_t capacity;
+} snet_sse_buf_t;
+
+// Incremental server-sent events parser.
+// See: https://html.spec.whatwg.org/multipage/server-sent-events.html#event-stream-interpretation
+typedef struct {
+	const char* cur;
+	const char* end;
+	bool skip_lf;
+	bool dispatched;
+
+	snet_sse_buf_t line;
+	snet_sse_buf_t type;
+	snet_sse_buf_t data;
+	snet_sse_buf_t id;
+} snet_sse_parser_t;
+
+// All strings are null-terminated
+typedef struct {
+	const char* type;
+	const char* data;
+	size_t data_size;
+	// The last event id seen on the stream, not necessarily from this event
+	const char* id;
+} snet_sse_event_t;
+
+void
+snet_sse_parser_init(snet_sse_parser_t* parser);
+
+void
+snet_sse_parser_cleanup(snet_sse_parser_t* parser);
+
+// The data must stay valid until snet_sse_parser_next returns false
+void
+snet_sse_parser_feed(snet_sse_parser_t* parser, const void* data, size_t size);
+
+// The event is valid until the next call to snet_sse_parser_next
+bool
+snet_sse_parser_next(snet_sse_parser_t* parser, snet_sse_event_t* event);
+
+// Used for Last-Event-ID when resuming, empty if the server never sent one
+static inline const char*
+snet_sse_parser_last_id(snet_sse_parser_t* parser) {
+	return parser->id.size > 0 ? parser->id.ptr : "";
+}
+
+#endif
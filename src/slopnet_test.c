@@ -0,0 +1,161 @@
+#define SNET_ENABLE_TESTS 1
+#include "slopnet_test.h"
+#include "slopnet_msg_ring.h"
+#include "slopnet_clock.h"
+#include <string.h>
+
+static void
+snet_msg_ring_test_wrap_around(void) {
+	snet_msg_ring_t ring;
+	snet_msg_ring_init(&ring, 8, 64);
+
+	// Sizes which do not divide the byte ring so messages keep landing on
+	// the end and have to start over
+	uint8_t next_write = 0;
+	uint8_t next_read = 0;
+	int num_written = 0;
+	int num_read = 0;
+	for (int round = 0; round < 1000; ++round) {
+		size_t size = 1 + (size_t)(round * 7) % 29;
+		uint8_t* message;
+		while ((message = snet_msg_ring_reserve(&ring, size)) != NULL) {
+			for (size_t i = 0; i < size; ++i) { message[i] = next_write++; }
+			num_written += 1;
+			size = 1 + (size + 11) % 29;
+		}
+		snet_msg_ring_commit(&ring);
+
+		// Drain only some of it so the indices drift relative to each other
+		const void* read;
+		size_t read_size;
+		for (int i = 0; i <= round % 4 && snet_msg_ring_next(&ring, &read, &read_size); ++i) {
+			const uint8_t* bytes = read;
+			for (size_t j = 0; j < read_size; ++j) {
+				snet_check(bytes[j] == next_read++);
+			}
+			num_read += 1;
+		}
+		snet_msg_ring_release(&ring);
+	}
+
+	const void* read;
+	size_t read_size;
+	while (snet_msg_ring_next(&ring, &read, &read_size)) {
+		const uint8_t* bytes = read;
+		for (size_t j = 0; j < read_size; ++j) {
+			snet_check(bytes[j] == next_read++);
+		}
+		num_read += 1;
+	}
+	snet_msg_ring_release(&ring);
+	snet_check(num_read == num_written);
+	snet_check(num_written > 1000);
+
+	snet_msg_ring_cleanup(&ring);
+}
+
+static void
+snet_msg_ring_test_full(void) {
+	snet_msg_ring_t ring;
+	snet_msg_ring_init(&ring, 4, 64);
+
+	snet_check(snet_msg_ring_reserve(&ring, 65) == NULL);
+
+	// Out of descriptors
+	for (int i = 0; i < 4; ++i) {
+		snet_check(snet_msg_ring_reserve(&ring, 1) != NULL);
+	}
+	snet_check(snet_msg_ring_reserve(&ring, 1) == NULL);
+	snet_msg_ring_commit(&ring);
+
+	// Space only comes back after a release
+	const void* read;
+	size_t read_size;
+	snet_check(snet_msg_ring_next(&ring, &read, &read_size));
+	snet_check(snet_msg_ring_reserve(&ring, 1) == NULL);
+	snet_msg_ring_release(&ring);
+	snet_check(snet_msg_ring_reserve(&ring, 1) != NULL);
+
+	// Out of bytes: 60 free but not contiguous
+	snet_msg_ring_commit(&ring);
+	while (snet_msg_ring_next(&ring, &read, &read_size)) {}
+	snet_msg_ring_release(&ring);
+	snet_check(snet_msg_ring_reserve(&ring, 40) != NULL);
+	snet_check(snet_msg_ring_reserve(&ring, 40) == NULL);
+
+	snet_msg_ring_cleanup(&ring);
+}
+
+static void
+snet_clock_test_estimate(void) {
+	// The remote clock is 500s ahead and runs 200ppm fast
+	const double offset = 500.0;
+	const double drift = 0.0002;
+
+	snet_clock_t clock = { 0 };
+	double time, error;
+	snet_check(!snet_clock_estimate(&clock, 0.0, &time, &error));
+
+	unsigned seed = 1;
+	double now = 0.0;
+	int num_requests = 0;
+	while (now < 120.0) {
+		if (snet_clock_should_request(&clock, now)) {
+			seed = seed * 1103515245u + 12345u;
+			double rtt = 0.02 + (double)(seed >> 16 & 0x7FFF) / 0x7FFF * 0.2;
+			// The remote reads its clock anywhere in the round trip
+			double remote_at = now + rtt * (double)(seed & 0xFF) / 0xFF;
+			double remote_time = remote_at + offset + remote_at * drift;
+			snet_clock_add_sample(&clock, now, remote_time, now + rtt);
+			num_requests += 1;
+		}
+
+		if (snet_clock_estimate(&clock, now, &time, &error)) {
+			double actual = now + offset + now * drift;
+			snet_check(fabs(time - actual) <= error + 1e-9);
+		}
+		now += 0.05;
+	}
+	snet_check(error < 0.1);
+	// Backs off once there are enough samples
+	snet_check(num_requests < 120.0 / SNET_CLOCK_FAST_INTERVAL / 2);
+}
+
+static void
+snet_clock_test_unanswered(void) {
+	snet_clock_t clock = { 0 };
+	int num_requests = 0;
+	double now = 0.0;
+	for (; now < 60.0; now += 0.05) {
+		num_requests += snet_clock_should_request(&clock, now);
+	}
+	snet_check(num_requests == SNET_CLOCK_MAX_UNANSWERED);
+
+	// A late answer starts the requests again
+	snet_clock_add_sample(&clock, 0.0, 100.0, now);
+	snet_check(snet_clock_should_request(&clock, now));
+}
+
+static void
+snet_clock_test_encoding(void) {
+	char buf[8];
+	snet_clock_write_time(buf, 1234.5678);
+	snet_check(snet_clock_read_time(buf) == 1234.5678);
+}
+
+int
+main(void) {
+	snet_wire_test();
+	snet_json_test();
+	snet_sse_test();
+	snet_game_table_test();
+	snet_send_queue_test();
+	snet_msg_ring_test_wrap_around();
+	snet_msg_ring_test_full();
+	snet_clock_test_encoding();
+	snet_clock_test_unanswered();
+	snet_clock_test_estimate();
+
+	printf("All tests passed\n");
+	return 0;
+}
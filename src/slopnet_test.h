@@ -0,0 +1,41 @@
+#ifndef SLOPNET_TEST_H
+#define SLOPNET_TEST_H
+
+// Self tests of the modules which do not need a network.
+// Each module compiles its tests when SNET_ENABLE_TESTS is 1 and
+// slopnet_test.c runs them all.
+#ifndef SNET_ENABLE_TESTS
+#define SNET_ENABLE_TESTS 0
+#endif
+
+#if SNET_ENABLE_TESTS
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define snet_check(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("check failed: ( %s ), function %s, file %s, line %d\n", #condition, __func__, __FILE__, __LINE__); \
+			exit(1); \
+		} \
+	} while (0)
+
+void
+snet_wire_test(void);
+
+void
+snet_json_test(void);
+
+void
+snet_sse_test(void);
+
+void
+snet_game_table_test(void);
+
+void
+snet_send_queue_test(void);
+
+#endif
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef SLOPNET_TIME_H
+#define SLOPNET_TIME_H
+
+#include <cute_time.h>
+
+// CF_SECONDS only advances with the app's main loop while this can be read
+// from any thread
+static inline double
+snet_seconds(void) {
+	return (double)cf_get_ticks() / (double)cf_get_tick_frequency();
+}
+
+#endif
@@ -1,16 +1,42 @@
 #include "slopnet_transport.h"
+#include "slopnet_msg_ring.h"
+#include <string.h>
+
+// Received messages wait here until snet_transport_recv
+#define SNET_TRANSPORT_RECV_QUEUE_SIZE 1024
+#define SNET_TRANSPORT_RECV_BUF_SIZE (256 * 1024)
 
 #ifndef __EMSCRIPTEN__
 
 #include <cute_networking.h>
 #include <cute_alloc.h>
-#include <cute_time.h>
 #include <time.h>
+#include <SDL3/SDL_atomic.h>
+#include "slopnet_time.h"
+#include "slopnet_socket.h"
+
+#define SNET_TRANSPORT_NETWORK_CHECK_INTERVAL 0.5
+#define SNET_TRANSPORT_MAX_LOCAL_ADDRESSES 32
 
 struct snet_transport_s {
 	CF_Client* client;
 	double last_update;
-	void* last_packet;
+
+	// A session is tied to the address it was started from.
+	// When that address goes away, such as when switching from Wi-Fi to
+	// cellular, the connection is dropped right away instead of waiting for
+	// it to time out so the caller can rejoin from the new one.
+	// Other addresses coming and going, such as those of a VPN or a second
+	// adapter, do not matter.
+	uint64_t route_address;
+	bool has_route_address;
+	double next_network_check;
+	bool network_changed;
+
+	snet_msg_ring_t recv_ring;
+	// Popped from the client but did not fit into the ring yet
+	void* pending_packet;
+	int pending_packet_size;
 };
 
 snet_transport_t*
@@ -21,25 +47,99 @@ snet_transport_init(const char* configuration) {
 	snet_transport_t* transport = cf_alloc(sizeof(snet_transport_t));
 	*transport = (snet_transport_t){
 		.client = client,
+		.last_update = snet_seconds(),
+		.next_network_check = snet_seconds() + SNET_TRANSPORT_NETWORK_CHECK_INTERVAL,
 	};
+	// The client socket is not bound to an address so the one the relay sees
+	// is picked by the route.
+	// Relays are assumed to be reached through the default route.
+	transport->has_route_address = snet_socket_route_address(&transport->route_address);
+	snet_msg_ring_init(&transport->recv_ring, SNET_TRANSPORT_RECV_QUEUE_SIZE, SNET_TRANSPORT_RECV_BUF_SIZE);
 	return transport;
 }
 
+// One scan of the local addresses serves every transport in the process, such
+// as the many instances of a snet_group_t
+static SDL_SpinLock snet_transport_scan_lock;
+static bool snet_transport_scanned;
+static double snet_transport_scan_time;
+static uint64_t snet_transport_scan_addresses[SNET_TRANSPORT_MAX_LOCAL_ADDRESSES];
+static int snet_transport_scan_num_addresses;
+
+static bool
+snet_transport_lost_address(snet_transport_t* transport, double now) {
+	if (!transport->has_route_address) { return false; }
+
+	SDL_LockSpinlock(&snet_transport_scan_lock);
+	if (!snet_transport_scanned || now >= snet_transport_scan_time + SNET_TRANSPORT_NETWORK_CHECK_INTERVAL) {
+		snet_transport_scan_num_addresses = snet_socket_local_addresses(
+			snet_transport_scan_addresses, SNET_TRANSPORT_MAX_LOCAL_ADDRESSES
+		);
+		snet_transport_scanned = true;
+		snet_transport_scan_time = now;
+	}
+
+	// Unknown when the addresses cannot be listed
+	bool found = snet_transport_scan_num_addresses < 0;
+	for (int i = 0; i < snet_transport_scan_num_addresses && !found; ++i) {
+		found = snet_transport_scan_addresses[i] == transport->route_address;
+	}
+	SDL_UnlockSpinlock(&snet_transport_scan_lock);
+
+	return !found;
+}
+
 void
 snet_transport_cleanup(snet_transport_t* transport) {
 	cf_client_disconnect(transport->client);
-	if (transport->last_packet) {
-		cf_client_free_packet(transport->client, transport->last_packet);
-		transport->last_packet = NULL;
+	if (transport->pending_packet) {
+		cf_client_free_packet(transport->client, transport->pending_packet);
+		transport->pending_packet = NULL;
 	}
 	cf_destroy_client(transport->client);
+	snet_msg_ring_cleanup(&transport->recv_ring);
 	cf_free(transport);
 }
 
 void
 snet_transport_update(snet_transport_t* transport) {
-	cf_client_update(transport->client, CF_SECONDS - transport->last_update, time(NULL));
-	transport->last_update = CF_SECONDS;
+	double now = snet_seconds();
+	cf_client_update(transport->client, now - transport->last_update, time(NULL));
+	transport->last_update = now;
+
+	if (!transport->network_changed && now >= transport->next_network_check) {
+		transport->next_network_check = now + SNET_TRANSPORT_NETWORK_CHECK_INTERVAL;
+		if (snet_transport_lost_address(transport, now)) {
+			transport->network_changed = true;
+			cf_client_disconnect(transport->client);
+		}
+	}
+
+	snet_msg_ring_t* ring = &transport->recv_ring;
+	snet_msg_ring_release(ring);
+
+	while (true) {
+		if (transport->pending_packet == NULL) {
+			bool reliable;
+			if (!cf_client_pop_packet(
+				transport->client,
+				&transport->pending_packet, &transport->pending_packet_size,
+				&reliable
+			)) {
+				break;
+			}
+		}
+
+		// Otherwise the packet waits in the client until there is room
+		void* message = snet_msg_ring_reserve(ring, transport->pending_packet_size);
+		if (message == NULL) { break; }
+
+		memcpy(message, transport->pending_packet, transport->pending_packet_size);
+		cf_client_free_packet(transport->client, transport->pending_packet);
+		transport->pending_packet = NULL;
+	}
+
+	snet_msg_ring_commit(ring);
 }
 
 snet_transport_state_t
@@ -55,28 +155,13 @@ snet_transport_state(snet_transport_t* transport) {
 }
 
 bool
-snet_transport_recv(snet_transport_t* transport, const void** message, size_t* size) {
-	if (transport->last_packet) {
-		cf_client_free_packet(transport->client, transport->last_packet);
-		transport->last_packet = NULL;
-	}
-
-	bool reliable;
-	int sizei;
-	if (cf_client_pop_packet(transport->client, &transport->last_packet, &sizei, &reliable)) {
-		*message = transport->last_packet;
-		*size = sizei;
-		return true;
-	} else {
-		*message = NULL;
-		*size = 0;
-		return false;
-	}
+snet_transport_send(snet_transport_t* transport, const void* message, size_t size, bool reliable) {
+	return !cf_is_error(cf_client_send(transport->client, message, (int)size, reliable));
 }
 
-void
-snet_transport_send(snet_transport_t* transport, const void* message, size_t size, bool reliable) {
-	cf_client_send(transport->client, message, size, reliable);
+bool
+snet_transport_network_changed(snet_transport_t* transport) {
+	return transport->network_changed;
 }
 
 size_t
@@ -98,12 +183,14 @@ typedef struct {
 } snet_message_t;
 
 struct snet_transport_s {
-	snet_message_t* last_incoming_message;
 	int handle;
+	// Created once connected since it is sized after the path
 	snet_wt_t* wt;
 
-	int next_message;
-	dyna snet_message_t** incoming_messages;
+	snet_msg_ring_t recv_ring;
+	// Messages which did not fit into the ring, in order
+	int next_overflow;
+	dyna snet_message_t** overflow;
 
 	char recv_buf[SNET_WT_RECV_BUF_SIZE];
 };
@@ -140,21 +227,70 @@ snet_wt_send_callback(const void* message, size_t size, void* ctx) {
 	snet_transport_impl_send(transport->handle, message, size);
 }
 
+static void
+snet_transport_flush_overflow(snet_transport_t* transport) {
+	while (transport->next_overflow < alen(transport->overflow)) {
+		snet_message_t* msg = transport->overflow[transport->next_overflow];
+		void* message = snet_msg_ring_reserve(&transport->recv_ring, msg->size);
+		if (message == NULL) { return; }
+
+		memcpy(message, msg->data, msg->size);
+		free(msg);
+		++transport->next_overflow;
+	}
+
+	if (transport->next_overflow > 0) {
+		transport->next_overflow = 0;
+		aclear(transport->overflow);
+	}
+}
+
 static void
 snet_wt_process_callback(const void* message, size_t size, void* ctx) {
 	snet_transport_t* transport = ctx;
 
-	snet_message_t* msg = malloc(sizeof(snet_message_t) + size);
-	msg->size = size;
-	memcpy(msg->data, message, size);
+	// Reliable messages have already been acked so nothing can be dropped
+	void* dst = transport->next_overflow < alen(transport->overflow)
+		? NULL
+		: snet_msg_ring_reserve(&transport->recv_ring, size);
+	if (dst != NULL) {
+		memcpy(dst, message, size);
+	} else {
+		snet_message_t* msg = malloc(sizeof(snet_message_t) + size);
+		msg->size = size;
+		memcpy(msg->data, message, size);
+		apush(transport->overflow, msg);
+	}
+}
+
+// QUIC already probes the path so the browser's max datagram size is used
+// as is.
+// It can grow as the browser probes so snet_transport_update keeps following
+// it.
+static snet_wt_t*
+snet_transport_wt(snet_transport_t* transport) {
+	if (transport->wt == NULL && snet_transport_impl_state(transport->handle) == SNET_TRANSPORT_CONNECTED) {
+		snet_wt_config_t wt_config = {
+			.ctx = transport,
+			.send = snet_wt_send_callback,
+			.realloc = snet_wt_realloc_callback,
+			.process = snet_wt_process_callback,
+			.max_datagram_size = snet_transport_impl_max_datagram_size(transport->handle),
+		};
+		transport->wt = snet_wt_init(&wt_config, CF_SECONDS);
+	}
 
-	apush(transport->incoming_messages, msg);
+	return transport->wt;
 }
 
 EMSCRIPTEN_KEEPALIVE void
 snet_transport_process_incoming(void* ctx, size_t size) {
 	snet_transport_t* transport = ctx;
-	snet_wt_process_incoming(transport->wt, transport->recv_buf, size);
+	snet_wt_t* wt = snet_transport_wt(transport);
+	if (wt == NULL) { return; }
+
+	snet_wt_process_incoming(wt, transport->recv_buf, size);
+	snet_msg_ring_commit(&transport->recv_ring);
 }
 
 snet_transport_t*
@@ -163,14 +299,7 @@ snet_transport_init(const char* configuration) {
 	*transport = (snet_transport_t){
 		.handle = snet_transport_impl_connect(configuration, &transport->recv_buf[0], transport),
 	};
-
-	snet_wt_config_t wt_config = {
-		.ctx = transport,
-		.send = snet_wt_send_callback,
-		.realloc = snet_wt_realloc_callback,
-		.process = snet_wt_process_callback,
-	};
-	transport->wt = snet_wt_init(&wt_config, CF_SECONDS);
+	snet_msg_ring_init(&transport->recv_ring, SNET_TRANSPORT_RECV_QUEUE_SIZE, SNET_TRANSPORT_RECV_BUF_SIZE);
 
 	return transport;
 }
@@ -179,23 +308,29 @@ void
 snet_transport_cleanup(snet_transport_t* transport) {
 	snet_transport_impl_disconnect(transport->handle);
 
-	free(transport->last_incoming_message);
-
-	if (transport->incoming_messages) {
-		for (int i = 0 ; i < alen(transport->incoming_messages); ++i) {
-			free(transport->incoming_messages[i]);
+	if (transport->overflow) {
+		for (int i = transport->next_overflow; i < alen(transport->overflow); ++i) {
+			free(transport->overflow[i]);
 		}
-		afree(transport->incoming_messages);
+		afree(transport->overflow);
 	}
 
-	snet_wt_cleanup(transport->wt);
+	if (transport->wt != NULL) { snet_wt_cleanup(transport->wt); }
+	snet_msg_ring_cleanup(&transport->recv_ring);
 
 	free(transport);
 }
 
 void
 snet_transport_update(snet_transport_t* transport) {
-	snet_wt_update(transport->wt, CF_SECONDS);
+	snet_msg_ring_release(&transport->recv_ring);
+	snet_transport_flush_overflow(transport);
+	snet_wt_t* wt = snet_transport_wt(transport);
+	if (wt != NULL) {
+		snet_wt_set_max_datagram_size(wt, snet_transport_impl_max_datagram_size(transport->handle));
+		snet_wt_update(wt, CF_SECONDS);
+	}
+	snet_msg_ring_commit(&transport->recv_ring);
 }
 
 snet_transport_state_t
@@ -204,34 +339,15 @@ snet_transport_state(snet_transport_t* transport) {
 }
 
 bool
-snet_transport_recv(snet_transport_t* transport, const void** message, size_t* size) {
-	free(transport->last_incoming_message);
-	transport->last_incoming_message = NULL;
-
-	if (
-		transport->incoming_messages
-		&&
-		transport->next_message < alen(transport->incoming_messages)
-	) {  // There is at least a message
-		transport->last_incoming_message = transport->incoming_messages[transport->next_message];
-		transport->incoming_messages[transport->next_message] = NULL;
-		++transport->next_message;
-
-		*message = transport->last_incoming_message->data;
-		*size = transport->last_incoming_message->size;
-		return true;
-	} else {
-		if (transport->next_message > 0) {  // We reached the end of the queue
-			transport->next_message = 0;
-			aclear(transport->incoming_messages);
-		}
-		return false;
-	}
+snet_transport_send(snet_transport_t* transport, const void* message, size_t size, bool reliable) {
+	snet_wt_t* wt = snet_transport_wt(transport);
+	return wt != NULL && snet_wt_send(wt, message, size, reliable);
 }
 
-void
-snet_transport_send(snet_transport_t* transport, const void* message, size_t size, bool reliable) {
-	snet_wt_send(transport->wt, message, size, reliable);
+bool
+snet_transport_network_changed(snet_transport_t* transport) {
+	// The browser owns the connection
+	return false;
 }
 
 size_t
@@ -240,3 +356,16 @@ snet_transport_max_message_size(void) {
 }
 
 #endif
+
+bool
+snet_transport_recv(snet_transport_t* transport, const void** message, size_t* size) {
+	// Messages stay in the ring until the next update or until it is drained
+	if (snet_msg_ring_next(&transport->recv_ring, message, size)) {
+		return true;
+	} else {
+		snet_msg_ring_release(&transport->recv_ring);
+		*message = NULL;
+		*size = 0;
+		return false;
+	}
+}
@@ -27,10 +27,17 @@ snet_transport_update(snet_transport_t* transport);
 snet_transport_state_t
 snet_transport_state(snet_transport_t* transport);
 
+// Whether the transport disconnected because the local network changed.
+// Its configuration is then likely tied to the old address.
+bool
+snet_transport_network_changed(snet_transport_t* transport);
+
 bool
 snet_transport_recv(snet_transport_t* transport, const void** message, size_t* size);
 
-void
+// Returns false when the message was not accepted, such as when too many
+// reliable messages are in flight
+bool
 snet_transport_send(snet_transport_t* transport, const void* message, size_t size, bool reliable);
 
 #endif
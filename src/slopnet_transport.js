@@ -14,7 +14,7 @@ addToLibrary({
 				state: 1,
 				sendDatagram: () => {},
 				close: () => {},
-				maxDatagramSize: 0,
+				datagrams: null,
 				recvBuf: recvBuf,
 				context: context,
 				lastSend: performance.now(),
@@ -46,8 +46,9 @@ addToLibrary({
 
 		_snet_transport_impl_max_datagram_size = (handle) => {
 			const transport = handles.get(handle);
-			return transport ? transport.maxDatagramSize : 0;
-		}
+			// Read live since the browser raises it as it probes the path
+			return transport && transport.datagrams ? transport.datagrams.maxDatagramSize : 0;
+		};
 
 		const bufferPool = [];
 
@@ -119,7 +120,7 @@ addToLibrary({
 
 			if (wt !== null) {
 				transport.state = 2;
-				transport.maxDatagramSize = wt.datagrams.maxDatagramSize;
+				transport.datagrams = wt.datagrams;
 
 				const datagramWriter = wt.datagrams.writable.getWriter();
 				transport.sendDatagram = datagramWriter.write.bind(datagramWriter);
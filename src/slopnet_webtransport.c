@@ -4,16 +4,28 @@
 
 // These are copied from cute_net
 // They should be safe enough
-// Howevever, negotiation based on maxDatagramSize might be better
 #define SNET_WT_SEQUENCE_BUF_SIZE 32
 #define SNET_WT_MAX_FRAGMENTS 32
-#define SNET_WT_FRAGMENT_ABOVE 1015  /* Max datagram size keeps returning 1024 */
-									 /* and the reliable header is at most 9 bytes */
+// Used when the max datagram size is unknown
+#define SNET_WT_DEFAULT_MAX_DATAGRAM_SIZE 1024
+// The receiver expects every fragment but the last to be exactly this big so
+// it cannot follow the path without the other end agreeing.
+// Packets up to the max datagram size are sent whole instead.
 #define SNET_WT_FRAGMENT_SIZE 1000
 #define SNET_WT_MAX_INFLIGHT_RELIABLE_MESSAGES 32
+// One parity fragment per group lets a single lost fragment in the group be
+// rebuilt instead of resending the whole message
+#define SNET_WT_FRAGMENT_PARITY_GROUP 4
 
 #define SNET_WT_MAX_MESSAGE_SIZE (SNET_WT_MAX_FRAGMENTS * SNET_WT_FRAGMENT_SIZE)
 #define SNET_WT_RESEND_DELAY 0.2
+// Acks ride along with outgoing packets.
+// When there are none, an ack only packet goes out this long after the
+// first packet it acks or once this many packets wait for an ack, well
+// before the other end resends or the 32 packets ack window is exceeded.
+#define SNET_WT_ACK_DELAY 0.05
+#define SNET_WT_MAX_UNACKED_PACKETS 16
+#define SNET_WT_MAX_DEFERRED_SENDS 8
 
 typedef union {
 	struct {
@@ -40,6 +52,13 @@ typedef struct {
 	int members[SNET_WT_MAX_INFLIGHT_RELIABLE_MESSAGES];
 } snet_wt_index_list_t;
 
+typedef struct {
+	// NULL for unreliable messages
+	snet_wt_outgoing_reliable_message_t* reliable_message;
+	int size;
+	char data[];
+} snet_wt_deferred_send_t;
+
 struct snet_wt_s {
 	snet_wt_config_t config;
 	struct reliable_endpoint_t* endpoint;
@@ -54,7 +73,13 @@ struct snet_wt_s {
 	snet_wt_fragment_t* incoming_reliable_messages[SNET_WT_MAX_INFLIGHT_RELIABLE_MESSAGES * 2];
 
 	bool processing;
-	int deferred_send_size;
+	snet_wt_deferred_send_t* deferred_sends[SNET_WT_MAX_DEFERRED_SENDS];
+	int num_deferred_sends;
+
+	// Received packets which were not acked by an outgoing one yet
+	int num_unacked_packets;
+	double first_unacked_time;
+
 	uint8_t send_buf[SNET_WT_MAX_MESSAGE_SIZE];
 };
 
@@ -86,7 +111,9 @@ snet_wt_reliable_transmit(void* ctx, uint64_t id, uint16_t sequence, const uint8
 
 static int
 snet_wt_reliable_process(void* ctx, uint64_t id, uint16_t sequence, const uint8_t* packet_data, int packet_bytes) {
-	if (packet_bytes == 0) { return 0; }
+	// Only carries acks which are only read from accepted packets.
+	// It does not need an ack of its own.
+	if (packet_bytes == 0) { return 1; }
 
 	snet_wt_t* swt = ctx;
 
@@ -126,6 +153,10 @@ snet_wt_reliable_process(void* ctx, uint64_t id, uint16_t sequence, const uint8_
 		}
 	}
 
+	if (swt->num_unacked_packets++ == 0) {
+		swt->first_unacked_time = swt->time;
+	}
+
 	return 1;  // Should ack
 }
 
@@ -149,26 +180,78 @@ snet_wt_cleanup_reliable_message(snet_wt_t* swt, snet_wt_outgoing_reliable_messa
 	snet_wt_free(&swt->config, msg);
 }
 
+// Every packet carries all the acks so far
 static void
-snet_wt_flush_deferred_send(snet_wt_t* swt) {
-	if (swt->deferred_send_size > 0) {
-		reliable_endpoint_send_packet(swt->endpoint, swt->send_buf, swt->deferred_send_size);
-		swt->deferred_send_size = 0;
+snet_wt_send_packet(
+	snet_wt_t* swt,
+	snet_wt_outgoing_reliable_message_t* reliable_message,
+	const void* buf,
+	int size
+) {
+	swt->current_outgoing_reliable_message = reliable_message;
+	if (reliable_message != NULL) {
+		reliable_message->ack_sequence = reliable_endpoint_next_packet_sequence(swt->endpoint);
 	}
+	reliable_endpoint_send_packet(swt->endpoint, buf, size);
+	swt->current_outgoing_reliable_message = NULL;
+
+	swt->num_unacked_packets = 0;
+}
+
+static void
+snet_wt_flush_deferred_sends(snet_wt_t* swt) {
+	for (int i = 0; i < swt->num_deferred_sends; ++i) {
+		snet_wt_deferred_send_t* send = swt->deferred_sends[i];
+		snet_wt_send_packet(swt, send->reliable_message, send->data, send->size);
+		snet_wt_free(&swt->config, send);
+	}
+	swt->num_deferred_sends = 0;
 }
 
 static void
-snet_wt_maybe_send(snet_wt_t* swt, const void* buf, int size) {
+snet_wt_maybe_send(
+	snet_wt_t* swt,
+	snet_wt_outgoing_reliable_message_t* reliable_message,
+	const void* buf,
+	int size
+) {
 	if (swt->processing) {
 		// If this send is made right inside a processing call as a response,
 		// defer sending for a bit so we can ack the same message it is responding
 		// to
-		swt->deferred_send_size = size;
+		if (swt->num_deferred_sends >= SNET_WT_MAX_DEFERRED_SENDS) {
+			snet_wt_flush_deferred_sends(swt);
+		}
+
+		snet_wt_deferred_send_t* send = snet_wt_malloc(&swt->config, sizeof(snet_wt_deferred_send_t) + size);
+		send->reliable_message = reliable_message;
+		send->size = size;
+		memcpy(send->data, buf, size);
+		swt->deferred_sends[swt->num_deferred_sends++] = send;
 	} else {
-		reliable_endpoint_send_packet(swt->endpoint, buf, size);
+		snet_wt_flush_deferred_sends(swt);
+		snet_wt_send_packet(swt, reliable_message, buf, size);
 	}
 }
 
+static void
+snet_wt_maybe_send_acks(snet_wt_t* swt) {
+	if (
+		swt->num_unacked_packets >= SNET_WT_MAX_UNACKED_PACKETS
+		|| (swt->num_unacked_packets > 0 && swt->time - swt->first_unacked_time >= SNET_WT_ACK_DELAY)
+	) {
+		snet_wt_send_packet(swt, NULL, swt->send_buf, 0);
+	}
+}
+
+static int
+snet_wt_fragment_above(int max_datagram_size) {
+	if (max_datagram_size <= 0) { max_datagram_size = SNET_WT_DEFAULT_MAX_DATAGRAM_SIZE; }
+	// Bigger datagrams would not fit into the receive buffer of either end
+	if (max_datagram_size > SNET_WT_RECV_BUF_SIZE) { max_datagram_size = SNET_WT_RECV_BUF_SIZE; }
+	return max_datagram_size - RELIABLE_MAX_PACKET_HEADER_BYTES;
+}
+
 snet_wt_t*
 snet_wt_init(const snet_wt_config_t* config, double time) {
 	snet_wt_t* swt = snet_wt_malloc(config, sizeof(snet_wt_t));
@@ -183,15 +266,18 @@ snet_wt_init(const snet_wt_config_t* config, double time) {
 	swt->next_incoming_reliable_header.u8 = 0;
 	memset(swt->incoming_reliable_messages, 0, sizeof(swt->incoming_reliable_messages));
 
-	swt->deferred_send_size = 0;
+	swt->num_deferred_sends = 0;
 	swt->processing = false;
+	swt->num_unacked_packets = 0;
+	swt->first_unacked_time = time;
 
 	struct reliable_config_t endpoint_conf;
 	reliable_default_config(&endpoint_conf);
 	endpoint_conf.max_packet_size = SNET_WT_MAX_MESSAGE_SIZE;
-	endpoint_conf.fragment_above = SNET_WT_FRAGMENT_ABOVE;
+	endpoint_conf.fragment_above = snet_wt_fragment_above(config->max_datagram_size);
 	endpoint_conf.max_fragments = SNET_WT_MAX_FRAGMENTS;
 	endpoint_conf.fragment_size = SNET_WT_FRAGMENT_SIZE;
+	endpoint_conf.fragment_parity_group = SNET_WT_FRAGMENT_PARITY_GROUP;
 	endpoint_conf.transmit_packet_function = snet_wt_reliable_transmit;
 	endpoint_conf.process_packet_function = snet_wt_reliable_process;
 	endpoint_conf.allocate_function = snet_wt_reliable_allocate;
@@ -209,6 +295,10 @@ snet_wt_cleanup(snet_wt_t* swt) {
 
 	snet_wt_config_t config = swt->config;
 
+	for (int i = 0; i < swt->num_deferred_sends; ++i) {
+		snet_wt_free(&config, swt->deferred_sends[i]);
+	}
+
 	for (int i = 0; i < swt->num_outgoing_reliable_messages; ++i) {
 		snet_wt_cleanup_reliable_message(swt, swt->outgoing_reliable_messages[i]);
 	}
@@ -224,8 +314,6 @@ snet_wt_cleanup(snet_wt_t* swt) {
 
 bool
 snet_wt_send(snet_wt_t* swt, const void* message, size_t size, bool reliable) {
-	snet_wt_flush_deferred_send(swt);
-
 	if (reliable) {
 		if (size > SNET_WT_MAX_MESSAGE_SIZE - 1) { return false; }
 
@@ -233,12 +321,12 @@ snet_wt_send(snet_wt_t* swt, const void* message, size_t size, bool reliable) {
 			return false;
 		}
 
-		// Allocate a record to store fragments for retransmission
-		swt->current_outgoing_reliable_message = snet_wt_malloc(&swt->config, sizeof(snet_wt_outgoing_reliable_message_t));
-		swt->outgoing_reliable_messages[swt->num_outgoing_reliable_messages++] = swt->current_outgoing_reliable_message;
-		swt->current_outgoing_reliable_message->timestamp = swt->time;
-		swt->current_outgoing_reliable_message->ack_sequence = reliable_endpoint_next_packet_sequence(swt->endpoint);
-		swt->current_outgoing_reliable_message->num_fragments = 0;
+		// Allocate a record to store fragments for retransmission.
+		// Its ack sequence is only known once it is actually sent.
+		snet_wt_outgoing_reliable_message_t* reliable_message = snet_wt_malloc(&swt->config, sizeof(snet_wt_outgoing_reliable_message_t));
+		swt->outgoing_reliable_messages[swt->num_outgoing_reliable_messages++] = reliable_message;
+		reliable_message->timestamp = swt->time;
+		reliable_message->num_fragments = 0;
 
 		// Get the header
 		snet_wt_reliable_header_t header = swt->next_outgoing_reliable_header;
@@ -249,7 +337,7 @@ snet_wt_send(snet_wt_t* swt, const void* message, size_t size, bool reliable) {
 		memcpy(&swt->send_buf[1], message, size);
 
 		// Send the message
-		snet_wt_maybe_send(swt, swt->send_buf, (int)(size + 1));
+		snet_wt_maybe_send(swt, reliable_message, swt->send_buf, (int)(size + 1));
 		return true;
 	} else {
 		if (size > SNET_WT_MAX_MESSAGE_SIZE - 1) { return false; }
@@ -257,8 +345,7 @@ snet_wt_send(snet_wt_t* swt, const void* message, size_t size, bool reliable) {
 		swt->send_buf[0] = 0;  // Unreliable
 		memcpy(&swt->send_buf[1], message, size);
 
-		swt->current_outgoing_reliable_message = NULL;  // Don't store fragments
-		snet_wt_maybe_send(swt, swt->send_buf, (int)(size + 1));
+		snet_wt_maybe_send(swt, NULL, swt->send_buf, (int)(size + 1));  // Don't store fragments
 		return true;
 	}
 }
@@ -268,7 +355,8 @@ snet_wt_process_incoming(snet_wt_t* swt, const void* packet, size_t size) {
 	swt->processing = true;
 	reliable_endpoint_receive_packet(swt->endpoint, packet, (int)size);
 	swt->processing = false;
-	snet_wt_flush_deferred_send(swt);
+	snet_wt_flush_deferred_sends(swt);
+	snet_wt_maybe_send_acks(swt);
 
 	// Check acks for reliable messages
 	int num_acks;
@@ -298,11 +386,21 @@ snet_wt_process_incoming(snet_wt_t* swt, const void* packet, size_t size) {
 	reliable_endpoint_clear_acks(swt->endpoint);
 }
 
+void
+snet_wt_set_max_datagram_size(snet_wt_t* swt, int max_datagram_size) {
+	if (max_datagram_size == swt->config.max_datagram_size) { return; }
+
+	swt->config.max_datagram_size = max_datagram_size;
+	reliable_endpoint_set_fragment_above(swt->endpoint, snet_wt_fragment_above(max_datagram_size));
+}
+
 void
 snet_wt_update(snet_wt_t* swt, double time) {
 	reliable_endpoint_update(swt->endpoint, time);
 	swt->time = time;
 
+	snet_wt_maybe_send_acks(swt);
+
 	// Resend unacked messages
 	for (
 		int msg_index = 0;
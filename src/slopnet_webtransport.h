@@ -11,6 +11,10 @@ typedef struct {
 	void* (*realloc)(void* ptr, size_t size, void* ctx);
 	void (*send)(const void* message, size_t size, void* ctx);
 	void (*process)(const void* message, size_t size, void* ctx);
+
+	// Largest datagram the path takes, as reported by the browser.
+	// 0 assumes 1024.
+	int max_datagram_size;
 } snet_wt_config_t;
 
 typedef struct snet_wt_s snet_wt_t;
@@ -27,6 +31,10 @@ snet_wt_send(snet_wt_t* swt, const void* message, size_t size, bool reliable);
 void
 snet_wt_process_incoming(snet_wt_t* swt, const void* packet, size_t size);
 
+// Packets sent from now on are fragmented after the new size
+void
+snet_wt_set_max_datagram_size(snet_wt_t* swt, int max_datagram_size);
+
 void
 snet_wt_update(snet_wt_t* swt, double time);
 
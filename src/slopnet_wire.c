@@ -0,0 +1,159 @@
+#include "slopnet_wire.h"
+#include "slopnet_test.h"
+#include <string.h>
+
+void
+snet_wire_reader_init(snet_wire_reader_t* reader) {
+	*reader = (snet_wire_reader_t){ 0 };
+}
+
+void
+snet_wire_reader_feed(snet_wire_reader_t* reader, const void* data, size_t size) {
+	reader->cur = data;
+	reader->end = reader->cur + size;
+}
+
+snet_wire_status_t
+snet_wire_read_varint(snet_wire_reader_t* reader, uint64_t* value) {
+	while (reader->cur < reader->end) {
+		uint8_t byte = *reader->cur++;
+		if (reader->shift >= 64 || (reader->shift == 63 && byte > 1)) {
+			return SNET_WIRE_ERROR;
+		}
+
+		reader->varint |= (uint64_t)(byte & 0x7F) << reader->shift;
+		reader->shift += 7;
+
+		if ((byte & 0x80) == 0) {
+			*value = reader->varint;
+			reader->varint = 0;
+			reader->shift = 0;
+			return SNET_WIRE_OK;
+		}
+	}
+
+	return SNET_WIRE_NEED_MORE;
+}
+
+snet_wire_status_t
+snet_wire_read_bytes(snet_wire_reader_t* reader, void* dst, size_t size) {
+	size_t available = (size_t)(reader->end - reader->cur);
+	size_t remaining = size - reader->num_bytes_read;
+	size_t num_copied = available < remaining ? available : remaining;
+
+	if (num_copied > 0) {
+		memcpy((char*)dst + reader->num_bytes_read, reader->cur, num_copied);
+		reader->cur += num_copied;
+		reader->num_bytes_read += num_copied;
+	}
+
+	if (reader->num_bytes_read < size) { return SNET_WIRE_NEED_MORE; }
+
+	reader->num_bytes_read = 0;
+	return SNET_WIRE_OK;
+}
+
+size_t
+snet_wire_varint_size(uint64_t value) {
+	size_t size = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		size += 1;
+	}
+	return size;
+}
+
+char*
+snet_wire_write_varint(char* out, uint64_t value) {
+	while (value >= 0x80) {
+		*out++ = (char)((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	*out++ = (char)value;
+	return out;
+}
+
+char*
+snet_wire_write_string(char* out, const void* str, size_t size) {
+	out = snet_wire_write_varint(out, size);
+	if (size > 0) { memcpy(out, str, size); }
+	return out + size;
+}
+
+#if SNET_ENABLE_TESTS
+
+static void
+snet_wire_test_varint_round_trip(void) {
+	const uint64_t values[] = {
+		0, 1, 0x7F, 0x80, 0x3FFF, 0x4000, UINT32_MAX, (uint64_t)1 << 63, UINT64_MAX,
+	};
+
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+		char buf[SNET_WIRE_MAX_VARINT_SIZE];
+		char* end = snet_wire_write_varint(buf, values[i]);
+		snet_check((size_t)(end - buf) == snet_wire_varint_size(values[i]));
+
+		// One byte at a time to exercise resuming
+		snet_wire_reader_t reader;
+		snet_wire_reader_init(&reader);
+		uint64_t value = 0;
+		snet_wire_status_t status = SNET_WIRE_NEED_MORE;
+		for (char* itr = buf; itr < end; ++itr) {
+			snet_check(status == SNET_WIRE_NEED_MORE);
+			snet_wire_reader_feed(&reader, itr, 1);
+			status = snet_wire_read_varint(&reader, &value);
+		}
+		snet_check(status == SNET_WIRE_OK);
+		snet_check(value == values[i]);
+	}
+}
+
+static void
+snet_wire_test_varint_overflow(void) {
+	snet_wire_reader_t reader;
+	uint64_t value;
+
+	// 2^64 does not fit
+	const uint8_t too_large[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x02 };
+	snet_wire_reader_init(&reader);
+	snet_wire_reader_feed(&reader, too_large, sizeof(too_large));
+	snet_check(snet_wire_read_varint(&reader, &value) == SNET_WIRE_ERROR);
+
+	// Continuation past the tenth byte
+	const uint8_t too_long[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x81, 0x00 };
+	snet_wire_reader_init(&reader);
+	snet_wire_reader_feed(&reader, too_long, sizeof(too_long));
+	snet_check(snet_wire_read_varint(&reader, &value) == SNET_WIRE_ERROR);
+}
+
+static void
+snet_wire_test_string(void) {
+	char buf[64];
+	char* end = snet_wire_write_string(buf, "hello", 5);
+	end = snet_wire_write_string(end, "", 0);
+
+	snet_wire_reader_t reader;
+	snet_wire_reader_init(&reader);
+	snet_wire_reader_feed(&reader, buf, 3);
+
+	uint64_t size;
+	char str[5];
+	snet_check(snet_wire_read_varint(&reader, &size) == SNET_WIRE_OK);
+	snet_check(size == 5);
+	snet_check(snet_wire_read_bytes(&reader, str, size) == SNET_WIRE_NEED_MORE);
+	snet_wire_reader_feed(&reader, buf + 3, (size_t)(end - buf) - 3);
+	snet_check(snet_wire_read_bytes(&reader, str, size) == SNET_WIRE_OK);
+	snet_check(memcmp(str, "hello", 5) == 0);
+	snet_check(snet_wire_read_varint(&reader, &size) == SNET_WIRE_OK);
+	snet_check(size == 0);
+	snet_check(snet_wire_read_varint(&reader, &size) == SNET_WIRE_NEED_MORE);
+}
+
+void
+snet_wire_test(void) {
+	snet_wire_test_varint_round_trip();
+	snet_wire_test_varint_overflow();
+	snet_wire_test_string();
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SLOPNET_WIRE_H
+#define SLOPNET_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact binary lobby encoding, used instead of JSON when both sides
+// agree on SNET_WIRE_CONTENT_TYPE.
+//
+// Integers are unsigned LEB128 varints.
+// Strings are a varint length followed by the bytes, without terminator.
+//
+//     game          := join_token:string creator:string data:string
+//     create_game   := visibility:varint max_num_players:varint data:string
+//     created_game  := game
+//     game_list     := num_games:varint game* next_cursor:string
+//
+// visibility is 0 for public and 1 for private games.
+#define SNET_WIRE_CONTENT_TYPE "application/x-slopnet-lobby"
+#define SNET_WIRE_MAX_VARINT_SIZE 10
+#define SNET_WIRE_VISIBILITY_PUBLIC 0
+#define SNET_WIRE_VISIBILITY_PRIVATE 1
+
+typedef enum {
+	SNET_WIRE_NEED_MORE,
+	SNET_WIRE_ERROR,
+	SNET_WIRE_OK,
+} snet_wire_status_t;
+
+// Incremental reader.
+// A read which returns SNET_WIRE_NEED_MORE keeps its progress and must be
+// repeated with the same arguments after more data is fed.
+typedef struct {
+	const uint8_t* cur;
+	const uint8_t* end;
+
+	uint64_t varint;
+	int shift;
+	size_t num_bytes_read;
+} snet_wire_reader_t;
+
+void
+snet_wire_reader_init(snet_wire_reader_t* reader);
+
+void
+snet_wire_reader_feed(snet_wire_reader_t* reader, const void* data, size_t size);
+
+snet_wire_status_t
+snet_wire_read_varint(snet_wire_reader_t* reader, uint64_t* value);
+
+snet_wire_status_t
+snet_wire_read_bytes(snet_wire_reader_t* reader, void* dst, size_t size);
+
+size_t
+snet_wire_varint_size(uint64_t value);
+
+// Returns the end of what was written
+char*
+snet_wire_write_varint(char* out, uint64_t value);
+
+char*
+snet_wire_write_string(char* out, const void* str, size_t size);
+
+#endif